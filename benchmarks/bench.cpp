@@ -0,0 +1,419 @@
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "entrystore.h"
+#include "iconcache.h"
+#include "textrenderer.h"
+#include "texture.h"
+#include "scanner.h"
+#include "sorter.h"
+#include "filetypes.h"
+#include "treewalker.h"
+#include "treemodel.h"
+#include "contentsearch.h"
+#include "dupfinder.h"
+#include "treegen.h"
+#include "syscounter.h"
+
+/*****************************/
+/**  ALLOCATION COUNTING    **/
+/*****************************/
+
+// Every C++ allocation in the process (all threads) goes through these
+static std::atomic<long> Allocations(0);
+static std::atomic<long> AllocatedBytes(0);
+
+void* operator new(size_t size) {
+    Allocations++;
+    AllocatedBytes += size;
+    void* memory = malloc(size ? size : 1);
+    if(memory == NULL) { throw std::bad_alloc(); }
+    return memory;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+/*****************************/
+/**  MEASUREMENT            **/
+/*****************************/
+
+/* Everything measured about one benchmark */
+typedef struct Measurement {
+    std::string name;
+    long items;
+    double wall_ms;
+    SyscallCounts syscalls;
+    long allocations;
+    long allocated_bytes;
+    long peak_rss_kb;
+    // Extra "key": value pairs specific to the benchmark, already formatted as JSON
+    std::string extra;
+    // Set when what was measured didn't finish in time (the numbers cover only part of the work)
+    bool timed_out;
+} Measurement;
+
+/* Snapshot taken when a benchmark starts; finish() turns it into a Measurement */
+typedef struct Probe {
+    std::chrono::steady_clock::time_point start;
+    SyscallCounts syscalls;
+    long allocations;
+    long allocated_bytes;
+} Probe;
+
+static Probe startProbe() {
+    Probe probe;
+    probe.syscalls = countSyscalls();
+    probe.allocations = Allocations.load();
+    probe.allocated_bytes = AllocatedBytes.load();
+    probe.start = std::chrono::steady_clock::now();
+    return probe;
+}
+
+static Measurement finish(const Probe& probe, const std::string& name, long items, const std::string& extra = "") {
+    Measurement result;
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - probe.start).count();
+    result.name = name;
+    result.items = items;
+    result.syscalls = syscallsSince(probe.syscalls);
+    result.allocations = Allocations.load() - probe.allocations;
+    result.allocated_bytes = AllocatedBytes.load() - probe.allocated_bytes;
+    // Peak resident set size of the process so far (Linux reports kilobytes); it only grows, so later benchmarks include earlier peaks
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.extra = extra;
+    result.timed_out = false;
+    fprintf(stderr, "%-22s %8ld items %10.2f ms\n", name.c_str(), items, result.wall_ms);
+    return result;
+}
+
+static void printJSON(const TreeSpec& spec, const TreeStats& tree, long flat_files, const std::vector<Measurement>& results) {
+    printf("{\n  \"tree\": {\"fanout\": %d, \"depth\": %d, \"files_per_dir\": %d, \"name_min\": %d, \"name_max\": %d, \"seed\": %u, "
+           "\"directories\": %ld, \"files\": %ld, \"flat_files\": %ld},\n",
+           spec.fanout, spec.depth, spec.files_per_dir, spec.name_min, spec.name_max, spec.seed, tree.directories, tree.files, flat_files);
+    printf("  \"benchmarks\": [\n");
+    for(int i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        printf("    {\"name\": \"%s\", \"items\": %ld, \"wall_ms\": %.3f, \"syscalls\": %ld, \"syscalls_per_item\": %.3f, ",
+               m.name.c_str(), m.items, m.wall_ms, m.syscalls.syscalls(), m.items ? (double)m.syscalls.syscalls() / m.items : 0.0);
+        printf("\"syscall_breakdown\": {");
+        for(int k = 0; k < SYS_KIND_COUNT; k++) {
+            printf("%s\"%s\": %ld", k ? ", " : "", syscallName((SyscallKind)k), m.syscalls.calls[k]);
+        }
+        printf("}, \"allocations\": %ld, \"allocated_bytes\": %ld, \"peak_rss_kb\": %ld%s%s%s}%s\n",
+               m.allocations, m.allocated_bytes, m.peak_rss_kb, m.extra.empty() ? "" : ", ", m.extra.c_str(),
+               m.timed_out ? ", \"timed_out\": true" : "", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+/*****************************/
+/**  BENCHMARKS             **/
+/*****************************/
+
+/* Waits (through the SDL event queue, like the application) until 'done' returns true or 'seconds' pass;
+   false if the time ran out */
+template<class Done>
+static bool waitFor(Done done, double seconds) {
+    std::chrono::steady_clock::time_point limit = std::chrono::steady_clock::now() + std::chrono::milliseconds((long)(seconds * 1000));
+    SDL_Event event;
+    while(!done()) {
+        if(std::chrono::steady_clock::now() > limit) { return false; }
+        SDL_WaitEventTimeout(&event, 5);
+    }
+    return true;
+}
+
+/* Lists 'dirname' the way getDirectoryEntries() does, then fetches every entry's metadata (as sorting by size does) */
+static void benchScan(const std::string& dirname, std::vector<ScannedEntry>* scanned, std::vector<EntryMetadata>* metadata,
+                      std::vector<Measurement>* results) {
+    DirectoryScanner scanner(SDL_RegisterEvents(1));
+
+    Probe probe = startProbe();
+    bool finished = false;
+    bool stale;
+    scanner.start(dirname);
+    bool done = waitFor([&]() { scanner.takeEntries(scanned, &finished, &stale); return finished; }, 60);
+    results->push_back(finish(probe, "scan_list", scanned->size()));
+    results->back().timed_out = !done;
+
+    size_t wanted = 0;
+    for(int i = 0; i < scanned->size(); i++) {
+        if((*scanned)[i].type != ENTRY_DIR && (*scanned)[i].mode == 0) { wanted++; }
+    }
+    probe = startProbe();
+    scanner.requestAllMetadata();
+    done = waitFor([&]() { scanner.takeMetadata(metadata); return metadata->size() >= wanted; }, 60);
+    results->push_back(finish(probe, "scan_metadata", metadata->size()));
+    results->back().timed_out = !done;
+
+    // Sniffing only happens for rows asked for explicitly (the rows on screen in the application); ask for all of them at once
+    size_t unclassified = 0;
+    std::vector<int> rows;
+    for(int i = 0; i < scanned->size(); i++) {
+        rows.push_back(i);
+        if((*scanned)[i].type != ENTRY_DIR && classifyByExtension((*scanned)[i].name) == NULL) { unclassified++; }
+    }
+    probe = startProbe();
+    std::vector<EntryMetadata> sniffed;
+    scanner.requestMetadata(rows);
+    done = waitFor([&]() { scanner.takeMetadata(&sniffed); return sniffed.size() >= unclassified; }, 60);
+    results->push_back(finish(probe, "scan_sniff", sniffed.size()));
+    results->back().timed_out = !done;
+}
+
+/* Adds a scan's entries to a store, as receiveDirectoryEntries() does */
+static void benchEntries(const std::string& dirname, const std::vector<ScannedEntry>& scanned, const std::vector<EntryMetadata>& metadata,
+                         EntryStore* store, std::vector<uint32_t>* entries, std::vector<Measurement>* results) {
+    Probe probe = startProbe();
+    uint32_t parent = store->addParent(dirname);
+    for(int i = 0; i < scanned.size(); i++) {
+        uint32_t entry = store->add(parent, scanned[i].name, scanned[i].sort_key, scanned[i].type);
+        store->setMetadata(entry, scanned[i].size, scanned[i].mode, scanned[i].modified);
+        entries->push_back(entry);
+    }
+    for(int i = 0; i < metadata.size(); i++) {
+        store->setMetadata(metadata[i].index, metadata[i].size, metadata[i].mode, metadata[i].modified);
+    }
+    results->push_back(finish(probe, "create_entries", entries->size(),
+                              "\"store_bytes\": " + std::to_string(store->reservedBytes())));
+}
+
+/* Sorts the entries by every column in both directions */
+static void benchSort(const EntryStore& store, std::vector<uint32_t> entries, std::vector<Measurement>* results) {
+    static const char* const names[] = {"sort_name", "sort_size", "sort_type", "sort_permissions"};
+    for(int key = SORT_NAME; key <= SORT_PERMISSIONS; key++) {
+        Probe probe = startProbe();
+        for(int ascending = 1; ascending >= 0; ascending--) {
+            SortOrder order = {(SortKey)key, ascending == 1};
+            sortEntries(store, &entries, order);
+        }
+        results->push_back(finish(probe, names[key], entries.size() * 2));
+    }
+
+    // Collation keys are computed once per name; measure that separately
+    Probe probe = startProbe();
+    std::vector<std::string> names_only;
+    for(int i = 0; i < entries.size(); i++) { names_only.push_back(store.name(entries[i])); }
+    sortByName(&names_only, [](const std::string& name) -> const std::string& { return name; });
+    results->push_back(finish(probe, "sort_by_collation_key", names_only.size()));
+}
+
+/* Classifies every name by extension 'rounds' times */
+static void benchClassify(const std::vector<ScannedEntry>& scanned, int rounds, std::vector<Measurement>* results) {
+    Probe probe = startProbe();
+    long unknown = 0;
+    for(int round = 0; round < rounds; round++) {
+        for(int i = 0; i < scanned.size(); i++) {
+            if(classifyByExtension(scanned[i].name) == NULL) { unknown++; }
+        }
+    }
+    results->push_back(finish(probe, "classify_extension", scanned.size() * rounds,
+                              "\"needs_sniffing\": " + std::to_string(unknown / (rounds ? rounds : 1))));
+}
+
+/* Walks the whole tree into a TreeModel, as buildRecursiveEntries()/receiveRecursiveEntries() do */
+static void benchWalk(const std::string& root, std::vector<Measurement>* results) {
+    TreeWalker walker(SDL_RegisterEvents(1));
+    TreeModel model;
+
+    Probe probe = startProbe();
+    model.reset(root);
+    walker.start(root);
+    bool finished = false;
+    bool done = waitFor([&]() {
+        std::vector<WalkListing> listings;
+        walker.takeListings(&listings, &finished);
+        for(int i = 0; i < listings.size(); i++) { model.addListing(listings[i]); }
+        return finished;
+    }, 120);
+    results->push_back(finish(probe, "walk_tree", model.size()));
+    results->back().timed_out = !done;
+}
+
+/* Searches the contents of every file in the tree for the generated scripts' first line, as Ctrl+F searches do */
+static void benchContentSearch(const std::string& root, std::vector<Measurement>* results) {
+    ContentSearcher searcher(SDL_RegisterEvents(1));
+    std::vector<ContentMatch> matches;
+
+    Probe probe = startProbe();
+    searcher.start(root, "#!/bin/sh");
+    bool finished = false;
+    bool done = waitFor([&]() {
+        searcher.takeMatches(&matches, &finished);
+        return finished;
+    }, 120);
+    ContentSearchStats searched = searcher.stats();
+    double seconds = std::max(searched.elapsed_ms, 0.001) / 1000.0;
+    results->push_back(finish(probe, "content_search", searched.files,
+                              "\"matches\": " + std::to_string(matches.size()) + ", \"bytes\": " + std::to_string(searched.bytes) +
+                              ", \"skipped\": " + std::to_string(searched.skipped) +
+                              ", \"mib_per_second\": " + std::to_string(searched.bytes / seconds / (1024.0 * 1024.0))));
+    results->back().timed_out = !done;
+}
+
+/* Looks for duplicate files in the tree twice with one finder: the second run takes every hash from the cache */
+static void benchDuplicates(const std::string& root, std::vector<Measurement>* results) {
+    DuplicateFinder finder(SDL_RegisterEvents(1));
+    const char* names[] = {"find_duplicates", "find_duplicates_cached"};
+    for(int run = 0; run < 2; run++) {
+        Probe probe = startProbe();
+        finder.start(root);
+        std::vector<DuplicateGroup> groups;
+        bool done = waitFor([&]() { return finder.takeGroups(&groups); }, 120);
+        DuplicateStats found = finder.stats();
+        results->push_back(finish(probe, names[run], found.files,
+                                  "\"candidates\": " + std::to_string(found.candidates) + ", \"hashed\": " + std::to_string(found.hashed) +
+                                  ", \"hashed_bytes\": " + std::to_string(found.hashed_bytes) + ", \"groups\": " + std::to_string(found.groups) +
+                                  ", \"reclaimable\": " + std::to_string(found.reclaimable)));
+        results->back().timed_out = !done;
+    }
+}
+
+/* Creates the icon and glyph atlases on a software renderer and draws 'frames' frames of the entry list */
+static void benchRender(const EntryStore& store, const std::vector<uint32_t>& entries, IconCache* icons, int frames,
+                        std::vector<Measurement>* results) {
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, 800, 600, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = target ? SDL_CreateSoftwareRenderer(target) : NULL;
+    if(renderer == NULL) {
+        fprintf(stderr, "render benchmarks skipped: %s\n", SDL_GetError());
+        if(target) { SDL_FreeSurface(target); }
+        return;
+    }
+
+    TextRenderer text;
+    Probe probe = startProbe();
+    icons->load(renderer);
+    text.load(renderer, "resrc/OpenSans-Regular.ttf", 20);
+    results->push_back(finish(probe, "create_textures", TextureHandle::liveCount(),
+                              "\"live_textures\": " + std::to_string(TextureHandle::liveCount())));
+
+    // Same row layout as the list view: 45-pixel rows, icon at x=75, name, size and permissions columns
+    probe = startProbe();
+    SDL_Color color = {0, 0, 0, 255};
+    int rows = 12;
+    for(int frame = 0; frame < frames; frame++) {
+        SDL_SetRenderDrawColor(renderer, 235, 235, 235, 255);
+        SDL_RenderClear(renderer);
+        int first = entries.empty() ? 0 : (frame * 3) % entries.size();
+        for(int row = 0; row < rows && first + row < entries.size(); row++) {
+            uint32_t entry = entries[first + row];
+            int y = 62 + row * 45;
+            SDL_Rect icon = {75, y + 5, 35, 35};
+            icons->draw(renderer, entryIcon(store.type(entry)), &icon);
+            text.drawText(store.name(entry), 135, y + 5, color);
+            text.drawText(formatSize(store.size(entry)), 475, y + 5, color);
+            if(store.type(entry) != ENTRY_DIR && store.hasMetadata(entry)) {
+                text.drawText(getFilePermissions((mode_t)store.mode(entry)), 620, y + 5, color);
+            }
+        }
+        text.flush();
+        SDL_RenderPresent(renderer);
+    }
+    results->push_back(finish(probe, "render_frames", frames));
+
+    text.unload();
+    icons->unload();
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+}
+
+/*****************************/
+/**  MAIN                   **/
+/*****************************/
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--root DIR] [--fanout N] [--depth N] [--files N] [--flat N] [--name-min N] [--name-max N]\n"
+                    "          [--seed N] [--frames N]\n"
+                    "Generates (or reuses) a synthetic tree under DIR and prints benchmark results as JSON on stdout\n", program);
+}
+
+int main(int argc, char** argv) {
+    std::string root = "/tmp/fileexplorer-bench";
+    TreeSpec spec = {6, 3, 40, 4, 24, 1};
+    // Files in the single large directory used for scanning, sorting and classification
+    int flat_files = 20000;
+    int frames = 200;
+
+    for(int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if(i + 1 >= argc) { usage(argv[0]); return 2; }
+        const char* value = argv[++i];
+        if(option == "--root") { root = value; }
+        else if(option == "--fanout") { spec.fanout = atoi(value); }
+        else if(option == "--depth") { spec.depth = atoi(value); }
+        else if(option == "--files") { spec.files_per_dir = atoi(value); }
+        else if(option == "--flat") { flat_files = atoi(value); }
+        else if(option == "--name-min") { spec.name_min = atoi(value); }
+        else if(option == "--name-max") { spec.name_max = atoi(value); }
+        else if(option == "--seed") { spec.seed = strtoul(value, NULL, 10); }
+        else if(option == "--frames") { frames = atoi(value); }
+        else { usage(argv[0]); return 2; }
+    }
+    if(spec.name_min < 1 || spec.name_max < spec.name_min) { usage(argv[0]); return 2; }
+
+    // Nothing is shown: the dummy video driver needs no display, and rendering goes to a software renderer
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+    if(SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "SDL_Init: %s\n", SDL_GetError());
+        return 1;
+    }
+    IMG_Init(IMG_INIT_PNG);
+    TTF_Init();
+
+    // A nested tree for the recursive walk and one flat directory for everything else
+    TreeSpec flat_spec = spec;
+    flat_spec.fanout = 0;
+    flat_spec.depth = 0;
+    flat_spec.files_per_dir = flat_files;
+    TreeStats tree, flat;
+    mkdir(root.c_str(), 0755);
+    if(!generateTree(root + "/tree", spec, &tree) || !generateTree(root + "/flat", flat_spec, &flat)) {
+        return 1;
+    }
+
+    std::vector<Measurement> results;
+    std::vector<ScannedEntry> scanned;
+    std::vector<EntryMetadata> metadata;
+    benchScan(root + "/flat", &scanned, &metadata, &results);
+
+    IconCache icons;
+    EntryStore store;
+    std::vector<uint32_t> entries;
+    benchEntries(root + "/flat", scanned, metadata, &store, &entries, &results);
+    benchSort(store, entries, &results);
+    benchClassify(scanned, 10, &results);
+    benchWalk(root + "/tree", &results);
+    benchContentSearch(root + "/tree", &results);
+    benchDuplicates(root + "/tree", &results);
+    benchRender(store, entries, &icons, frames, &results);
+
+    printJSON(spec, tree, flat.files, results);
+    // Numbers of work that didn't finish can't be compared with anything; make the run fail
+    int status = 0;
+    for(int i = 0; i < results.size(); i++) {
+        if(results[i].timed_out) {
+            fprintf(stderr, "%s timed out\n", results[i].name.c_str());
+            status = 1;
+        }
+    }
+
+    TTF_Quit();
+    IMG_Quit();
+    SDL_Quit();
+    return status;
+}
@@ -0,0 +1,106 @@
+#include "syscounter.h"
+#include <atomic>
+#include <cstdarg>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static std::atomic<long> Counters[SYS_KIND_COUNT];
+
+long SyscallCounts::syscalls() const {
+    long total = 0;
+    for(int i = 0; i < SYS_KIND_COUNT; i++) {
+        if(i != SYS_READDIR) { total += calls[i]; }
+    }
+    return total;
+}
+
+const char* syscallName(SyscallKind kind) {
+    static const char* const names[SYS_KIND_COUNT] = {"open", "close", "dup", "stat", "pread", "getdents", "readdir_entries"};
+    return names[kind];
+}
+
+SyscallCounts countSyscalls() {
+    SyscallCounts counts;
+    for(int i = 0; i < SYS_KIND_COUNT; i++) { counts.calls[i] = Counters[i].load(); }
+    return counts;
+}
+
+SyscallCounts syscallsSince(const SyscallCounts& before) {
+    SyscallCounts counts = countSyscalls();
+    for(int i = 0; i < SYS_KIND_COUNT; i++) { counts.calls[i] -= before.calls[i]; }
+    return counts;
+}
+
+/* The linker sends every reference to e.g. open() in our objects to __wrap_open(); __real_open() is the libc function */
+extern "C" {
+    int __real_open(const char* path, int flags, ...);
+    int __real_openat(int dir_fd, const char* path, int flags, ...);
+    int __real_close(int fd);
+    int __real_dup(int fd);
+    int __real_fstat(int fd, struct stat* info);
+    int __real_fstatat(int dir_fd, const char* path, struct stat* info, int flags);
+    int __real_statx(int dir_fd, const char* path, int flags, unsigned int mask, struct statx* info);
+    ssize_t __real_pread(int fd, void* buffer, size_t count, off_t offset);
+    ssize_t __real_getdents64(int fd, void* buffer, size_t length);
+    struct dirent* __real_readdir(DIR* dir);
+
+    int __wrap_open(const char* path, int flags, ...) {
+        Counters[SYS_OPEN]++;
+        va_list args;
+        va_start(args, flags);
+        mode_t mode = (flags & O_CREAT) ? va_arg(args, int) : 0;
+        va_end(args);
+        return __real_open(path, flags, mode);
+    }
+
+    int __wrap_openat(int dir_fd, const char* path, int flags, ...) {
+        Counters[SYS_OPEN]++;
+        va_list args;
+        va_start(args, flags);
+        mode_t mode = (flags & O_CREAT) ? va_arg(args, int) : 0;
+        va_end(args);
+        return __real_openat(dir_fd, path, flags, mode);
+    }
+
+    int __wrap_close(int fd) {
+        Counters[SYS_CLOSE]++;
+        return __real_close(fd);
+    }
+
+    int __wrap_dup(int fd) {
+        Counters[SYS_DUP]++;
+        return __real_dup(fd);
+    }
+
+    int __wrap_fstat(int fd, struct stat* info) {
+        Counters[SYS_STAT]++;
+        return __real_fstat(fd, info);
+    }
+
+    int __wrap_fstatat(int dir_fd, const char* path, struct stat* info, int flags) {
+        Counters[SYS_STAT]++;
+        return __real_fstatat(dir_fd, path, info, flags);
+    }
+
+    int __wrap_statx(int dir_fd, const char* path, int flags, unsigned int mask, struct statx* info) {
+        Counters[SYS_STAT]++;
+        return __real_statx(dir_fd, path, flags, mask, info);
+    }
+
+    ssize_t __wrap_pread(int fd, void* buffer, size_t count, off_t offset) {
+        Counters[SYS_PREAD]++;
+        return __real_pread(fd, buffer, count, offset);
+    }
+
+    ssize_t __wrap_getdents64(int fd, void* buffer, size_t length) {
+        Counters[SYS_GETDENTS]++;
+        return __real_getdents64(fd, buffer, length);
+    }
+
+    struct dirent* __wrap_readdir(DIR* dir) {
+        Counters[SYS_READDIR]++;
+        return __real_readdir(dir);
+    }
+}
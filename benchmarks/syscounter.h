@@ -0,0 +1,23 @@
+#ifndef __SYSCOUNTER_H_
+#define __SYSCOUNTER_H_
+
+/* File system calls made by the code under test, counted by linking it with -Wl,--wrap=<call>
+   (see BENCH_WRAP in the Makefile). Only calls from our own objects are seen; readdir() is
+   counted per entry returned, since the getdents64 calls behind it happen inside libc, while
+   the scanner's own getdents64() calls are counted as they are */
+enum SyscallKind { SYS_OPEN, SYS_CLOSE, SYS_DUP, SYS_STAT, SYS_PREAD, SYS_GETDENTS, SYS_READDIR, SYS_KIND_COUNT };
+
+typedef struct SyscallCounts {
+    long calls[SYS_KIND_COUNT];
+    // Every call except readdir()
+    long syscalls() const;
+} SyscallCounts;
+
+// Name of a counter in the benchmark's output
+const char* syscallName(SyscallKind kind);
+// Counts since the start of the process (all threads)
+SyscallCounts countSyscalls();
+// Counts between two snapshots
+SyscallCounts syscallsSince(const SyscallCounts& before);
+
+#endif
@@ -0,0 +1,170 @@
+#include "treegen.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// File written at the root of every generated tree, holding the spec it was made from
+#define MARKER ".treegen"
+
+// Extensions handed out to generated files, including ones in mixed case, compound ones and ones the classifier has to sniff
+static const char* const Extensions[] = {
+    ".txt", ".cpp", ".h", ".PNG", ".jpg", ".mp4", ".tar.gz", ".test.js", ".py", ".ts", ".dat", "", ".md", ".MKV", ".json", ".o"
+};
+static const int ExtensionCount = sizeof(Extensions) / sizeof(Extensions[0]);
+
+// Leading bytes for files whose type is only known from their contents
+static const char PngMagic[] = "\x89PNG\r\n\x1a\n";
+static const char ScriptMagic[] = "#!/bin/sh\n";
+
+/* Small deterministic generator (xorshift32), so a seed always yields the same tree on every platform */
+typedef struct Random {
+    unsigned int state;
+    unsigned int next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    int range(int low, int high) { return low + next() % (high - low + 1); }
+} Random;
+
+static std::string describe(const TreeSpec& spec) {
+    char text[256];
+    snprintf(text, sizeof(text), "fanout=%d depth=%d files=%d names=%d-%d seed=%u\n",
+             spec.fanout, spec.depth, spec.files_per_dir, spec.name_min, spec.name_max, spec.seed);
+    return text;
+}
+
+/* A name of 'length' characters mixing cases and digit runs, so sorting exercises case folding and natural order */
+static std::string randomName(Random* random, int length) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_-";
+    std::string name;
+    while(name.size() < (size_t)length) {
+        if(random->next() % 6 == 0) {
+            name += std::to_string(random->next() % 1000);
+        } else {
+            name += letters[random->next() % (sizeof(letters) - 1)];
+        }
+    }
+    name.resize(length);
+    return name;
+}
+
+static bool writeFile(const std::string& path, const std::string& contents, mode_t mode) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if(fd < 0) { return false; }
+    bool ok = write(fd, contents.data(), contents.size()) == (ssize_t)contents.size();
+    close(fd);
+    return ok;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+static bool populate(const std::string& dir, const TreeSpec& spec, int level, Random* random, TreeStats* stats) {
+    stats->directories++;
+    for(int i = 0; i < spec.files_per_dir; i++) {
+        const char* extension = Extensions[random->next() % ExtensionCount];
+        // The index keeps names unique within the directory
+        std::string name = randomName(random, random->range(spec.name_min, spec.name_max)) + "_" + std::to_string(i) + extension;
+
+        // Sizes spread over several orders of magnitude; a few files are executable or start with a signature
+        std::string contents;
+        mode_t mode = 0644;
+        int kind = random->next() % 16;
+        if(kind == 0) {
+            contents = ScriptMagic;
+            mode = 0755;
+        } else if(kind == 1) {
+            contents.assign(PngMagic, sizeof(PngMagic) - 1);
+        }
+        contents.resize(contents.size() + (random->next() % 4096) * (kind == 2 ? 64 : 1), 'x');
+
+        if(!writeFile(dir + "/" + name, contents, mode)) {
+            perror(("generateTree: " + dir + "/" + name).c_str());
+            return false;
+        }
+        stats->files++;
+    }
+    if(level == spec.depth) { return true; }
+    for(int i = 0; i < spec.fanout; i++) {
+        std::string child = dir + "/" + randomName(random, random->range(spec.name_min, spec.name_max)) + "_d" + std::to_string(i);
+        if(mkdir(child.c_str(), 0755) != 0 || !populate(child, spec, level + 1, random, stats)) {
+            perror(("generateTree: " + child).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Counts what a reused tree contains */
+static void count(const std::string& dir, TreeStats* stats) {
+    stats->directories++;
+    DIR* handle = opendir(dir.c_str());
+    if(handle == NULL) { return; }
+    struct dirent* entry;
+    while((entry = readdir(handle)) != NULL) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, MARKER) == 0) { continue; }
+        if(entry->d_type == DT_DIR) {
+            count(dir + "/" + entry->d_name, stats);
+        } else {
+            stats->files++;
+        }
+    }
+    closedir(handle);
+}
+
+bool generateTree(const std::string& root, const TreeSpec& spec, TreeStats* stats) {
+    stats->directories = 0;
+    stats->files = 0;
+    std::string marker = root + "/" MARKER;
+    std::string wanted = describe(spec);
+
+    // Reuse an identical tree; anything else we generated is thrown away
+    char existing[256] = {0};
+    FILE* file = fopen(marker.c_str(), "r");
+    if(file != NULL) {
+        size_t length = fread(existing, 1, sizeof(existing) - 1, file);
+        existing[length] = '\0';
+        fclose(file);
+        if(wanted == existing) {
+            count(root, stats);
+            return true;
+        }
+        if(nftw(root.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+            perror(("generateTree: removing " + root).c_str());
+            return false;
+        }
+    } else {
+        DIR* handle = opendir(root.c_str());
+        if(handle != NULL) {
+            int entries = 0;
+            while(readdir(handle) != NULL) { entries++; }
+            closedir(handle);
+            // Only "." and ".." may be there
+            if(entries > 2) {
+                fprintf(stderr, "generateTree: '%s' is not empty and was not generated by this tool\n", root.c_str());
+                return false;
+            }
+        }
+    }
+
+    if(mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror(("generateTree: " + root).c_str());
+        return false;
+    }
+    // The marker holds the spec only once the tree is complete, so an interrupted run is regenerated instead of reused
+    if(!writeFile(marker, "incomplete\n", 0644)) {
+        perror(("generateTree: " + marker).c_str());
+        return false;
+    }
+    Random random = {spec.seed ? spec.seed : 1};
+    if(!populate(root, spec, 0, &random, stats)) { return false; }
+    return writeFile(marker, wanted, 0644);
+}
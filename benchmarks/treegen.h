@@ -0,0 +1,30 @@
+#ifndef __TREEGEN_H_
+#define __TREEGEN_H_
+
+#include <string>
+
+/* Shape of a synthetic directory tree */
+typedef struct TreeSpec {
+    // Subdirectories per directory, and how many levels of them below the root
+    int fanout;
+    int depth;
+    // Regular files in every directory
+    int files_per_dir;
+    // Range of the base name length (before the extension)
+    int name_min;
+    int name_max;
+    // Same seed and shape always produce the same names, sizes, types and permissions
+    unsigned int seed;
+} TreeSpec;
+
+typedef struct TreeStats {
+    long directories;
+    long files;
+} TreeStats;
+
+/* Creates the tree described by 'spec' under 'root'. A tree generated earlier with the same spec is
+   reused as is; one with a different spec is deleted first. Refuses to touch a non-empty 'root'
+   that it didn't generate. Returns false (and prints why) on failure */
+bool generateTree(const std::string& root, const TreeSpec& spec, TreeStats* stats);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __CONTENTSEARCH_H_
+#define __CONTENTSEARCH_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+/* One line of a file that contains the searched text */
+typedef struct ContentMatch {
+    std::string path;
+    // 1-based line number
+    int64_t line;
+    // The line without its leading whitespace, cut to a few hundred bytes around the match
+    std::string text;
+} ContentMatch;
+
+/* How far the current search has got, as returned by ContentSearcher::stats() */
+typedef struct ContentSearchStats {
+    // Text files searched and their total size; 'skipped' counts images, videos and files that look binary
+    int64_t files;
+    int64_t bytes;
+    int64_t skipped;
+    int64_t matches;
+    // Set when the search stopped at the match limit
+    bool truncated;
+    bool running;
+    double elapsed_ms;
+} ContentSearchStats;
+
+/* Searches the contents of every file under a directory for a literal string, on a pool of threads.
+   Directories and batches of files are separate tasks, so one directory holding thousands of
+   files is searched by every thread at once. Files are opened relative to their directory's
+   descriptor; small ones are read with a single pread() into a buffer each thread reuses, large
+   ones are mapped, except those modified in the last few seconds, which are read in windows (one
+   truncated while mapped would crash the process with SIGBUS). The search runs over the raw bytes:
+   candidate positions are found 16 bytes at a time by comparing the first and last byte of the
+   pattern with SSE2 and confirmed with memcmp(), and line numbers come from counting newlines the
+   same way, only up to each match. Images and videos (by their extension) and files with a NUL
+   byte in their first 8 KiB are skipped as binary. Symlinks to directories are not followed.
+   Matches are streamed to the UI thread as files finish; starting a new search cancels the one in
+   flight. */
+class ContentSearcher {
+    public:
+        // 'notify_event' is pushed to the SDL event queue whenever matches are ready or the search finished
+        ContentSearcher(Uint32 notify_event, int thread_count = 0);
+        ~ContentSearcher();
+
+        // Begin searching the files under 'root' for 'pattern' (matched byte for byte), cancelling any search in flight
+        void start(const std::string& root, const std::string& pattern);
+        // Stop the search; matches not yet taken are dropped
+        void cancel();
+        // Move the matches found since the last call into 'out' (appending). 'finished' is set once the search is done
+        void takeMatches(std::vector<ContentMatch>* out, bool* finished);
+        ContentSearchStats stats();
+
+    private:
+        /* An open directory descriptor shared by the tasks of its subdirectories and files */
+        struct DirHandle {
+            int fd;
+            explicit DirHandle(int fd) : fd(fd) {}
+            ~DirHandle();
+        };
+
+        /* A directory waiting to be listed, or a batch of files of one directory waiting to be searched */
+        struct Task {
+            // Opened relative to 'parent' when it is set, by 'path' otherwise (the root of the search)
+            std::shared_ptr<DirHandle> parent;
+            std::string name;
+            // Path of the directory; for a batch of files, the directory holding them
+            std::string path;
+            std::vector<std::string> files;
+            std::shared_ptr<const std::string> pattern;
+            unsigned int generation;
+        };
+
+        void work();
+        void list(Task& task);
+        void searchFile(int dir_fd, const Task& task, const std::string& name, std::vector<char>& buffer,
+                        std::vector<ContentMatch>* found);
+        void searchWindows(int fd, const Task& task, const std::string& name, std::vector<char>& buffer,
+                           std::vector<ContentMatch>* found);
+        void scan(const char* data, size_t size, int64_t first_line, const Task& task, const std::string& name,
+                  std::vector<ContentMatch>* found);
+        void wakeUI();
+
+        Uint32 notify_event;
+        std::vector<std::thread> workers;
+        std::atomic<unsigned int> generation;
+
+        // Counters of the current search
+        std::atomic<int64_t> files;
+        std::atomic<int64_t> bytes;
+        std::atomic<int64_t> skipped;
+        std::atomic<int64_t> matches;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        // Taken from the back, so the walk goes depth first and few descriptors are open at once
+        std::deque<Task> queue;
+        // Tasks taken by a worker and not finished yet; the search is done when this is 0 and the queue is empty
+        int busy;
+        bool done;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+        std::vector<ContentMatch> pending;
+        bool pending_finished;
+        bool stopping;
+        bool notified;
+};
+
+#endif
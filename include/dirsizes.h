@@ -0,0 +1,136 @@
+#ifndef __DIRSIZES_H_
+#define __DIRSIZES_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <list>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sys/types.h>
+
+/* Total size of one requested directory tree */
+typedef struct DirSizeResult {
+    // The index passed to DirSizer::request()
+    int index;
+    // Disk space used by the directory and everything below it, in bytes
+    int64_t bytes;
+} DirSizeResult;
+
+/* Computes recursive directory sizes (disk usage, like du -sx) on a pool of threads.
+   Every directory of a tree is a separate task, so one huge subdirectory is summed by all
+   threads at once; totals are added up into their parents as subdirectories finish, and a
+   requested directory is reported as soon as its whole tree is done. What a directory
+   directly holds (the bytes of its files and the names of its subdirectories) is cached by
+   device, inode and mtime: adding, removing or renaming an entry changes the directory's
+   mtime, so on a repeated visit an unchanged directory costs one fstat() instead of a
+   listing and a stat per file. Files that grow in place don't change it, so their new size
+   is only seen once something else in their directory changes. The cache is bounded by
+   'memory_budget', dropping the least recently used directories first. Symlinks are not followed,
+   other file systems mounted inside the tree are not entered, and a file with several hard
+   links inside one requested tree is counted once. */
+class DirSizer {
+    public:
+        // 'notify_event' is pushed to the SDL event queue whenever results are ready; the cache of listings
+        // is kept within 'memory_budget' bytes
+        DirSizer(Uint32 notify_event, size_t memory_budget, int thread_count = 0);
+        ~DirSizer();
+
+        // Queue the tree under 'path'; its total is reported with 'index'. Requests are started in order
+        void request(int index, const std::string& path);
+        // Drop every request queued or in progress, and results not yet taken (the cache is kept)
+        void cancel();
+        // Move the totals computed since the last call into 'out' (appending)
+        void takeResults(std::vector<DirSizeResult>* out);
+
+    private:
+        /* Running total of one directory; finished once its own listing and every subdirectory's total are in */
+        struct Total {
+            std::atomic<int64_t> bytes;
+            // Parts still missing: the directory's own listing plus one per subdirectory
+            std::atomic<int> pending;
+            std::shared_ptr<Total> parent;
+            // Request index for a requested directory, -1 below it
+            int index;
+            Total() : bytes(0), pending(1), index(-1) {}
+        };
+
+        /* Inodes of hard-linked files already counted in one requested tree */
+        struct LinkSet {
+            std::mutex lock;
+            std::set<ino_t> seen;
+        };
+
+        /* An open directory descriptor shared by the tasks of its subdirectories */
+        struct DirHandle {
+            int fd;
+            explicit DirHandle(int fd) : fd(fd) {}
+            ~DirHandle();
+        };
+
+        /* A directory waiting to be listed */
+        struct Task {
+            std::shared_ptr<Total> total;
+            // Opened relative to 'parent' when it is set, by 'path' otherwise
+            std::shared_ptr<DirHandle> parent;
+            std::string name;
+            std::string path;
+            // Device of the requested directory; the walk doesn't leave it
+            dev_t device;
+            std::shared_ptr<LinkSet> links;
+            unsigned int generation;
+        };
+
+        /* What a directory holds directly, as of its modification time */
+        struct Listing {
+            int64_t mtime;
+            // Files with a single link
+            int64_t file_bytes;
+            // Files with more than one link, counted through the request's LinkSet: inode and bytes
+            std::vector<std::pair<ino_t, int64_t> > linked;
+            std::vector<std::string> subdirs;
+        };
+
+        typedef std::pair<dev_t, ino_t> CacheKey;
+
+        /* A cached listing, with its place in the recency order */
+        struct Cached {
+            Listing listing;
+            size_t bytes;
+            std::list<CacheKey>::iterator use;
+        };
+
+        void work();
+        void list(Task& task);
+        bool cachedListing(dev_t dev, ino_t ino, int64_t mtime, Listing* out);
+        void cacheListing(dev_t dev, ino_t ino, const Listing& listing);
+        void finish(std::shared_ptr<Total> total, unsigned int task_generation);
+
+        Uint32 notify_event;
+        std::vector<std::thread> workers;
+        std::atomic<unsigned int> generation;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        // Subdirectories are taken from the back (depth first, few descriptors open); requests are queued at the front
+        std::deque<Task> queue;
+        std::vector<DirSizeResult> pending;
+        bool stopping;
+        bool notified;
+
+        std::mutex cache_lock;
+        std::map<CacheKey, Cached> cache;
+        // Keys of the cache, most recently used first
+        std::list<CacheKey> recency;
+        size_t cache_bytes;
+        size_t memory_budget;
+};
+
+#endif
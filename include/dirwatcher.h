@@ -0,0 +1,116 @@
+#ifndef __DIRWATCHER_H_
+#define __DIRWATCHER_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "entrystore.h"
+
+/* The state of one entry of a watched directory after a change */
+typedef struct WatchedEntry {
+    std::string name;
+    // False if the entry no longer exists
+    bool exists;
+    bool is_dir;
+    EntryType type;
+    // Size, mtime and mode are only set in incremental changes (-1, -1 and 0 otherwise)
+    int64_t size;
+    int64_t modified;
+    uint32_t mode;
+} WatchedEntry;
+
+/* What changed in one watched directory since the previous batch */
+typedef struct DirChanges {
+    // The directory, exactly as passed to DirWatcher::watch()
+    std::string dir;
+    // Set when 'entries' is the whole directory (names and types only) rather than the entries that changed: the first
+    // listing of a directory watched with 'list', or after events were lost. Entries missing from it are gone
+    bool complete;
+    std::vector<WatchedEntry> entries;
+    // Only in the batch that follows adding a watch for 'dir' (-1 otherwise): the directory's modification time once
+    // it was watched. A listing read before that, with an older mtime, may have missed changes no event will report
+    int64_t mtime;
+} DirChanges;
+
+/* Watches directories with inotify and reports what changed in them to the UI thread.
+   A thread waits on the inotify descriptor and wakes the event loop with an SDL event, like
+   the other workers. Events are coalesced: a burst (a build writing hundreds of files, a log
+   growing line by line) is collected until it has been quiet for a moment or has gone on for
+   too long, and every name it touched is reported once, with the state it has by then. Each
+   changed name costs one statx() relative to the directory, so the UI only updates the rows
+   that changed instead of rescanning. If the kernel's event queue overflows, every watched
+   directory is listed again in full. */
+class DirWatcher {
+    public:
+        // 'notify_event' is pushed to the SDL event queue whenever changes are ready
+        explicit DirWatcher(Uint32 notify_event);
+        ~DirWatcher();
+
+        // Start watching directory 'path' (a path watched already only counts one more user); with 'list' set, its
+        // whole contents are reported first as a complete batch. The watch itself is added by the watcher thread,
+        // so a hung mount never blocks the caller; a directory that can't be watched simply never reports
+        void watch(const std::string& path, bool list);
+        // Stop watching 'path' once every watch() of it has been undone; batches not yet taken are dropped
+        void unwatch(const std::string& path);
+        // Move the batches collected since the last call into 'out' (appending)
+        void takeChanges(std::vector<DirChanges>* out);
+
+    private:
+        /* One inotify watch; several paths can lead to the same directory */
+        struct Watch {
+            // Watched paths and how many times each was watched
+            std::map<std::string, int> paths;
+            // Names touched since the last batch
+            std::set<std::string> dirty;
+            // Report the whole directory with the next batch
+            bool relist;
+            Watch() : relist(false) {}
+        };
+
+        /* A watch() or unwatch() waiting for the thread */
+        struct Request {
+            std::string path;
+            bool list;
+            bool add;
+        };
+
+        void run();
+        void applyRequests();
+        void readEvents();
+        void flush();
+        void listDirectory(int dir_fd, DirChanges* out);
+        bool examine(int dir_fd, const std::string& name, WatchedEntry* out);
+        void wakeUI();
+
+        Uint32 notify_event;
+        int inotify_fd;
+        // Written to wake the thread (watch requests, shutdown)
+        int wake_fd;
+        std::thread worker;
+        std::atomic<bool> stopping;
+
+        std::mutex lock;
+        // watch() and unwatch() calls in order, applied by the thread
+        std::vector<Request> requests;
+        // How many times each path is watched, as the callers see it; batches of other paths are dropped
+        std::map<std::string, int> uses;
+        // Watch descriptor -> watch (only the thread changes these)
+        std::map<int, Watch> watches;
+        std::map<std::string, int> path_to_watch;
+        std::vector<DirChanges> pending;
+        // Set when an event is already queued and not yet answered by takeChanges()
+        bool notified;
+        // When the first and the latest event of the burst being collected arrived
+        std::chrono::steady_clock::time_point burst_start;
+        std::chrono::steady_clock::time_point burst_last;
+        bool collecting;
+};
+
+#endif
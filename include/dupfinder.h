@@ -0,0 +1,176 @@
+#ifndef __DUPFINDER_H_
+#define __DUPFINDER_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <sys/types.h>
+#include "entrystore.h"
+
+/* Files with identical contents */
+typedef struct DuplicateGroup {
+    // Size of each copy in bytes
+    int64_t size;
+    // Full paths, in name order
+    std::vector<std::string> paths;
+} DuplicateGroup;
+
+/* How far the current run has got, as returned by DuplicateFinder::stats() */
+typedef struct DuplicateStats {
+    // Non-empty regular files found below the directory, and how many share their size with another
+    int64_t files;
+    int64_t candidates;
+    // Files hashed (head and tail, or in full), bytes read for that, and hashes reused from earlier runs
+    int64_t hashed;
+    int64_t hashed_bytes;
+    int64_t cached;
+    // Once finished: the groups found and the bytes deleting all but one copy of each would free
+    int64_t groups;
+    int64_t reclaimable;
+    bool running;
+    double elapsed_ms;
+} DuplicateStats;
+
+/* Finds files with identical contents below a directory, on a pool of threads.
+   The tree is walked first (directories are separate tasks, like DirSizer's), collecting the size,
+   device, inode and mtime of every non-empty regular file. Only files sharing their size with
+   another can be duplicates, and only those are read at all: each is hashed over its first and
+   last 4 KiB, and only files that still share size and that hash are hashed in full. Files small
+   enough for the first hash to cover them whole are never read twice. Hashes are 64-bit XXH64,
+   computed over 1 MiB reads; the number of reads in flight is capped separately from the thread
+   count, so threads hash what they read while others wait on the disk, without flooding it with
+   seeks. The walk's files are kept in an EntryStore, so their paths cost little. Hashes are
+   cached by device, inode and mtime for the life of the finder, so running it again only reads
+   files that changed. Hard links to one inode count as one file, symlinks are not followed, and
+   other file systems mounted inside the tree are not entered. */
+class DuplicateFinder {
+    public:
+        // 'notify_event' is pushed to the SDL event queue as the run makes progress and when it finished;
+        // 'io_limit' caps the reads in flight at once
+        DuplicateFinder(Uint32 notify_event, int thread_count = 0, int io_limit = 4);
+        ~DuplicateFinder();
+
+        // Begin looking for duplicates below 'root', cancelling any run in flight
+        void start(const std::string& root);
+        // Stop the run; the hashes computed so far stay cached
+        void cancel();
+        // Move the groups of a finished run into 'out' (replacing its contents), largest reclaimable size first.
+        // Returns false while the run is still going (or was already taken)
+        bool takeGroups(std::vector<DuplicateGroup>* out);
+        DuplicateStats stats();
+
+    private:
+        /* Identity and hashes of a file found by the walk; its path, size and mtime are in the run's store */
+        struct Candidate {
+            dev_t dev;
+            ino_t ino;
+            // Hash of the first and last HEAD_BYTES (of the whole file when that covers it), and of the whole file
+            uint64_t head;
+            uint64_t full;
+            bool has_head;
+            bool has_full;
+        };
+
+        /* State of one run, shared by its tasks; tasks of a cancelled run finish on their own copy */
+        struct Run {
+            unsigned int generation;
+            // Device of the directory searched; the walk doesn't leave it
+            dev_t device;
+            // Every file found by the walk, at the same index in both; only appended to while listing
+            EntryStore store;
+            std::vector<Candidate> files;
+            // Indices of the files still in the running for a duplicate
+            std::vector<uint32_t> sized;
+            // What the queued tasks are doing; the next phase starts once they are all done
+            enum Phase { LISTING, HEADS, FULL } phase;
+            // Tasks of the run taken by a worker and not finished yet
+            int busy;
+        };
+
+        /* An open directory descriptor shared by the tasks of its subdirectories */
+        struct DirHandle {
+            int fd;
+            explicit DirHandle(int fd) : fd(fd) {}
+            ~DirHandle();
+        };
+
+        /* A directory waiting to be listed, or a batch of files (indices into the run's files) waiting to be hashed */
+        struct Task {
+            std::shared_ptr<Run> run;
+            // Opened relative to 'parent' when it is set, by 'path' otherwise (the directory searched)
+            std::shared_ptr<DirHandle> parent;
+            std::string name;
+            std::string path;
+            std::vector<uint32_t> files;
+        };
+
+        /* Hashes of a file as of its mtime and size */
+        struct CachedHash {
+            int64_t mtime;
+            int64_t size;
+            uint64_t head;
+            uint64_t full;
+            bool has_full;
+        };
+
+        void work();
+        void list(Task& task);
+        void hash(Task& task, std::vector<char>& buffer);
+        bool hashFile(Run& run, uint32_t index, bool full, std::vector<char>& buffer);
+        bool advance(Run& run, std::vector<Task>* tasks, std::vector<DuplicateGroup>* groups_out);
+        void acquireIO();
+        void releaseIO();
+        void wakeUI();
+
+        Uint32 notify_event;
+        int io_limit;
+        std::vector<std::thread> workers;
+        // Incremented by every start()/cancel(); tasks of an older run are dropped
+        std::atomic<unsigned int> generation;
+
+        // Counters of the current run
+        std::atomic<int64_t> files;
+        std::atomic<int64_t> candidates;
+        std::atomic<int64_t> hashed;
+        std::atomic<int64_t> hashed_bytes;
+        std::atomic<int64_t> cached;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        // Taken from the back, so the walk goes depth first and few descriptors are open at once
+        std::deque<Task> queue;
+        bool done;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+        // When the UI was last woken, for the progress shown while hashing
+        std::chrono::steady_clock::time_point woken;
+        // Result of the finished run; 'groups' is emptied by takeGroups(), the totals stay for stats()
+        std::vector<DuplicateGroup> groups;
+        bool groups_ready;
+        int64_t group_count;
+        int64_t reclaimable;
+        bool stopping;
+        bool notified;
+
+        // Reads in flight, at most 'io_limit'
+        std::mutex io_lock;
+        std::condition_variable io_free;
+        int io_busy;
+
+        std::mutex cache_lock;
+        std::map<std::pair<dev_t, ino_t>, CachedHash> cache;
+};
+
+/* 64-bit XXH64 hash of 'length' bytes */
+uint64_t xxh64(const void* data, size_t length, uint64_t seed);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __ENTRYSTORE_H_
+#define __ENTRYSTORE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "iconcache.h"
+
+/* What an entry is; decides its icon. The values follow the alphabetical order of the type names
+   ("code", "dir", "exe", "img", "other", "vid"), so sorting by type compares single bytes */
+enum EntryType : uint8_t {
+    ENTRY_CODE,
+    ENTRY_DIR,
+    ENTRY_EXE,
+    ENTRY_IMG,
+    ENTRY_OTHER,
+    ENTRY_VID
+};
+
+/* The EntryType of a type string as returned by classifyByExtension()/sniffFileType() ("other" for anything unknown) */
+EntryType entryTypeFromString(const char* type);
+/* Icon shown for an entry of 'type' */
+IconType entryIcon(EntryType type);
+/* Human-readable size ("12.50 MiB"); empty for -1 (not known yet) */
+std::string formatSize(int64_t size);
+
+/* Columnar storage for the entries of a view.
+   Every field is a separate array indexed by entry, names and collation keys are packed one
+   after another into two character pools, and the directory an entry lives in is stored once
+   per directory rather than once per entry. An entry costs 36 bytes plus its name and key, and
+   sorting or filtering only touches the columns it compares. Entries are appended and never
+   move, so an entry's index stays valid until reset(); removing one only flags it. Strings
+   shown on screen (size, permissions, full path) are formatted when a row is drawn. */
+class EntryStore {
+    public:
+        EntryStore();
+
+        // Drop every entry and directory; the memory is kept for the next view
+        void reset();
+        // Exchange contents with 'other' without copying
+        void swap(EntryStore& other);
+
+        // Register the directory following entries live in (each distinct one is stored once); returns its index
+        uint32_t addParent(const std::string& dir);
+        // Append an entry of directory 'parent' with collation key 'key' (see collationKey()); returns its index.
+        // Size and modification time start out unknown (-1)
+        uint32_t add(uint32_t parent, const std::string& name, const std::string& key, EntryType type);
+
+        // Number of entries added since the last reset(), removed ones included
+        size_t count() const { return types.size(); }
+
+        const char* name(uint32_t entry) const { return &names[name_starts[entry]]; }
+        size_t nameLength(uint32_t entry) const { return name_starts[entry + 1] - name_starts[entry] - 1; }
+        const char* key(uint32_t entry) const { return &keys[key_starts[entry]]; }
+        size_t keyLength(uint32_t entry) const { return key_starts[entry + 1] - key_starts[entry] - 1; }
+        // Directory holding the entry, and the entry's full path
+        const std::string& parentPath(uint32_t entry) const { return parents[parent_of[entry]]; }
+        std::string path(uint32_t entry) const;
+
+        EntryType type(uint32_t entry) const { return (EntryType)types[entry]; }
+        void setType(uint32_t entry, EntryType type) { types[entry] = type; }
+        // Size in bytes (a directory's is the total of its tree), -1 while not known
+        int64_t size(uint32_t entry) const { return sizes[entry]; }
+        void setSize(uint32_t entry, int64_t size) { sizes[entry] = size; }
+        // Modification time in nanoseconds since the epoch, -1 while not known
+        int64_t modified(uint32_t entry) const { return mtimes[entry]; }
+        // stat() mode bits, 0 while not known
+        uint32_t mode(uint32_t entry) const { return modes[entry]; }
+        bool hasMetadata(uint32_t entry) const { return modes[entry] != 0; }
+        void setMetadata(uint32_t entry, int64_t size, uint32_t mode, int64_t mtime);
+
+        // Width of the rendered name in pixels (-1 until first measured), used for hit testing
+        int nameWidth(uint32_t entry) const { return name_widths[entry] == UNMEASURED ? -1 : name_widths[entry]; }
+        void setNameWidth(uint32_t entry, int width) { name_widths[entry] = width < 0 ? UNMEASURED : std::min(width, UNMEASURED - 1); }
+
+        // Flag an entry as gone (it stays in the store, but views drop it)
+        void remove(uint32_t entry) { flags[entry] |= FLAG_REMOVED; }
+        bool isRemoved(uint32_t entry) const { return flags[entry] & FLAG_REMOVED; }
+        // Selection for file operations
+        void setSelected(uint32_t entry, bool selected) { flags[entry] = selected ? flags[entry] | FLAG_SELECTED : flags[entry] & ~FLAG_SELECTED; }
+        bool isSelected(uint32_t entry) const { return flags[entry] & FLAG_SELECTED; }
+
+        // Bytes reserved by the columns and pools right now
+        size_t reservedBytes() const;
+        // Largest number of entries and reserved bytes seen over the life of the store
+        size_t highWaterEntries() const { return std::max(high_water_entries, count()); }
+        size_t highWaterBytes() const { return std::max(high_water_bytes, reservedBytes()); }
+
+    private:
+        static const uint16_t UNMEASURED = 0xFFFF;
+        static const uint8_t FLAG_REMOVED = 1;
+        static const uint8_t FLAG_SELECTED = 2;
+
+        // NUL-terminated names and keys; entry i spans [starts[i], starts[i + 1])
+        std::vector<char> names;
+        std::vector<uint32_t> name_starts;
+        std::vector<char> keys;
+        std::vector<uint32_t> key_starts;
+
+        std::vector<std::string> parents;
+        std::unordered_map<std::string, uint32_t> parent_index;
+        std::vector<uint32_t> parent_of;
+
+        std::vector<uint8_t> types;
+        std::vector<uint8_t> flags;
+        std::vector<uint16_t> name_widths;
+        std::vector<uint32_t> modes;
+        std::vector<int64_t> sizes;
+        std::vector<int64_t> mtimes;
+
+        size_t high_water_entries;
+        size_t high_water_bytes;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __FILEOPS_H_
+#define __FILEOPS_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <sys/stat.h>
+
+enum FileOpKind { FILEOP_COPY, FILEOP_MOVE, FILEOP_DELETE, FILEOP_MKDIR };
+
+/* One queued operation: copy or move 'sources' into directory 'target', delete 'sources', or create directory 'name'
+   inside 'target'. Names already taken in 'target' are never overwritten; the new entry gets a free name instead */
+typedef struct FileOperation {
+    FileOpKind kind;
+    std::vector<std::string> sources;
+    std::string target;
+    std::string name;
+} FileOperation;
+
+/* How far the running operation has got, as returned by FileOperations::progress() */
+typedef struct FileOpProgress {
+    // False while nothing is running
+    bool active;
+    FileOpKind kind;
+    // Operations waiting behind the running one
+    int queued;
+    // Items (files, directories, links) and bytes done so far and in total; the totals grow while the sources are measured
+    int64_t items_done;
+    int64_t items_total;
+    int64_t bytes_done;
+    int64_t bytes_total;
+    // Throughput over the last second or so
+    double bytes_per_second;
+    // Name of the item being worked on
+    std::string current;
+} FileOpProgress;
+
+/* What became of a finished (or cancelled) operation */
+typedef struct FileOpResult {
+    FileOpKind kind;
+    bool cancelled;
+    int64_t items_done;
+    int64_t bytes_done;
+    // Items that failed, and why the first of them did
+    int failed;
+    std::string error;
+    double elapsed_ms;
+} FileOpResult;
+
+/* Copies, moves, deletes and creates files on a worker thread, one queued operation at a time.
+   File contents never pass through user space when the kernel can avoid it: a copy is first
+   tried as a reflink (FICLONE, which shares the extents on Btrfs, XFS and the like), then with
+   copy_file_range(), then with sendfile(). Data is copied in large chunks so progress is
+   reported and cancellation noticed between them. A move within one file system is a single
+   renameat2() that refuses to replace an existing name; across file systems it is a copy
+   followed by deleting the source once the copy is complete. Cancelling removes whatever the
+   running copy or move had half created (a cancelled move leaves its source where it was);
+   a cancelled delete stops where it is. Progress is kept in counters the UI reads without
+   waiting on the worker, which wakes it with 'notify_event' a few times a second. */
+class FileOperations {
+    public:
+        // 'notify_event' is pushed to the SDL event queue when progress was made or an operation finished
+        explicit FileOperations(Uint32 notify_event);
+        ~FileOperations();
+
+        // Add an operation to the end of the queue
+        void queue(const FileOperation& operation);
+        // Stop the running operation (undoing its half-done item) and drop the queued ones
+        void cancel();
+        // True while an operation is running or queued
+        bool busy();
+        FileOpProgress progress();
+        // Move the results of the operations finished since the last call into 'out' (appending)
+        void takeResults(std::vector<FileOpResult>* out);
+
+    private:
+        /* Bookkeeping of the running operation */
+        struct Job {
+            FileOperation operation;
+            unsigned int generation;
+            FileOpResult result;
+        };
+
+        void run();
+        void execute(Job& job);
+        bool cancelled(const Job& job) const { return generation != job.generation; }
+        void measure(int dir_fd, const std::string& name, const Job& job);
+        void move(int src_dir, const std::string& path, const std::string& name, int dst_dir, Job& job);
+        // 'path' is the source's full path, for error messages
+        bool copyItem(int src_dir, const std::string& path, const std::string& name, int dst_dir, const std::string& dst_name, Job& job);
+        bool copyFile(int src_dir, const std::string& path, const std::string& name, int dst_dir, const std::string& dst_name,
+                      const struct stat& info, Job& job);
+        // Removes 'name' and everything below it; a 'counted' removal shows in the progress and stops when cancelled
+        bool removeItem(int dir_fd, const std::string& path, const std::string& name, Job& job, bool counted);
+        void fail(Job& job, const std::string& message);
+        void advance(int64_t items, int64_t bytes, const char* current);
+        void wakeUI();
+
+        Uint32 notify_event;
+        std::thread worker;
+        std::atomic<unsigned int> generation;
+
+        // Progress of the running operation, written by the worker only
+        std::atomic<int64_t> items_done;
+        std::atomic<int64_t> items_total;
+        std::atomic<int64_t> bytes_done;
+        std::atomic<int64_t> bytes_total;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<FileOperation> waiting;
+        std::vector<FileOpResult> finished;
+        bool running;
+        FileOpKind running_kind;
+        std::string current;
+        double rate;
+        // When progress was last sampled for the throughput, and the bytes done then
+        std::chrono::steady_clock::time_point sampled;
+        int64_t sampled_bytes;
+        bool stopping;
+        bool notified;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __FILETYPES_H_
+#define __FILETYPES_H_
+
+#include <string>
+
+/* Type string of a regular file ("img", "vid", "code" or "other") from its final extension, ignoring case.
+   Returns NULL when the name has no extension or one that is unknown or ambiguous (".ts" is TypeScript or
+   an MPEG transport stream); the contents have to decide those (see sniffFileType()) */
+const char* classifyByExtension(const std::string& name);
+
+/* Type string of file 'name' inside the directory open as 'dir_fd' from its first bytes, read with a single
+   small pread(). Returns NULL if no known signature matched */
+const char* sniffFileType(int dir_fd, const char* name);
+
+#endif
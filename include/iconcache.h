@@ -0,0 +1,50 @@
+#ifndef __ICONCACHE_H_
+#define __ICONCACHE_H_
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include "texture.h"
+
+/* Every icon shipped in resrc/images; each one owns a fixed slot in the atlas */
+enum IconType {
+    ICON_FOLDER,
+    ICON_EXECUTABLE,
+    ICON_IMAGE,
+    ICON_VIDEO,
+    ICON_CODEFILE,
+    ICON_OTHERFILE,
+    ICON_HOME,
+    ICON_DESKTOP,
+    ICON_RECURSIVE,
+    ICON_BACK,
+    ICON_COUNT
+};
+
+/* Loads each icon PNG exactly once and packs them into a single atlas texture.
+   Entries only keep a pointer to their slot, so opening a directory never decodes an image. */
+class IconCache {
+    public:
+        IconCache();
+        ~IconCache();
+
+        // Decode all icons and upload the atlas (call once, after the renderer exists)
+        bool load(SDL_Renderer* renderer);
+        // Destroy the atlas (must happen before the renderer is destroyed)
+        void unload();
+        // The atlas texture shared by every icon
+        SDL_Texture* texture() const { return atlas.get(); }
+        // Source rectangle of an icon inside the atlas
+        const SDL_Rect* slot(IconType type) const { return &slots[type]; }
+        // Copy an icon from the atlas to 'dst', mirrored if 'flip' says so (the forward button is the back icon flipped)
+        void draw(SDL_Renderer* renderer, IconType type, const SDL_Rect* dst, SDL_RendererFlip flip = SDL_FLIP_NONE) const;
+
+    private:
+        // Icons are 48x48 PNGs; anything else is scaled into the cell
+        static const int CELL_SIZE = 48;
+        static const int ATLAS_COLUMNS = 4;
+
+        TextureHandle atlas;
+        SDL_Rect slots[ICON_COUNT];
+};
+
+#endif
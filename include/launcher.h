@@ -0,0 +1,59 @@
+#ifndef __LAUNCHER_H_
+#define __LAUNCHER_H_
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <sys/types.h>
+
+/* What happened to one opened file once its opener exited */
+typedef struct LaunchResult {
+    std::string path;
+    pid_t pid;
+    // Exit code of the opener, or minus the signal that killed it
+    int status;
+    // Time from the click to posix_spawnp() returning, and from then until the opener exited (milliseconds)
+    double spawn_ms;
+    double run_ms;
+} LaunchResult;
+
+/* Opens files with xdg-open without blocking the UI thread.
+   The opener is started with posix_spawnp() and the path passed as its own argument, so no shell
+   is involved and paths with spaces or quotes need no escaping. Children are reaped on a
+   background thread that sleeps on a self-pipe written by the SIGCHLD handler; it pushes
+   'notify_event' when results are ready. Only one Launcher may exist at a time, since it owns
+   the process's SIGCHLD handler. */
+class Launcher {
+    public:
+        explicit Launcher(Uint32 notify_event);
+        ~Launcher();
+
+        // Start opening 'path'; returns false (and prints why) if the opener couldn't be started
+        bool open(const std::string& path);
+        // Move the results of every opener that exited since the last call into 'out' (appending)
+        void takeResults(std::vector<LaunchResult>* out);
+
+    private:
+        /* An opener that is still running */
+        struct Launch {
+            std::string path;
+            std::chrono::steady_clock::time_point spawned;
+            double spawn_ms;
+        };
+
+        void reap();
+
+        Uint32 notify_event;
+        std::thread reaper;
+
+        std::mutex lock;
+        std::map<pid_t, Launch> running;
+        std::vector<LaunchResult> finished;
+        bool stopping;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __LISTVIEW_H_
+#define __LISTVIEW_H_
+
+#include <SDL.h>
+
+/* Scroll state and geometry of a vertically scrolling list of fixed-height rows.
+   Only the rows intersecting the viewport are ever drawn. */
+class ListView {
+    public:
+        ListView(SDL_Rect viewport, SDL_Rect scroll_track, int row_height);
+
+        // Set how many rows the list holds (clamps the scroll offset)
+        void setRowCount(int count);
+        int rowCount() const { return row_count; }
+
+        // Scrolling, in pixels; each returns true if the offset actually changed
+        bool scrollBy(int pixels);
+        bool scrollTo(int pixels);
+        bool scrollToTop() { return scrollTo(0); }
+        int scrollOffset() const { return scroll_offset; }
+
+        // Range of rows intersecting the viewport: [firstVisibleRow(), endVisibleRow())
+        int firstVisibleRow() const;
+        int endVisibleRow() const;
+        // Screen y coordinate of the top of a row
+        int rowTop(int row) const { return viewport.y + row * row_height - scroll_offset; }
+        int rowHeight() const { return row_height; }
+        // Row under screen coordinate y, or -1 if there is none
+        int rowAt(int y) const;
+        const SDL_Rect* area() const { return &viewport; }
+
+        // Scroll bar geometry and mouse interaction
+        SDL_Rect scrollThumb() const;
+        const SDL_Rect* scrollTrack() const { return &track; }
+        bool pressScrollBar(int mouse_x, int mouse_y);
+        bool dragScrollBar(int mouse_y);
+        void releaseScrollBar() { dragging = false; }
+        bool isDragging() const { return dragging; }
+
+        void drawScrollBar(SDL_Renderer* renderer) const;
+
+    private:
+        int maxScroll() const;
+
+        SDL_Rect viewport;
+        SDL_Rect track;
+        int row_height;
+        int row_count;
+        int scroll_offset;
+        // Set while the scroll thumb is held; grab_offset is where on the thumb it was grabbed
+        bool dragging;
+        int grab_offset;
+};
+
+#endif
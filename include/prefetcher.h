@@ -0,0 +1,81 @@
+#ifndef __PREFETCHER_H_
+#define __PREFETCHER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "scanner.h"
+
+// Listings older than this are not handed out (the metadata in them may have gone stale)
+#define PREFETCH_MAX_AGE_MS 30000
+// Rows of a prefetched listing whose metadata is fetched with it (the first screenful)
+#define PREFETCH_METADATA_ROWS 16
+
+/* Hit and miss counts of a Prefetcher, for tuning */
+typedef struct PrefetchStats {
+    // Navigations that found a fresh listing, and ones that didn't
+    long hits;
+    long misses;
+    // Listings read ahead, and those evicted (or expired) without ever being used
+    long fetched;
+    long wasted;
+    // Memory held by cached listings right now, in bytes
+    size_t bytes;
+} PrefetchStats;
+
+/* Reads the listings of directories the user is likely to open next, on a low-priority thread.
+   The UI hands over candidate directories in priority order (the hovered row first, then
+   recently visited ones, then the other visible directories); they are read with
+   readDirectoryListing() plus the metadata of their first screenful, and kept in an LRU cache
+   bounded by 'memory_budget'. Navigating to a cached directory passes its listing to the
+   DirectoryScanner, which uses it as long as the directory's mtime still matches. */
+class Prefetcher {
+    public:
+        explicit Prefetcher(size_t memory_budget);
+        ~Prefetcher();
+
+        // Replace the directories to read ahead, most likely first
+        void setCandidates(const std::vector<std::string>& paths);
+        // Stop reading ahead until the next setCandidates() (e.g. while a directory is being scanned)
+        void pause();
+        // The cached listing of 'path', or an empty pointer; counts a hit or a miss
+        std::shared_ptr<const DirectoryListing> take(const std::string& path);
+        PrefetchStats stats();
+
+    private:
+        struct Cached {
+            std::shared_ptr<const DirectoryListing> listing;
+            size_t bytes;
+            int64_t fetched_ms;
+            uint64_t last_used;
+            bool used;
+        };
+
+        void work();
+        void fetch(const std::string& path, unsigned int candidates_id);
+        void evict(size_t needed);
+
+        size_t memory_budget;
+        std::thread worker;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        // Paths the worker hasn't taken yet (it empties this), and the last list setCandidates() accepted, which the
+        // UI passes again on every redraw
+        std::vector<std::string> candidates;
+        std::vector<std::string> accepted;
+        // Incremented by every setCandidates()/pause(), so the worker drops a list that was replaced
+        std::atomic<unsigned int> generation;
+        bool stopping;
+        std::map<std::string, Cached> cache;
+        uint64_t use_clock;
+        PrefetchStats counters;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __PROFILER_H_
+#define __PROFILER_H_
+
+#include <stdint.h>
+#include <chrono>
+
+/* Scoped timers around hot paths. Each thread records into its own fixed-size ring buffer
+   (the oldest events are overwritten), so recording takes no lock and never allocates.
+   profilerExport() writes everything still in the rings as Chrome trace-event JSON, which
+   chrome://tracing and Perfetto can open. The timers are compiled out unless the program is
+   built with -DFE_PROFILE (make PROFILE=1). */
+
+// Entry arrivals are counted in this many buckets of 100 ms, covering the last second
+#define FRAME_ARRIVAL_BUCKETS 10
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef FE_PROFILE
+// Time the rest of the enclosing scope under 'name' (must be a string literal)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+// Label the calling thread in exported traces (must be a string literal)
+#define PROFILE_THREAD(name) profilerNameThread(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+// Nanoseconds since the profiler's epoch (steady clock)
+uint64_t profilerNow();
+void profilerRecord(const char* name, uint64_t start, uint64_t end);
+void profilerNameThread(const char* name);
+// Whether the timers were compiled in
+bool profilerEnabled();
+// Write the recorded events to 'path'; returns how many were written, or -1 on failure
+long profilerExport(const char* path);
+
+class ProfileScope {
+    public:
+        explicit ProfileScope(const char* name) : name(name), start(profilerNow()) {}
+        ~ProfileScope() { profilerRecord(name, start, profilerNow()); }
+
+    private:
+        const char* name;
+        uint64_t start;
+};
+
+/* Frame time and entry throughput for the on-screen overlay; cheap enough to keep in every build */
+class FrameStats {
+    public:
+        FrameStats();
+
+        void beginFrame();
+        void endFrame();
+        // Duration of the last frame and a running average (milliseconds)
+        double frameMs() const { return last_ms; }
+        double averageFrameMs() const { return average_ms; }
+
+        // Count entries as they arrive from the scanner or walker
+        void addEntries(int count);
+        // Entries that arrived during the last second
+        double entriesPerSecond();
+
+    private:
+        std::chrono::steady_clock::time_point frame_start;
+        double last_ms;
+        double average_ms;
+        // Entries counted in each 100 ms slot (since the clock's epoch) of the last second, by slot modulo the bucket count
+        int64_t arrival_slot[FRAME_ARRIVAL_BUCKETS];
+        int64_t arrival_count[FRAME_ARRIVAL_BUCKETS];
+};
+
+#endif
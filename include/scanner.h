@@ -0,0 +1,155 @@
+#ifndef __SCANNER_H_
+#define __SCANNER_H_
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "entrystore.h"
+
+/* Metadata gathered by the scanner for one directory entry; added to an EntryStore on the UI thread.
+   Size, mode and modification time are only known when 'mode' isn't 0 (see requestMetadata()) */
+typedef struct ScannedEntry {
+    std::string name;
+    EntryType type;
+    int64_t size;
+    // Modification time in nanoseconds since the epoch (-1 until the metadata is known)
+    int64_t modified;
+    uint32_t mode;
+    // Collation key the scanner sorted by (see collationKey())
+    std::string sort_key;
+} ScannedEntry;
+
+/* Size and permissions (and for some files the type) of an entry, fetched after it was published;
+   'index' is its position in the scan */
+typedef struct EntryMetadata {
+    int index;
+    int64_t size;
+    int64_t modified;
+    uint32_t mode;
+    bool executable;
+    // Set when the file's contents decided its type ('type'), for names that don't
+    bool typed;
+    EntryType type;
+} EntryMetadata;
+
+/* What is known about a file before it is published: its stat fields, when 'known' is set */
+typedef struct FileMetadata {
+    bool known;
+    mode_t mode;
+    int64_t size;
+    int64_t mtime;
+} FileMetadata;
+
+/* The sorted names and d_types of a directory, read by a DirectoryScanner or ahead of time by a Prefetcher */
+typedef struct DirectoryListing {
+    // Modification time of the directory when it was read; the listing is only used while it still matches
+    int64_t mtime;
+    std::vector<std::pair<std::string, unsigned char> > files;
+    // Collation key of each name (see collationKey())
+    std::vector<std::string> keys;
+    // Metadata fetched along with the listing, by position in 'files' (may be shorter than 'files', or empty)
+    std::vector<FileMetadata> metadata;
+} DirectoryListing;
+
+/* Reads and sorts the entries of the directory open as 'dir_fd' (everything but "."); stops early and returns false
+   if '*generation' stops being 'id' meanwhile, or if the directory can't be read */
+bool readDirectoryListing(int dir_fd, DirectoryListing* out, const std::atomic<unsigned int>* generation, unsigned int id);
+/* Mode, size and modification time (in nanoseconds) of 'name' inside the directory open as 'dir_fd', following symlinks */
+bool fetchMetadata(int dir_fd, const char* name, mode_t* mode, off_t* size, int64_t* mtime);
+/* Modification time of the directory open as 'dir_fd' in nanoseconds, or -1 */
+int64_t directoryMtime(int dir_fd);
+
+/* Reads a directory on a worker thread and streams its entries to the UI thread in batches.
+   Names are read with getdents64() into a large buffer, so even a directory of millions of files
+   takes a handful of system calls, and entries are typed from the d_type that comes with them,
+   so listing costs no stat calls unless the file system doesn't report types (or for symlinks).
+   The size and permissions columns are fetched afterwards with one statx() per entry relative to
+   the directory's descriptor, and only for the rows the UI asks for; files whose name doesn't
+   decide their type get it from a single small read of their first bytes at the same time. The
+   worker appends to a back buffer under a short lock and the UI thread swaps it out, so neither
+   side waits on the other. Starting a new scan cancels the one in flight. A listing read ahead of
+   time (see Prefetcher) replaces the directory read and sort when the directory hasn't changed since. */
+class DirectoryScanner {
+    public:
+        // 'notify_event' is pushed to the SDL event queue whenever new entries or metadata are ready
+        explicit DirectoryScanner(Uint32 notify_event);
+        ~DirectoryScanner();
+
+        // Begin scanning 'dirname', cancelling any scan in flight. 'prefetched', if given, is used instead of
+        // reading the directory again as long as the directory's mtime still matches it
+        void start(const std::string& dirname, std::shared_ptr<const DirectoryListing> prefetched = std::shared_ptr<const DirectoryListing>());
+        // Serve metadata for a directory whose entries the UI still has from an earlier scan, without listing it again.
+        // 'entries' holds them at the indices that scan published them at; only what they still lack is fetched.
+        // The worker first checks that the directory's mtime is still 'mtime'; if not, takeEntries() reports it stale
+        void resume(const std::string& dirname, const EntryStore& entries, int64_t mtime);
+        // Stop the worker without waiting for it; entries it already published are dropped
+        void cancel();
+
+        // Move everything published since the last call into 'out' (appending).
+        // 'finished' is set once the last batch of the current scan has been taken, 'stale' once a resumed
+        // directory turned out to have changed (its entries have to be listed again with start())
+        void takeEntries(std::vector<ScannedEntry>* out, bool* finished, bool* stale);
+        // Modification time of the directory when the current scan listed it; -1 until it is finished (or if unknown)
+        int64_t listedMtime();
+        // Move every metadata result published since the last call into 'out' (appending)
+        void takeMetadata(std::vector<EntryMetadata>* out);
+        // Ask for the size and permissions of the entries at these scan indices (e.g. the rows on screen),
+        // replacing the previous request
+        void requestMetadata(const std::vector<int>& indices);
+        // Ask for the size and permissions of every entry of the scan (e.g. to sort by size)
+        void requestAllMetadata();
+
+    private:
+        /* Names of the published entries, packed into one buffer */
+        struct NameList {
+            std::vector<char> chars;
+            std::vector<uint32_t> starts;
+            void add(const char* name, size_t length);
+            const char* operator[](size_t index) const { return &chars[starts[index]]; }
+            size_t size() const { return starts.size(); }
+        };
+
+        void run(std::string dirname, std::shared_ptr<const DirectoryListing> prefetched, unsigned int scan_id);
+        void runResumed(std::string dirname, std::shared_ptr<NameList> published, std::vector<unsigned char> missing, int64_t mtime,
+                        unsigned int scan_id);
+        void serve(int dir_fd, const NameList& published, std::vector<unsigned char>& missing, unsigned int scan_id);
+        void publish(std::vector<ScannedEntry>* batch, bool last, unsigned int scan_id);
+        void publishMetadata(std::vector<EntryMetadata>* batch, unsigned int scan_id);
+        void wakeUI();
+        void markExited();
+
+        Uint32 notify_event;
+        // The current scan's worker, and the cancelled ones not yet joined (they join once they are in 'exited')
+        std::thread worker;
+        std::vector<std::thread> retired;
+        std::vector<std::thread::id> exited;
+        // Incremented by every start()/cancel(); the worker quits once it no longer matches its own id
+        std::atomic<unsigned int> generation;
+
+        std::mutex lock;
+        std::vector<ScannedEntry> pending;
+        std::vector<EntryMetadata> pending_metadata;
+        bool pending_finished;
+        bool pending_stale;
+        int64_t listed_mtime;
+        // Set when an event is already queued and not yet answered by takeEntries()/takeMetadata()
+        bool notified;
+
+        // Rows whose metadata the UI wants; the worker sleeps on 'requested' while there are none
+        std::condition_variable requested;
+        std::vector<int> requested_rows;
+        bool requested_all;
+};
+
+/* String representation of the permissions in a stat structure or mode ("rwxr-xr-x") */
+std::string getFilePermissions(struct stat info);
+std::string getFilePermissions(mode_t mode);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __SEARCHINDEX_H_
+#define __SEARCHINDEX_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "treemodel.h"
+
+/* Trigram index over the names in a TreeModel, for finding files by part of their name.
+   Every run of three bytes of a name (ASCII case folded) maps to the ascending list of
+   nodes whose name contains it. Since the model only appends nodes (until it is compacted,
+   after which the index is built again), new listings are indexed by appending to those
+   lists, without touching what is already indexed. A query
+   intersects the lists of its own trigrams, starting from the shortest, and checks the
+   remaining candidates against the name. The folded names are also kept back to back in
+   node order, so those checks (and queries too short for a trigram) are memmem() calls over
+   contiguous memory rather than walks through the model. */
+class SearchIndex {
+    public:
+        SearchIndex();
+
+        // Forget everything (call together with TreeModel::reset())
+        void reset();
+        // Index the nodes added to 'model' since the last call; returns the first node indexed now
+        uint32_t update(const TreeModel& model);
+        // Number of node ids covered so far (nodes 1 .. indexedEnd() - 1)
+        uint32_t indexedEnd() const { return indexed_end; }
+
+        // Every indexed node whose name contains 'query' ignoring ASCII case, in ascending order.
+        // 'narrowing', if given, must hold every answer (e.g. the results of a shorter query that 'query'
+        // contains); it is filtered instead of the index when that is less work
+        void find(const std::string& query, const std::vector<uint32_t>* narrowing, std::vector<uint32_t>* out) const;
+        // Append the nodes from 'first' up to indexedEnd() whose name contains 'query'
+        void findFrom(const std::string& query, uint32_t first, std::vector<uint32_t>* out) const;
+
+    private:
+        bool contains(uint32_t node, const std::string& folded) const;
+
+        std::unordered_map<uint32_t, std::vector<uint32_t> > postings;
+        // Case folded names of nodes 1, 2, ... each followed by a NUL; node n's starts at folded_starts[n]
+        std::vector<char> folded_names;
+        std::vector<uint32_t> folded_starts;
+        uint32_t indexed_end;
+};
+
+#endif
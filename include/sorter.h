@@ -0,0 +1,97 @@
+#ifndef __SORTER_H_
+#define __SORTER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include "entrystore.h"
+
+// Below this many items a single-threaded std::sort is faster than spinning up threads
+#define PARALLEL_SORT_THRESHOLD 16384
+
+// The columns the entry list can be ordered by
+enum SortKey { SORT_NAME, SORT_SIZE, SORT_TYPE, SORT_PERMISSIONS };
+
+typedef struct SortOrder {
+    SortKey key;
+    bool ascending;
+} SortOrder;
+
+/* Key that orders names case-insensitively and naturally ("file2" before "file10") under a plain
+   string comparison. Computed once per name, so comparisons never allocate or fold case again */
+std::string collationKey(const std::string& name);
+
+/* Sorts the entries of a view (indices into 'store') in 'order'; ties are broken by name. Relies on the stored collation keys */
+void sortEntries(const EntryStore& store, std::vector<uint32_t>* entries, SortOrder order);
+/* Sorts the entries from 'sorted_count' on and merges them into the already sorted ones before them */
+void mergeEntries(const EntryStore& store, std::vector<uint32_t>* entries, size_t sorted_count, SortOrder order);
+/* Whether 'order' compares fields the scanner only fetches on demand (size and permissions) */
+bool sortNeedsMetadata(SortOrder order);
+
+/* std::sort on several threads: the range is cut into one run per core, the runs are sorted
+   concurrently and then merged pairwise. 'less' must be safe to call from several threads */
+template<class It, class Compare>
+void parallelSort(It begin, It end, Compare less) {
+    size_t count = end - begin;
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), 8);
+    if(count < PARALLEL_SORT_THRESHOLD || threads < 2) {
+        std::sort(begin, end, less);
+        return;
+    }
+
+    // bounds[i]..bounds[i+1] is run i
+    std::vector<It> bounds;
+    for(size_t t = 0; t < threads; t++) { bounds.push_back(begin + count * t / threads); }
+    bounds.push_back(end);
+
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t + 1 < bounds.size(); t++) {
+        workers.emplace_back([=]() { std::sort(bounds[t], bounds[t + 1], less); });
+    }
+    for(size_t t = 0; t < workers.size(); t++) { workers[t].join(); }
+
+    // Merge neighbouring runs until one is left; the merges of a round run concurrently
+    while(bounds.size() > 2) {
+        std::vector<It> merged;
+        std::vector<std::thread> mergers;
+        size_t i = 0;
+        for(; i + 2 < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+            mergers.emplace_back([=]() { std::inplace_merge(bounds[i], bounds[i + 1], bounds[i + 2], less); });
+        }
+        // An odd run out waits for the next round
+        if(i + 1 < bounds.size()) { merged.push_back(bounds[i]); }
+        merged.push_back(end);
+        for(size_t t = 0; t < mergers.size(); t++) { mergers[t].join(); }
+        bounds.swap(merged);
+    }
+}
+
+/* Sorts 'items' by the collation key of their names, breaking ties by the raw name so the order never
+   depends on readdir. 'name_of' returns an item's name; the keys are stored in 'keys' (if given) in the new order */
+template<class T, class NameOf>
+void sortByName(std::vector<T>* items, NameOf name_of, std::vector<std::string>* keys = NULL) {
+    std::vector<std::pair<std::string, size_t> > order(items->size());
+    for(size_t i = 0; i < items->size(); i++) {
+        order[i].first = collationKey(name_of((*items)[i]));
+        order[i].second = i;
+    }
+    parallelSort(order.begin(), order.end(), [&](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+        int cmp = a.first.compare(b.first);
+        if(cmp != 0) { return cmp < 0; }
+        return name_of((*items)[a.second]) < name_of((*items)[b.second]);
+    });
+
+    std::vector<T> sorted;
+    sorted.reserve(items->size());
+    if(keys) { keys->clear(); keys->reserve(items->size()); }
+    for(size_t i = 0; i < order.size(); i++) {
+        sorted.push_back(std::move((*items)[order[i].second]));
+        if(keys) { keys->push_back(std::move(order[i].first)); }
+    }
+    items->swap(sorted);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __TEXTRENDERER_H_
+#define __TEXTRENDERER_H_
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "texture.h"
+
+/* Draws text from a glyph atlas instead of rasterizing every string into its own texture.
+   Each glyph is rendered once per font size into a shared atlas texture; strings are queued
+   as textured quads and submitted with a single SDL_RenderGeometry call per flush(). */
+class TextRenderer {
+    public:
+        TextRenderer();
+        ~TextRenderer();
+
+        // Open the font at 'point_size' and rasterize printable ASCII into the atlas
+        bool load(SDL_Renderer* renderer, const char* font_path, int point_size);
+        // Free the atlas and font (must happen before the renderer is destroyed)
+        void unload();
+
+        // Queue a UTF-8 string with its top-left corner at (x, y), optionally clipped to 'clip'.
+        // Returns the width of the string in pixels
+        int drawText(const std::string& text, int x, int y, SDL_Color color, const SDL_Rect* clip = NULL);
+        // Width of a UTF-8 string in pixels, without drawing it
+        int measure(const std::string& text);
+        int lineHeight() const { return line_height; }
+
+        // Submit every queued quad in one draw call
+        void flush();
+
+    private:
+        struct Glyph {
+            SDL_Rect src;   // location in the atlas (w == 0 for glyphs with no pixels, e.g. space)
+            int offset_x;   // horizontal offset of the bitmap from the pen position
+            int advance;    // pen movement after this glyph
+        };
+
+        static const int ATLAS_SIZE = 1024;
+
+        const Glyph* glyph(Uint32 codepoint);
+        Glyph fallbackGlyph(Uint32 codepoint);
+        bool rasterize(Uint32 codepoint, Glyph* out);
+        void pushQuad(SDL_Rect dst, SDL_Rect src, SDL_Color color, const SDL_Rect* clip);
+
+        SDL_Renderer* renderer;
+        TTF_Font* font;
+        TextureHandle atlas;
+        int line_height;
+
+        // Shelf packer state for the atlas
+        int pen_x;
+        int pen_y;
+        int shelf_height;
+
+        // ASCII is looked up directly, everything else through the map
+        Glyph ascii[128];
+        bool ascii_loaded[128];
+        std::unordered_map<Uint32, Glyph> extended;
+
+        // Quads queued since the last flush
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
+};
+
+#endif
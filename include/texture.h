@@ -0,0 +1,48 @@
+#ifndef __TEXTURE_H_
+#define __TEXTURE_H_
+
+#include <SDL.h>
+
+/* Sole owner of an SDL_Texture: the texture is destroyed when the handle is reset or goes out of scope.
+   Handles can be moved but not copied, so every texture has exactly one place that frees it. */
+class TextureHandle {
+    public:
+        TextureHandle() : texture(NULL) {}
+        explicit TextureHandle(SDL_Texture* texture) : texture(NULL) { reset(texture); }
+        ~TextureHandle() { reset(); }
+
+        TextureHandle(TextureHandle&& other) : texture(other.texture) { other.texture = NULL; }
+        TextureHandle& operator=(TextureHandle&& other) {
+            if(this != &other) {
+                reset();
+                texture = other.texture;
+                other.texture = NULL;
+            }
+            return *this;
+        }
+        TextureHandle(const TextureHandle&) = delete;
+        TextureHandle& operator=(const TextureHandle&) = delete;
+
+        // Destroy the current texture (if any) and take ownership of 'replacement'
+        void reset(SDL_Texture* replacement = NULL) {
+            if(texture != NULL) {
+                SDL_DestroyTexture(texture);
+                liveCount()--;
+            }
+            texture = replacement;
+            if(texture != NULL) { liveCount()++; }
+        }
+        SDL_Texture* get() const { return texture; }
+        explicit operator bool() const { return texture != NULL; }
+
+        // Number of textures currently owned by handles (only touched on the UI thread)
+        static int& liveCount() {
+            static int count = 0;
+            return count;
+        }
+
+    private:
+        SDL_Texture* texture;
+};
+
+#endif
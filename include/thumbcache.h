@@ -0,0 +1,64 @@
+#ifndef __THUMBCACHE_H_
+#define __THUMBCACHE_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+// Thumbnails fit in a square of this many pixels (the list's icon box is 35)
+#define THUMB_SIZE 36
+
+/* Identifies one version of a file: a thumbnail is only valid while size and mtime match */
+typedef struct ThumbnailKey {
+    uint64_t path_hash;
+    int64_t size;
+    int64_t mtime_ns;
+} ThumbnailKey;
+
+ThumbnailKey thumbnailKey(const std::string& path, int64_t size, int64_t mtime_ns);
+
+/* What the cache knows about a key */
+enum ThumbnailState { THUMB_MISSING, THUMB_READY, THUMB_UNDECODABLE };
+
+/* Persistent thumbnail store shared by every session.
+   The cache is one fixed-size file mapped into memory: a header followed by slots of
+   THUMB_SIZE x THUMB_SIZE ARGB8888 pixels, addressed by the path's hash with a short
+   linear probe. The file is sparse, so only slots that were written take disk space, and
+   reading a thumbnail is a copy out of the page cache. When a probe window is full the
+   path's home slot is overwritten. Files that couldn't be decoded are remembered too, so
+   they aren't retried. Safe to use from several threads. */
+class ThumbnailCache {
+    public:
+        ThumbnailCache();
+        ~ThumbnailCache();
+        ThumbnailCache(const ThumbnailCache&) = delete;
+        ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+        // Map (creating or resetting it if needed) the cache file at 'path'. If that fails the cache
+        // lives in anonymous memory for this session only; returns false in that case
+        bool open(const std::string& path);
+        void close();
+
+        // Copy the thumbnail for 'key' into 'pixels' (THUMB_SIZE * THUMB_SIZE entries, rows of THUMB_SIZE)
+        ThumbnailState lookup(const ThumbnailKey& key, Uint32* pixels, int* width, int* height);
+        ThumbnailState state(const ThumbnailKey& key);
+        // Store a width x height thumbnail (rows of THUMB_SIZE pixels), or remember that the file can't be decoded
+        void store(const ThumbnailKey& key, const Uint32* pixels, int width, int height);
+        void storeUndecodable(const ThumbnailKey& key);
+
+        /* Location of the cache file: $XDG_CACHE_HOME/fileexplorer or ~/.cache/fileexplorer */
+        static std::string defaultPath();
+
+    private:
+        struct Slot;
+        Slot* find(const ThumbnailKey& key);
+        Slot* place(const ThumbnailKey& key);
+
+        std::mutex lock;
+        char* mapping;
+        size_t mapping_size;
+        Slot* slots;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __THUMBNAILS_H_
+#define __THUMBNAILS_H_
+
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "thumbcache.h"
+#include "texture.h"
+
+/* Decodes and downscales images into a ThumbnailCache on a pool of threads.
+   Requests are served smallest file first, so one huge photo doesn't hold up the previews of
+   everything else in the directory. Every finished thumbnail (or failed decode) ends up in
+   the cache, and 'notify_event' is pushed so the UI can pick it up from there. */
+class ThumbnailLoader {
+    public:
+        ThumbnailLoader(Uint32 notify_event, ThumbnailCache* cache, int thread_count = 0);
+        ~ThumbnailLoader();
+
+        // Queue 'path' (a file of 'size' bytes, modified at 'mtime_ns'); already queued files are ignored
+        void request(const std::string& path, int64_t size, int64_t mtime_ns);
+        // Drop everything still queued (e.g. when leaving the directory); decodes in progress finish
+        void clear();
+        // Call when handling 'notify_event', so the next finished thumbnail sends another one
+        void acknowledge();
+
+    private:
+        struct Job {
+            std::string path;
+            ThumbnailKey key;
+            // The priority queue is a max-heap; reversing the order puts the smallest file on top
+            bool operator<(const Job& other) const { return key.size > other.key.size; }
+        };
+
+        void work();
+        void decode(const Job& job);
+        void notify();
+
+        Uint32 notify_event;
+        ThumbnailCache* cache;
+        std::vector<std::thread> workers;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<Job> queue;
+        // Path hashes queued or being decoded, so a row redrawn many times is requested once
+        std::set<uint64_t> queued;
+        bool stopping;
+        // Set while a notify event is queued and not yet acknowledged
+        bool notified;
+};
+
+/* Texture holding the thumbnails of the rows on screen.
+   Thumbnails are copied from the ThumbnailCache into a fixed grid of slots when a row needs
+   one; the least recently drawn slot is reused, so only visible rows ever take texture memory. */
+class ThumbnailAtlas {
+    public:
+        ThumbnailAtlas();
+
+        bool load(SDL_Renderer* renderer);
+        void unload();
+
+        // Start a new frame (slots used in this frame are never evicted during it)
+        void beginFrame() { frame++; }
+        // Texture region holding the thumbnail for 'path', uploading it from 'cache' if needed.
+        // Returns NULL (and asks 'loader' for it, if given) when there is no thumbnail yet
+        const SDL_Rect* find(const std::string& path, int64_t size, int64_t mtime_ns, ThumbnailCache* cache, ThumbnailLoader* loader);
+        SDL_Texture* texture() const { return atlas.get(); }
+
+    private:
+        struct Slot {
+            ThumbnailKey key;
+            bool used;
+            unsigned int last_frame;
+            SDL_Rect rect;
+        };
+
+        TextureHandle atlas;
+        std::vector<Slot> slots;
+        unsigned int frame;
+        // Versions of files known to have no thumbnail (undecodable), so the cache isn't asked every frame
+        std::set<uint64_t> undecodable;
+};
+
+/* Rectangle inside 'box' for showing a width x height thumbnail at the largest size that keeps its aspect ratio */
+SDL_Rect fitThumbnail(SDL_Rect box, int width, int height);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef __TREEMODEL_H_
+#define __TREEMODEL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "treewalker.h"
+
+/* Compact tree behind the recursive view.
+   Nodes are fixed-size records that refer to their parent and to a contiguous run of children
+   by index; names live once each in an interned string pool. Only the rows of expanded
+   directories are kept in the flattened 'visible' list the view scrolls through, so
+   expanding or collapsing a subtree costs time proportional to that subtree, plus renumbering
+   the rows after it (each shown node's row is kept, so finding it costs nothing). Nodes are
+   appended: when entries are added to a directory, it gets a new run of children and the old
+   run is flagged as removed, while entries that only went away are flagged where they are.
+   Once removed records outnumber live ones, compact() renumbers the tree without them. */
+class TreeModel {
+    public:
+        // Node flags
+        static const uint8_t NODE_DIR = 1;
+        static const uint8_t NODE_EXPANDED = 2;
+        static const uint8_t NODE_LISTED = 4;
+        // Dropped from the tree by updateChildren(); the record stays so node indices remain valid
+        static const uint8_t NODE_REMOVED = 8;
+
+        typedef struct Node {
+            uint32_t name;          // offset of the name in the string pool
+            uint32_t parent;
+            uint32_t first_child;
+            uint32_t child_count;
+            uint8_t depth;          // 0 for the root, saturates at 255
+            uint8_t flags;
+        } Node;
+
+        TreeModel();
+
+        // Start over with a single expanded root node named 'root_path'
+        void reset(const std::string& root_path);
+        // Attach the sorted children of a directory (identified by the walker's node id);
+        // returns true if rows were added to the visible list
+        bool addListing(const WalkListing& listing);
+
+        // Expand or collapse the directory on a visible row; returns true if the visible rows changed
+        bool toggle(int row);
+
+        // Node of the directory at 'path' (the root's path, or below it as path() spells it), or -1 if it isn't in the tree
+        int findDirectory(const std::string& path) const;
+        // Change the children of directory 'node' once the walk is over: every entry of 'present' is added (or retyped), the
+        // names in 'gone' are dropped, and with 'complete' set so is every child missing from 'present'. Children that stay
+        // keep what is known below them. Returns true if the visible rows changed
+        bool updateChildren(uint32_t node, const std::vector<WalkEntry>& present, const std::vector<std::string>& gone, bool complete);
+        // Drop the removed records (and unused names) once they outnumber the live ones. Every node index changes, so
+        // when this returns true anything holding nodes (a SearchIndex, search results) has to be rebuilt
+        bool compact();
+
+        // Flattened rows of the expanded part of the tree (the root itself is not a row)
+        int rowCount() const { return visible.size(); }
+        uint32_t rowNode(int row) const { return visible[row]; }
+
+        const char* name(uint32_t node) const { return &names[nodes[node].name]; }
+        int depth(uint32_t node) const { return nodes[node].depth; }
+        bool isDir(uint32_t node) const { return nodes[node].flags & NODE_DIR; }
+        bool isExpanded(uint32_t node) const { return nodes[node].flags & NODE_EXPANDED; }
+        bool isListed(uint32_t node) const { return nodes[node].flags & NODE_LISTED; }
+        bool isRemoved(uint32_t node) const { return nodes[node].flags & NODE_REMOVED; }
+        // Full path of a node, rebuilt from its ancestors
+        std::string path(uint32_t node) const;
+        // Number of nodes below the root
+        size_t size() const { return nodes.empty() ? 0 : nodes.size() - 1; }
+
+    private:
+        static const uint32_t NONE = 0xFFFFFFFF;
+
+        /* A child of a directory being updated: an old child that stays (its index) or a new entry (NONE, with its name and type) */
+        struct Child {
+            std::string name;
+            bool is_dir;
+            uint32_t old;
+        };
+
+        uint32_t intern(const std::string& name);
+        void growInternTable();
+        bool isShown(uint32_t node) const;
+        int rowOf(uint32_t node) const;
+        void insertRows(int at, const std::vector<uint32_t>& rows);
+        void eraseRows(int from, int to);
+        void numberRows(int from);
+        void collectRows(uint32_t node, std::vector<uint32_t>* rows) const;
+        void removeSubtree(uint32_t node);
+        void markRemoved(uint32_t node);
+        void moveChildren(uint32_t node, std::vector<Child>* children);
+
+        std::vector<Node> nodes;
+        // NUL-terminated names, each distinct name stored once
+        std::vector<char> names;
+        // Open-addressed hash table of name offsets + 1 (0 marks an empty slot)
+        std::vector<uint32_t> intern_slots;
+        size_t interned_count;
+        // Records flagged NODE_REMOVED; compact() drops them
+        size_t removed_count;
+        // Walker node id -> model node index
+        std::vector<uint32_t> walk_to_node;
+        std::vector<uint32_t> visible;
+        // Node index -> its row in 'visible'; only meaningful for shown nodes
+        std::vector<uint32_t> row_of;
+};
+
+#endif
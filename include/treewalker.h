@@ -0,0 +1,119 @@
+#ifndef __TREEWALKER_H_
+#define __TREEWALKER_H_
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <set>
+#include <sys/types.h>
+
+/* One entry of a directory listing produced by the walker */
+typedef struct WalkEntry {
+    std::string name;
+    bool is_dir;
+    // Node id of the directory's own listing (-1 for files and directories that are not descended into)
+    int node;
+} WalkEntry;
+
+/* The sorted contents of one directory; node 0 is the root of the walk */
+typedef struct WalkListing {
+    int node;
+    std::vector<WalkEntry> entries;
+} WalkListing;
+
+/* Walks a directory tree with a pool of work-stealing threads.
+   Each directory is opened with openat() relative to its parent's descriptor and its
+   entries are typed from d_type (falling back to fstatat()), so no full paths are resolved.
+   Symlinks are listed as leaves and never followed, other file systems mounted inside the tree
+   are not entered, and directories already visited (same device and inode, e.g. through a bind
+   mount) are not descended into again. Listings are sorted per directory and streamed to the UI
+   thread as they complete, so the tree can be shown while the walk is still running. */
+class TreeWalker {
+    public:
+        // 'notify_event' is pushed to the SDL event queue whenever new listings are ready
+        TreeWalker(Uint32 notify_event, int thread_count = 0);
+        ~TreeWalker();
+
+        // Begin walking the tree under 'root', cancelling any walk in flight
+        void start(const std::string& root);
+        // Stop all workers without waiting for them; listings not yet taken are dropped
+        void cancel();
+        bool running() const { return active; }
+
+        // Move every listing completed since the last call into 'out' (appending); a parent's
+        // listing is always delivered before its children's. 'finished' is set once the walk is done
+        void takeListings(std::vector<WalkListing>* out, bool* finished);
+
+    private:
+        /* An open directory descriptor shared by the tasks of its subdirectories */
+        struct DirHandle {
+            int fd;
+            explicit DirHandle(int fd) : fd(fd) {}
+            ~DirHandle();
+        };
+
+        /* A directory waiting to be listed */
+        struct Task {
+            int node;
+            std::shared_ptr<DirHandle> parent;
+            std::string name;
+            std::string path;
+        };
+
+        /* Each worker pushes and pops at the back of its own queue; idle workers steal from the front of others */
+        struct WorkQueue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        /* State of one walk, shared by its workers; the workers of a cancelled walk finish on their own copy */
+        struct Walk {
+            unsigned int id;
+            // Device of the root; set when the root is listed, before anything else is queued
+            dev_t device;
+            std::vector<std::unique_ptr<WorkQueue> > queues;
+            // Tasks queued or being listed; the walk is complete when this reaches zero
+            std::atomic<int> outstanding;
+            std::atomic<int> next_node;
+
+            // Idle workers sleep here until new tasks are pushed or the walk ends
+            std::mutex idle_lock;
+            std::condition_variable idle;
+
+            // (device, inode) of every directory descended into
+            std::mutex visited_lock;
+            std::set<std::pair<dev_t, ino_t> > visited;
+        };
+
+        void work(int index, std::shared_ptr<Walk> walk);
+        bool nextTask(Walk& walk, int index, Task* task);
+        void push(Walk& walk, int index, Task task);
+        void list(Walk& walk, int index, Task& task);
+        bool markVisited(Walk& walk, dev_t dev, ino_t ino);
+        void publish(WalkListing* listing, bool last, unsigned int walk_id);
+
+        Uint32 notify_event;
+        int thread_count;
+        // Workers of the current walk, and those of cancelled walks not yet joined (they join once they are in 'exited')
+        std::vector<std::thread> workers;
+        std::vector<std::thread> retired;
+        std::vector<std::thread::id> exited;
+        std::shared_ptr<Walk> current;
+
+        // Incremented by every start()/cancel(); workers quit once it no longer matches their walk
+        std::atomic<unsigned int> generation;
+        std::atomic<bool> active;
+
+        std::mutex lock;
+        std::vector<WalkListing> pending;
+        bool pending_finished;
+        bool notified;
+};
+
+#endif
@@ -0,0 +1,467 @@
+#include "contentsearch.h"
+#include "filetypes.h"
+#include "profiler.h"
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Files at least this large are mapped instead of read into the thread's buffer
+#define CONTENT_MAP_THRESHOLD (1024 * 1024)
+// Leading bytes checked for a NUL to tell binary files apart
+#define CONTENT_BINARY_PROBE 8192
+// Files of one directory searched as one task
+#define CONTENT_FILE_BATCH 32
+// Bytes of a mapped file searched between checks for cancellation
+#define CONTENT_SCAN_WINDOW (16 * 1024 * 1024)
+// Large files modified less than this long ago aren't mapped: one truncated while it is searched (a log being
+// rotated) would raise SIGBUS on the pages past its new end. They are read in windows of this size instead
+#define CONTENT_SETTLE_SECONDS 10
+#define CONTENT_READ_WINDOW (1024 * 1024)
+// Longest line text kept with a match
+#define CONTENT_TEXT_LIMIT 200
+// The search stops after this many matches
+#define CONTENT_MATCH_LIMIT 100000
+
+/* First occurrence of 'needle' (length 'n', at least 1) in 'haystack', or NULL */
+static const char* findSubstring(const char* haystack, size_t length, const char* needle, size_t n) {
+    if(n == 1) { return (const char*)memchr(haystack, needle[0], length); }
+    if(length < n) { return NULL; }
+    size_t i = 0;
+#ifdef __SSE2__
+    // Positions where both the first and the last byte of the needle line up are candidates; there are few of them
+    // in ordinary text, so the memcmp() that confirms one rarely runs
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    for(; i + n - 1 + 16 <= length; i += 16) {
+        __m128i starts = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i ends = _mm_loadu_si128((const __m128i*)(haystack + i + n - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last)));
+        while(mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if(memcmp(haystack + i + bit + 1, needle + 1, n - 2) == 0) { return haystack + i + bit; }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; i + n <= length; i++) {
+        if(haystack[i] == needle[0] && memcmp(haystack + i, needle, n) == 0) { return haystack + i; }
+    }
+    return NULL;
+}
+
+/* Number of '\n' bytes in [data, data + length) */
+static int64_t countNewlines(const char* data, size_t length) {
+    int64_t count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+    }
+#endif
+    for(; i < length; i++) {
+        count += data[i] == '\n';
+    }
+    return count;
+}
+
+/* Printable text of the line [start, end) holding a match at 'hit': a window around the match when the
+   line is long, cut at UTF-8 character boundaries, with control characters turned into spaces and
+   surrounding whitespace trimmed */
+static std::string lineText(const char* start, const char* end, const char* hit) {
+    if(hit - start > CONTENT_TEXT_LIMIT / 2) { start = hit - CONTENT_TEXT_LIMIT / 2; }
+    if(end - start > CONTENT_TEXT_LIMIT) { end = start + CONTENT_TEXT_LIMIT; }
+    while(start < end && ((unsigned char)*start & 0xC0) == 0x80) { start++; }
+    while(end > start && ((unsigned char)end[-1] & 0x80) != 0) {
+        // Drop a trailing sequence only when it was cut short
+        const char* lead = end - 1;
+        while(lead > start && ((unsigned char)*lead & 0xC0) == 0x80) { lead--; }
+        unsigned char byte = *lead;
+        int expected = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        if(end - lead >= expected) { break; }
+        end = lead;
+    }
+    while(start < end && (*start == ' ' || *start == '\t')) { start++; }
+    std::string text(start, end);
+    for(size_t i = 0; i < text.size(); i++) {
+        if((unsigned char)text[i] < 0x20 || text[i] == 0x7F) { text[i] = ' '; }
+    }
+    // A CRLF line ends in a space now
+    while(!text.empty() && text[text.size() - 1] == ' ') { text.erase(text.size() - 1); }
+    return text;
+}
+
+ContentSearcher::DirHandle::~DirHandle() {
+    if(fd >= 0) { close(fd); }
+}
+
+ContentSearcher::ContentSearcher(Uint32 notify_event, int thread_count)
+    : notify_event(notify_event), generation(0), files(0), bytes(0), skipped(0), matches(0), busy(0), done(true),
+      pending_finished(false), stopping(false), notified(false) {
+    if(thread_count <= 0) {
+        // Reading files from a cold cache waits on the disk, so more threads than cores still help there
+        thread_count = std::max(2, std::min(8, (int)std::thread::hardware_concurrency()));
+    }
+    for(int i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&ContentSearcher::work, this));
+    }
+}
+
+ContentSearcher::~ContentSearcher() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    for(int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ContentSearcher::start(const std::string& root, const std::string& pattern) {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    queue.clear();
+    pending.clear();
+    pending_finished = false;
+    notified = false;
+    files = 0;
+    bytes = 0;
+    skipped = 0;
+    matches = 0;
+    started = std::chrono::steady_clock::now();
+    finished = started;
+    // Nothing to look for: finished right away
+    if(pattern.empty()) {
+        done = true;
+        pending_finished = true;
+        wakeUI();
+        return;
+    }
+    done = false;
+    Task task;
+    task.name = root;
+    task.path = root;
+    task.pattern = std::make_shared<const std::string>(pattern);
+    task.generation = generation;
+    queue.push_back(task);
+    wake.notify_one();
+}
+
+void ContentSearcher::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    queue.clear();
+    pending.clear();
+    pending_finished = false;
+    if(!done) {
+        done = true;
+        finished = std::chrono::steady_clock::now();
+    }
+    notified = false;
+}
+
+void ContentSearcher::takeMatches(std::vector<ContentMatch>* out, bool* finished_flag) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(out->empty()) {
+        out->swap(pending);
+    } else {
+        out->insert(out->end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+        pending.clear();
+    }
+    *finished_flag = pending_finished;
+    pending_finished = false;
+    notified = false;
+}
+
+ContentSearchStats ContentSearcher::stats() {
+    ContentSearchStats result;
+    result.files = files;
+    result.bytes = bytes;
+    result.skipped = skipped;
+    result.matches = std::min<int64_t>(matches, CONTENT_MATCH_LIMIT);
+    result.truncated = matches >= CONTENT_MATCH_LIMIT;
+    std::lock_guard<std::mutex> guard(lock);
+    result.running = !done;
+    result.elapsed_ms = std::chrono::duration<double, std::milli>((done ? finished : std::chrono::steady_clock::now()) - started).count();
+    return result;
+}
+
+void ContentSearcher::work() {
+    PROFILE_THREAD("contentsearch");
+    // Small files (and large ones that aren't mapped, a window at a time) are read here; it grows to the largest of them and is reused
+    std::vector<char> buffer;
+    while(true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && queue.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            task = std::move(queue.back());
+            queue.pop_back();
+            busy++;
+        }
+        std::vector<ContentMatch> found;
+        // Past the match limit the remaining tasks are only drained
+        if(task.generation == generation && matches < CONTENT_MATCH_LIMIT) {
+            if(task.files.empty()) {
+                list(task);
+            } else {
+                PROFILE_SCOPE("contentsearch.files");
+                for(size_t i = 0; i < task.files.size() && task.generation == generation; i++) {
+                    searchFile(task.parent->fd, task, task.files[i], buffer, &found);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        busy--;
+        bool current = task.generation == generation;
+        if(current) {
+            pending.insert(pending.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+        }
+        // Whichever worker is the last one busy with an empty queue finishes the search, even with a stale task
+        // of a cancelled search: the current search can't be done before, as its tasks are queued or busy
+        if(!done && queue.empty() && busy == 0) {
+            done = true;
+            finished = std::chrono::steady_clock::now();
+            pending_finished = true;
+        }
+        if((current && !found.empty()) || pending_finished) { wakeUI(); }
+    }
+}
+
+/* Queues the subdirectories of a directory, and its files in batches */
+void ContentSearcher::list(Task& task) {
+    PROFILE_SCOPE("contentsearch.list");
+    int fd = -1;
+    if(task.parent) {
+        fd = openat(task.parent->fd, task.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    } else {
+        fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if(fd < 0) { return; }
+    std::shared_ptr<DirHandle> handle(new DirHandle(fd));
+    // fdopendir takes ownership of the descriptor it is given, so hand it a duplicate
+    int list_fd = dup(fd);
+    DIR* dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if(dir == NULL) {
+        if(list_fd >= 0) { close(list_fd); }
+        return;
+    }
+    // Paths below the root are joined without doubling a trailing slash
+    std::string prefix = task.path;
+    if(prefix.empty() || prefix[prefix.size() - 1] != '/') { prefix += '/'; }
+
+    std::vector<Task> children;
+    Task batch;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(task.generation != generation) { closedir(dir); return; }
+        const char* name = entry->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) { continue; }
+        bool is_dir = entry->d_type == DT_DIR;
+        bool is_file = entry->d_type == DT_REG;
+        // Symlinks are searched when they lead to a file; unknown types are looked up without following them
+        if(entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+            struct stat info;
+            if(fstatat(fd, name, &info, entry->d_type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) != 0) { continue; }
+            is_file = S_ISREG(info.st_mode);
+            is_dir = entry->d_type == DT_UNKNOWN && S_ISDIR(info.st_mode);
+        }
+        if(is_dir) {
+            Task child;
+            child.parent = handle;
+            child.name = name;
+            child.path = prefix + name;
+            child.pattern = task.pattern;
+            child.generation = task.generation;
+            children.push_back(std::move(child));
+        } else if(is_file) {
+            batch.files.push_back(name);
+            if(batch.files.size() == CONTENT_FILE_BATCH) {
+                children.push_back(std::move(batch));
+                batch = Task();
+            }
+        }
+    }
+    closedir(dir);
+    if(!batch.files.empty()) { children.push_back(std::move(batch)); }
+    if(children.empty()) { return; }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(task.generation != generation) { return; }
+    for(size_t i = 0; i < children.size(); i++) {
+        if(!children[i].files.empty()) {
+            children[i].parent = handle;
+            children[i].path = task.path;
+            children[i].pattern = task.pattern;
+            children[i].generation = task.generation;
+        }
+        queue.push_back(std::move(children[i]));
+    }
+    wake.notify_all();
+}
+
+/* Reads one file of the task's directory and collects its matching lines */
+void ContentSearcher::searchFile(int dir_fd, const Task& task, const std::string& name, std::vector<char>& buffer,
+                                 std::vector<ContentMatch>* found) {
+    // Images and videos are binary by their name alone; anything else is checked for NUL bytes once read
+    const char* type = classifyByExtension(name);
+    if(type != NULL && (strcmp(type, "img") == 0 || strcmp(type, "vid") == 0)) {
+        skipped++;
+        return;
+    }
+    int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if(fd < 0) { return; }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return;
+    }
+    size_t size = info.st_size;
+    const char* data = NULL;
+    void* mapped = MAP_FAILED;
+    if(size >= CONTENT_MAP_THRESHOLD) {
+        if(time(NULL) - info.st_mtim.tv_sec >= CONTENT_SETTLE_SECONDS) {
+            mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        if(mapped == MAP_FAILED) {
+            searchWindows(fd, task, name, buffer, found);
+            close(fd);
+            return;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = (const char*)mapped;
+    }
+    if(data == NULL) {
+        // Small files: one read, unless the file is growing meanwhile
+        buffer.resize(std::max(buffer.size(), size));
+        size_t got = 0;
+        while(got < size) {
+            ssize_t n = pread(fd, &buffer[got], size - got, got);
+            if(n <= 0) { break; }
+            got += n;
+        }
+        size = got;
+        data = buffer.data();
+    }
+    close(fd);
+
+    if(memchr(data, '\0', std::min(size, (size_t)CONTENT_BINARY_PROBE)) != NULL) {
+        skipped++;
+    } else {
+        files++;
+        bytes += size;
+        if(size >= task.pattern->size()) { scan(data, size, 1, task, name, found); }
+    }
+    if(mapped != MAP_FAILED) { munmap(mapped, info.st_size); }
+}
+
+/* Searches a large file that isn't mapped through pread() windows. Each window is searched up to its last complete
+   line and the rest is carried into the next, so lines are numbered and reported as they are in a mapped file; only a
+   line longer than a whole window is cut in two (a match across the cut is missed) */
+void ContentSearcher::searchWindows(int fd, const Task& task, const std::string& name, std::vector<char>& buffer,
+                                    std::vector<ContentMatch>* found) {
+    // What is carried over is shorter than a window, so two windows always fit
+    buffer.resize(std::max(buffer.size(), (size_t)CONTENT_READ_WINDOW * 2));
+    size_t carried = 0;
+    off_t offset = 0;
+    int64_t line = 1;
+    bool first = true;
+    while(task.generation == generation && matches < CONTENT_MATCH_LIMIT) {
+        ssize_t n = pread(fd, &buffer[carried], CONTENT_READ_WINDOW, offset);
+        // Reading stops at the end, however long the file was when it was opened
+        bool last = n <= 0;
+        if(n < 0) { n = 0; }
+        offset += n;
+        size_t length = carried + n;
+        if(first) {
+            if(memchr(buffer.data(), '\0', std::min(length, (size_t)CONTENT_BINARY_PROBE)) != NULL) {
+                skipped++;
+                return;
+            }
+            files++;
+            first = false;
+        }
+        bytes += n;
+        size_t cut = length;
+        if(!last) {
+            const char* newline = (const char*)memrchr(buffer.data(), '\n', length);
+            if(newline != NULL) { cut = newline + 1 - buffer.data(); }
+        }
+        if(cut >= task.pattern->size()) { scan(buffer.data(), cut, line, task, name, found); }
+        if(last) { return; }
+        line += countNewlines(buffer.data(), cut);
+        carried = length - cut;
+        memmove(buffer.data(), buffer.data() + cut, carried);
+    }
+}
+
+/* Finds every line of 'data' containing the pattern, numbering them from 'first_line'; a line is reported once however
+   often it matches */
+void ContentSearcher::scan(const char* data, size_t size, int64_t first_line, const Task& task, const std::string& name,
+                           std::vector<ContentMatch>* found) {
+    const std::string& pattern = *task.pattern;
+    const char* end = data + size;
+    const char* at = data;
+    // Newlines are counted lazily, from the end of the last reported line up to the next match
+    const char* counted = data;
+    int64_t line = first_line;
+    std::string path;
+    while(at < end && task.generation == generation) {
+        // Large mapped files are searched in windows, so cancelling doesn't wait for the whole file; the windows
+        // overlap by the pattern's length so no match is missed at their edges
+        size_t length = std::min((size_t)(end - at), (size_t)CONTENT_SCAN_WINDOW + pattern.size() - 1);
+        const char* hit = findSubstring(at, length, pattern.data(), pattern.size());
+        if(hit == NULL) {
+            if(at + length == end) { break; }
+            at += CONTENT_SCAN_WINDOW;
+            continue;
+        }
+        line += countNewlines(counted, hit - counted);
+        const char* line_start = (const char*)memrchr(counted, '\n', hit - counted);
+        line_start = line_start != NULL ? line_start + 1 : counted;
+        const char* line_end = (const char*)memchr(hit, '\n', end - hit);
+        if(line_end == NULL) { line_end = end; }
+
+        if(matches++ >= CONTENT_MATCH_LIMIT) { return; }
+        if(path.empty()) {
+            path = task.path;
+            if(path.empty() || path[path.size() - 1] != '/') { path += '/'; }
+            path += name;
+        }
+        ContentMatch match;
+        match.path = path;
+        match.line = line;
+        match.text = lineText(line_start, line_end, hit);
+        found->push_back(std::move(match));
+
+        if(line_end == end) { break; }
+        // The next search starts on the following line, whose number is known now
+        counted = line_end + 1;
+        at = counted;
+        line++;
+    }
+}
+
+void ContentSearcher::wakeUI() {
+    // One queued event is enough, the UI thread takes everything pending when it handles it
+    if(!notified) {
+        notified = true;
+        SDL_Event event = {};
+        event.type = notify_event;
+        SDL_PushEvent(&event);
+    }
+}
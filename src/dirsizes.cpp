@@ -0,0 +1,240 @@
+#include "dirsizes.h"
+#include "profiler.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+DirSizer::DirHandle::~DirHandle() {
+    if(fd >= 0) { close(fd); }
+}
+
+/* Rough heap footprint of a cached listing, for the memory budget (map and list nodes included) */
+static size_t listingBytes(const std::vector<std::string>& subdirs, size_t linked) {
+    size_t bytes = 128 + linked * sizeof(std::pair<ino_t, int64_t>);
+    for(size_t i = 0; i < subdirs.size(); i++) {
+        bytes += subdirs[i].capacity() + sizeof(std::string) + 16;
+    }
+    return bytes;
+}
+
+DirSizer::DirSizer(Uint32 notify_event, size_t memory_budget, int thread_count)
+    : notify_event(notify_event), generation(0), stopping(false), notified(false), cache_bytes(0),
+      memory_budget(memory_budget) {
+    if(thread_count <= 0) {
+        // Mostly waiting on metadata I/O, so more threads than cores still help on slow disks
+        thread_count = std::max(2, std::min(8, (int)std::thread::hardware_concurrency()));
+    }
+    for(int i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&DirSizer::work, this));
+    }
+}
+
+DirSizer::~DirSizer() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    for(int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void DirSizer::request(int index, const std::string& path) {
+    Task task;
+    task.total = std::make_shared<Total>();
+    task.total->index = index;
+    task.name = path;
+    task.path = path;
+    task.device = 0;
+    task.links = std::make_shared<LinkSet>();
+    std::lock_guard<std::mutex> guard(lock);
+    task.generation = generation;
+    queue.push_front(task);
+    wake.notify_one();
+}
+
+void DirSizer::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    queue.clear();
+    pending.clear();
+    notified = false;
+}
+
+void DirSizer::takeResults(std::vector<DirSizeResult>* out) {
+    std::lock_guard<std::mutex> guard(lock);
+    out->insert(out->end(), pending.begin(), pending.end());
+    pending.clear();
+    notified = false;
+}
+
+void DirSizer::work() {
+    PROFILE_THREAD("dirsizes");
+    while(true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && queue.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            task = std::move(queue.back());
+            queue.pop_back();
+        }
+        if(task.generation == generation) {
+            list(task);
+        }
+    }
+}
+
+/* Copies the cached listing of a directory if it is still current */
+bool DirSizer::cachedListing(dev_t dev, ino_t ino, int64_t mtime, Listing* out) {
+    std::lock_guard<std::mutex> guard(cache_lock);
+    std::map<CacheKey, Cached>::iterator found = cache.find(std::make_pair(dev, ino));
+    if(found == cache.end() || found->second.listing.mtime != mtime) { return false; }
+    recency.splice(recency.begin(), recency, found->second.use);
+    *out = found->second.listing;
+    return true;
+}
+
+/* Caches (or replaces) the listing of a directory, dropping least recently used ones until it fits the budget */
+void DirSizer::cacheListing(dev_t dev, ino_t ino, const Listing& listing) {
+    size_t bytes = listingBytes(listing.subdirs, listing.linked.size());
+    CacheKey key = std::make_pair(dev, ino);
+    std::lock_guard<std::mutex> guard(cache_lock);
+    std::map<CacheKey, Cached>::iterator found = cache.find(key);
+    if(found != cache.end()) {
+        cache_bytes -= found->second.bytes;
+        recency.erase(found->second.use);
+        cache.erase(found);
+    }
+    // A directory too big for the whole budget is simply listed again next time
+    if(bytes > memory_budget) { return; }
+    while(!recency.empty() && cache_bytes + bytes > memory_budget) {
+        std::map<CacheKey, Cached>::iterator oldest = cache.find(recency.back());
+        cache_bytes -= oldest->second.bytes;
+        cache.erase(oldest);
+        recency.pop_back();
+    }
+    recency.push_front(key);
+    Cached& cached = cache[key];
+    cached.listing = listing;
+    cached.bytes = bytes;
+    cached.use = recency.begin();
+    cache_bytes += bytes;
+}
+
+/* Adds up what one directory holds and queues its subdirectories */
+void DirSizer::list(Task& task) {
+    PROFILE_SCOPE("dirsizes.list");
+    int fd = -1;
+    if(task.parent) {
+        fd = openat(task.parent->fd, task.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    // The requested directory itself, or out of descriptors: fall back to the full path
+    if(fd < 0) {
+        fd = open(task.path.c_str(), (task.parent ? O_NOFOLLOW : 0) | O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    struct stat info;
+    // Unreadable directories, and mount points of other file systems, count as empty
+    if(fd < 0 || fstat(fd, &info) != 0 || (task.parent && info.st_dev != task.device)) {
+        if(fd >= 0) { close(fd); }
+        finish(task.total, task.generation);
+        return;
+    }
+    std::shared_ptr<DirHandle> handle(new DirHandle(fd));
+    if(!task.parent) { task.device = info.st_dev; }
+    int64_t mtime = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+
+    Listing listing;
+    if(!cachedListing(info.st_dev, info.st_ino, mtime, &listing)) {
+        listing.mtime = mtime;
+        listing.file_bytes = 0;
+        // fdopendir takes ownership of the descriptor it is given, so hand it a duplicate
+        int list_fd = dup(fd);
+        DIR* dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+        if(dir == NULL) {
+            if(list_fd >= 0) { close(list_fd); }
+            finish(task.total, task.generation);
+            return;
+        }
+        struct dirent* entry;
+        while((entry = readdir(dir)) != NULL) {
+            if(task.generation != generation) { closedir(dir); return; }
+            const char* name = entry->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) { continue; }
+            // Subdirectories are stat'ed when they are opened, everything else here (symlinks themselves, not their targets)
+            if(entry->d_type == DT_DIR) {
+                listing.subdirs.push_back(name);
+                continue;
+            }
+            struct stat file_info;
+            if(fstatat(fd, name, &file_info, AT_SYMLINK_NOFOLLOW) != 0) { continue; }
+            if(S_ISDIR(file_info.st_mode)) {
+                listing.subdirs.push_back(name);
+            } else if(file_info.st_nlink > 1) {
+                listing.linked.push_back(std::make_pair(file_info.st_ino, (int64_t)file_info.st_blocks * 512));
+            } else {
+                listing.file_bytes += (int64_t)file_info.st_blocks * 512;
+            }
+        }
+        closedir(dir);
+        cacheListing(info.st_dev, info.st_ino, listing);
+    }
+
+    // The directory's own blocks count too (they hold its entries)
+    int64_t bytes = listing.file_bytes + (int64_t)info.st_blocks * 512;
+    if(!listing.linked.empty()) {
+        std::lock_guard<std::mutex> guard(task.links->lock);
+        for(size_t i = 0; i < listing.linked.size(); i++) {
+            if(task.links->seen.insert(listing.linked[i].first).second) { bytes += listing.linked[i].second; }
+        }
+    }
+    task.total->bytes += bytes;
+    task.total->pending += listing.subdirs.size();
+    if(!listing.subdirs.empty()) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(task.generation != generation) { return; }
+        for(size_t i = 0; i < listing.subdirs.size(); i++) {
+            Task child;
+            child.total = std::make_shared<Total>();
+            child.total->parent = task.total;
+            child.parent = handle;
+            child.name = listing.subdirs[i];
+            child.path = task.path + "/" + listing.subdirs[i];
+            child.device = task.device;
+            child.links = task.links;
+            child.generation = task.generation;
+            queue.push_back(std::move(child));
+        }
+        wake.notify_all();
+    }
+    finish(task.total, task.generation);
+}
+
+/* Marks one part of 'total' as done; a finished total is added to its parent, or reported if it was requested */
+void DirSizer::finish(std::shared_ptr<Total> total, unsigned int task_generation) {
+    while(total && --total->pending == 0) {
+        if(total->parent) {
+            total->parent->bytes += total->bytes;
+            total = total->parent;
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if(task_generation != generation) { return; }
+        DirSizeResult result = {total->index, total->bytes};
+        pending.push_back(result);
+        // One queued event is enough, the UI thread takes everything pending when it handles it
+        if(!notified) {
+            notified = true;
+            SDL_Event event = {};
+            event.type = notify_event;
+            SDL_PushEvent(&event);
+        }
+        return;
+    }
+}
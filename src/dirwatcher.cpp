@@ -0,0 +1,349 @@
+#include "dirwatcher.h"
+#include "scanner.h"
+#include "filetypes.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// A burst of events is reported once it has been quiet this long...
+#define WATCH_QUIET_MS 100
+// ...or once it has gone on this long, so a directory written to continuously still updates
+#define WATCH_MAX_DELAY_MS 500
+
+// Everything that adds, removes, renames or changes an entry, plus the directory itself going away
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+DirWatcher::DirWatcher(Uint32 notify_event)
+    : notify_event(notify_event), stopping(false), notified(false), collecting(false) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd < 0) {
+        fprintf(stderr, "Warning: inotify unavailable, directories will not update by themselves\n");
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker = std::thread(&DirWatcher::run, this);
+}
+
+DirWatcher::~DirWatcher() {
+    stopping = true;
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) < 0) {}
+    worker.join();
+    if(inotify_fd >= 0) { close(inotify_fd); }
+    close(wake_fd);
+}
+
+void DirWatcher::watch(const std::string& path, bool list) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uses[path]++;
+        Request request = {path, list, true};
+        requests.push_back(request);
+    }
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+void DirWatcher::unwatch(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<std::string, int>::iterator known = uses.find(path);
+        if(known == uses.end()) { return; }
+        if(--known->second == 0) {
+            uses.erase(known);
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const DirChanges& changes) { return changes.dir == path; }),
+                          pending.end());
+        }
+        Request request = {path, false, false};
+        requests.push_back(request);
+    }
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+/* Adds and removes the inotify watches asked for since the last call. inotify_add_watch() resolves the path, which
+   can hang on an unresponsive network mount, so it runs here and never under the lock */
+void DirWatcher::applyRequests() {
+    std::vector<Request> todo;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        todo.swap(requests);
+    }
+    bool wake = false;
+    for(int i = 0; i < todo.size() && !stopping; i++) {
+        const std::string& path = todo[i].path;
+        std::map<std::string, int>::iterator known = path_to_watch.find(path);
+        if(todo[i].add) {
+            int wd;
+            if(known != path_to_watch.end()) {
+                wd = known->second;
+            } else {
+                if(inotify_fd < 0) { continue; }
+                wd = inotify_add_watch(inotify_fd, path.c_str(), WATCH_MASK);
+                if(wd < 0) { continue; }
+            }
+            // A newly watched path reports when it was last changed, since a listing may have been read before the watch
+            DirChanges watched_at;
+            watched_at.dir = path;
+            watched_at.complete = false;
+            watched_at.mtime = -1;
+            struct stat info;
+            if(known == path_to_watch.end() && !todo[i].list && stat(path.c_str(), &info) == 0) {
+                watched_at.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            path_to_watch[path] = wd;
+            Watch& watched = watches[wd];
+            watched.paths[path]++;
+            if(todo[i].list) { watched.relist = true; }
+            if(watched_at.mtime >= 0 && uses.count(path)) {
+                pending.push_back(std::move(watched_at));
+                wake |= !notified;
+                notified = true;
+            }
+        } else {
+            // A path whose watch couldn't be added has nothing to undo
+            if(known == path_to_watch.end()) { continue; }
+            int wd = known->second;
+            std::lock_guard<std::mutex> guard(lock);
+            Watch& watched = watches[wd];
+            if(--watched.paths[path] > 0) { continue; }
+            watched.paths.erase(path);
+            path_to_watch.erase(known);
+            if(watched.paths.empty()) {
+                // Fails harmlessly if the kernel already dropped the watch (the directory was deleted)
+                inotify_rm_watch(inotify_fd, wd);
+                watches.erase(wd);
+            }
+        }
+    }
+    if(wake) { wakeUI(); }
+}
+
+void DirWatcher::takeChanges(std::vector<DirChanges>* out) {
+    std::vector<DirChanges> front;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        front.swap(pending);
+        notified = false;
+    }
+    out->insert(out->end(), std::make_move_iterator(front.begin()), std::make_move_iterator(front.end()));
+}
+
+void DirWatcher::run() {
+    PROFILE_THREAD("watcher");
+    while(!stopping) {
+        // Sleep until something happens, or until the burst being collected is due
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            bool relist = false;
+            for(std::map<int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it) { relist |= it->second.relist; }
+            if(relist) {
+                timeout = 0;
+            } else if(collecting) {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                long quiet = WATCH_QUIET_MS - std::chrono::duration_cast<std::chrono::milliseconds>(now - burst_last).count();
+                long overdue = WATCH_MAX_DELAY_MS - std::chrono::duration_cast<std::chrono::milliseconds>(now - burst_start).count();
+                timeout = std::max(0L, std::min(quiet, overdue));
+            }
+        }
+        struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        int ready = poll(fds, 2, timeout);
+        if(stopping) { break; }
+        if(ready > 0 && (fds[1].revents & POLLIN)) {
+            uint64_t count;
+            if(read(wake_fd, &count, sizeof(count)) < 0) {}
+            applyRequests();
+        }
+        if(ready > 0 && (fds[0].revents & POLLIN)) {
+            readEvents();
+        }
+        flush();
+    }
+}
+
+/* Reads every queued inotify event and marks the names they touch as dirty */
+void DirWatcher::readEvents() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while(true) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if(length <= 0) { return; }
+
+        std::lock_guard<std::mutex> guard(lock);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(!collecting) {
+            collecting = true;
+            burst_start = now;
+        }
+        burst_last = now;
+        for(char* at = buffer; at < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)at;
+            at += sizeof(struct inotify_event) + event->len;
+            // Events were lost; only listing everything again is sure to catch up
+            if(event->mask & IN_Q_OVERFLOW) {
+                for(std::map<int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it) { it->second.relist = true; }
+                continue;
+            }
+            std::map<int, Watch>::iterator found = watches.find(event->wd);
+            if(found == watches.end()) { continue; }
+            // The directory itself is gone: its listing comes out empty
+            if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                found->second.relist = true;
+            } else if(event->len > 0) {
+                found->second.dirty.insert(event->name);
+            }
+        }
+    }
+}
+
+/* Turns the dirty names of a burst that is due (and any listings asked for) into batches for the UI */
+void DirWatcher::flush() {
+    typedef struct Job {
+        std::vector<std::string> paths;
+        std::vector<std::string> names;
+        bool relist;
+    } Job;
+    std::vector<Job> jobs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        bool due = false;
+        if(collecting) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            due = now - burst_last >= std::chrono::milliseconds(WATCH_QUIET_MS) ||
+                  now - burst_start >= std::chrono::milliseconds(WATCH_MAX_DELAY_MS);
+        }
+        for(std::map<int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it) {
+            Watch& watched = it->second;
+            if(!watched.relist && !(due && !watched.dirty.empty())) { continue; }
+            Job job;
+            for(std::map<std::string, int>::iterator path = watched.paths.begin(); path != watched.paths.end(); ++path) {
+                job.paths.push_back(path->first);
+            }
+            job.relist = watched.relist;
+            if(!job.relist) { job.names.assign(watched.dirty.begin(), watched.dirty.end()); }
+            watched.relist = false;
+            watched.dirty.clear();
+            jobs.push_back(std::move(job));
+        }
+        if(due) { collecting = false; }
+    }
+    if(jobs.empty()) { return; }
+
+    PROFILE_SCOPE("watch.flush");
+    std::vector<DirChanges> batches;
+    for(int i = 0; i < jobs.size() && !stopping; i++) {
+        DirChanges changes;
+        changes.complete = jobs[i].relist;
+        changes.mtime = -1;
+        int dir_fd = open(jobs[i].paths[0].c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(changes.complete) {
+            if(dir_fd >= 0) { listDirectory(dir_fd, &changes); }
+        } else {
+            for(int n = 0; n < jobs[i].names.size(); n++) {
+                WatchedEntry entry;
+                // A directory that can't be opened any more has lost everything in it
+                if(dir_fd < 0 || !examine(dir_fd, jobs[i].names[n], &entry)) {
+                    entry.name = jobs[i].names[n];
+                    entry.exists = false;
+                    entry.is_dir = false;
+                    entry.type = ENTRY_OTHER;
+                    entry.size = entry.modified = -1;
+                    entry.mode = 0;
+                }
+                changes.entries.push_back(std::move(entry));
+            }
+        }
+        if(dir_fd >= 0) { close(dir_fd); }
+        for(int p = 0; p < jobs[i].paths.size(); p++) {
+            changes.dir = jobs[i].paths[p];
+            batches.push_back(changes);
+        }
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(int i = 0; i < batches.size(); i++) {
+            // Skip directories unwatched while their batch was being put together
+            if(uses.count(batches[i].dir)) { pending.push_back(std::move(batches[i])); }
+        }
+        wake = !pending.empty() && !notified;
+        if(wake) { notified = true; }
+    }
+    if(wake) { wakeUI(); }
+}
+
+/* Names and types of everything in the directory open as 'dir_fd' */
+void DirWatcher::listDirectory(int dir_fd, DirChanges* out) {
+    DirectoryListing listing;
+    std::atomic<unsigned int> always(0);
+    if(!readDirectoryListing(dir_fd, &listing, &always, 0)) { return; }
+    for(int i = 0; i < listing.files.size(); i++) {
+        const std::string& name = listing.files[i].first;
+        if(name == "..") { continue; }
+        WatchedEntry entry;
+        entry.name = name;
+        entry.exists = true;
+        unsigned char d_type = listing.files[i].second;
+        if(d_type == DT_UNKNOWN || d_type == DT_LNK) {
+            // Symlinks are followed, like everywhere else; like the scanner, only directories and regular files are kept
+            struct stat info;
+            if(fstatat(dir_fd, name.c_str(), &info, 0) != 0 || !(S_ISDIR(info.st_mode) || S_ISREG(info.st_mode))) { continue; }
+            entry.is_dir = S_ISDIR(info.st_mode);
+        } else if(d_type == DT_DIR || d_type == DT_REG) {
+            entry.is_dir = d_type == DT_DIR;
+        } else {
+            continue;
+        }
+        const char* type = entry.is_dir ? "dir" : classifyByExtension(name);
+        entry.type = entryTypeFromString(type ? type : "other");
+        entry.size = entry.modified = -1;
+        entry.mode = 0;
+        out->entries.push_back(std::move(entry));
+    }
+}
+
+/* Stats 'name' inside the directory open as 'dir_fd' and types it the way the scanner would; false if it doesn't exist
+   or the scanner wouldn't list it */
+bool DirWatcher::examine(int dir_fd, const std::string& name, WatchedEntry* out) {
+    mode_t mode;
+    off_t size;
+    int64_t mtime;
+    // The scanner only lists directories and regular files (after following symlinks), so anything else,
+    // dangling symlinks included, reads as removed
+    if(!fetchMetadata(dir_fd, name.c_str(), &mode, &size, &mtime) || !(S_ISDIR(mode) || S_ISREG(mode))) {
+        return false;
+    }
+    out->name = name;
+    out->exists = true;
+    out->is_dir = S_ISDIR(mode);
+    out->size = out->is_dir ? -1 : size;
+    out->modified = mtime;
+    // Like the scanner, directories record no mode (they show no permissions)
+    out->mode = out->is_dir ? 0 : mode;
+    if(out->is_dir) {
+        out->type = ENTRY_DIR;
+    } else if(S_ISREG(mode) && (mode & S_IXUSR)) {
+        out->type = ENTRY_EXE;
+    } else {
+        const char* type = classifyByExtension(name);
+        if(type == NULL && S_ISREG(mode)) { type = sniffFileType(dir_fd, name.c_str()); }
+        out->type = entryTypeFromString(type ? type : "other");
+    }
+    return true;
+}
+
+void DirWatcher::wakeUI() {
+    SDL_Event event = {};
+    event.type = notify_event;
+    SDL_PushEvent(&event);
+}
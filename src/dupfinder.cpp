@@ -0,0 +1,602 @@
+#include "dupfinder.h"
+#include "profiler.h"
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Bytes hashed at each end of a file by the first pass
+#define HEAD_BYTES 4096
+// Size of each read while hashing a whole file
+#define HASH_READ (1024 * 1024)
+// Files hashed as one task
+#define HASH_BATCH 16
+// Progress events are pushed at most this often while hashing
+#define PROGRESS_INTERVAL_MS 200
+
+/*****************************/
+/**  XXH64                  **/
+/*****************************/
+
+static const uint64_t Prime1 = 11400714785074694791ULL;
+static const uint64_t Prime2 = 14029467366897019727ULL;
+static const uint64_t Prime3 = 1609587929392839161ULL;
+static const uint64_t Prime4 = 9650029242287828579ULL;
+static const uint64_t Prime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+    acc += input * Prime2;
+    return rotl64(acc, 31) * Prime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= hashRound(0, value);
+    return acc * Prime1 + Prime4;
+}
+
+/* XXH64 over data fed in pieces of any size */
+typedef struct Hash64 {
+    uint64_t seed;
+    uint64_t lanes[4];
+    uint64_t total;
+    // Bytes of an unfinished 32-byte stripe
+    unsigned char stripe[32];
+    size_t stripe_length;
+
+    explicit Hash64(uint64_t seed) : seed(seed), total(0), stripe_length(0) {
+        lanes[0] = seed + Prime1 + Prime2;
+        lanes[1] = seed + Prime2;
+        lanes[2] = seed;
+        lanes[3] = seed - Prime1;
+    }
+
+    void consume(const unsigned char* p) {
+        lanes[0] = hashRound(lanes[0], read64(p));
+        lanes[1] = hashRound(lanes[1], read64(p + 8));
+        lanes[2] = hashRound(lanes[2], read64(p + 16));
+        lanes[3] = hashRound(lanes[3], read64(p + 24));
+    }
+
+    void update(const void* data, size_t length) {
+        const unsigned char* p = (const unsigned char*)data;
+        total += length;
+        if(stripe_length > 0) {
+            size_t taken = std::min(length, 32 - stripe_length);
+            memcpy(stripe + stripe_length, p, taken);
+            stripe_length += taken;
+            p += taken;
+            length -= taken;
+            if(stripe_length < 32) { return; }
+            consume(stripe);
+            stripe_length = 0;
+        }
+        for(; length >= 32; p += 32, length -= 32) {
+            consume(p);
+        }
+        memcpy(stripe, p, length);
+        stripe_length = length;
+    }
+
+    uint64_t digest() const {
+        uint64_t hash;
+        if(total >= 32) {
+            hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+            for(int i = 0; i < 4; i++) { hash = mergeRound(hash, lanes[i]); }
+        } else {
+            hash = seed + Prime5;
+        }
+        hash += total;
+        const unsigned char* p = stripe;
+        size_t length = stripe_length;
+        for(; length >= 8; p += 8, length -= 8) {
+            hash ^= hashRound(0, read64(p));
+            hash = rotl64(hash, 27) * Prime1 + Prime4;
+        }
+        if(length >= 4) {
+            hash ^= (uint64_t)read32(p) * Prime1;
+            hash = rotl64(hash, 23) * Prime2 + Prime3;
+            p += 4;
+            length -= 4;
+        }
+        for(; length > 0; p++, length--) {
+            hash ^= *p * Prime5;
+            hash = rotl64(hash, 11) * Prime1;
+        }
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+} Hash64;
+
+uint64_t xxh64(const void* data, size_t length, uint64_t seed) {
+    Hash64 hash(seed);
+    hash.update(data, length);
+    return hash.digest();
+}
+
+/*****************************/
+/**  DUPLICATE FINDER       **/
+/*****************************/
+
+DuplicateFinder::DirHandle::~DirHandle() {
+    if(fd >= 0) { close(fd); }
+}
+
+DuplicateFinder::DuplicateFinder(Uint32 notify_event, int thread_count, int io_limit)
+    : notify_event(notify_event), io_limit(std::max(1, io_limit)), generation(0), files(0), candidates(0), hashed(0),
+      hashed_bytes(0), cached(0), done(true), groups_ready(false), group_count(0), reclaimable(0), stopping(false), notified(false),
+      io_busy(0) {
+    if(thread_count <= 0) {
+        // Walking and reading mostly wait on the disk; threads beyond 'io_limit' hash while the others read
+        thread_count = std::max(2, std::min(8, (int)std::thread::hardware_concurrency()));
+    }
+    for(int i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&DuplicateFinder::work, this));
+    }
+}
+
+DuplicateFinder::~DuplicateFinder() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    for(int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void DuplicateFinder::start(const std::string& root) {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    queue.clear();
+    groups.clear();
+    groups_ready = false;
+    group_count = 0;
+    reclaimable = 0;
+    notified = false;
+    files = 0;
+    candidates = 0;
+    hashed = 0;
+    hashed_bytes = 0;
+    cached = 0;
+    done = false;
+    started = std::chrono::steady_clock::now();
+    finished = started;
+    woken = started;
+
+    Task task;
+    task.run = std::make_shared<Run>();
+    task.run->generation = generation;
+    task.run->device = 0;
+    task.run->phase = Run::LISTING;
+    task.run->busy = 0;
+    task.name = root;
+    task.path = root;
+    queue.push_back(task);
+    wake.notify_one();
+}
+
+void DuplicateFinder::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    queue.clear();
+    groups.clear();
+    groups_ready = false;
+    group_count = 0;
+    reclaimable = 0;
+    if(!done) {
+        done = true;
+        finished = std::chrono::steady_clock::now();
+    }
+    notified = false;
+}
+
+bool DuplicateFinder::takeGroups(std::vector<DuplicateGroup>* out) {
+    std::lock_guard<std::mutex> guard(lock);
+    notified = false;
+    if(!groups_ready) { return false; }
+    out->swap(groups);
+    groups.clear();
+    groups_ready = false;
+    return true;
+}
+
+DuplicateStats DuplicateFinder::stats() {
+    DuplicateStats result;
+    result.files = files;
+    result.candidates = candidates;
+    result.hashed = hashed;
+    result.hashed_bytes = hashed_bytes;
+    result.cached = cached;
+    std::lock_guard<std::mutex> guard(lock);
+    result.groups = done ? group_count : 0;
+    result.reclaimable = done ? reclaimable : 0;
+    result.running = !done;
+    result.elapsed_ms = std::chrono::duration<double, std::milli>((done ? finished : std::chrono::steady_clock::now()) - started).count();
+    return result;
+}
+
+void DuplicateFinder::work() {
+    PROFILE_THREAD("dupfinder");
+    // Whole files are read through this in HASH_READ pieces; it is reused for every file the thread hashes
+    std::vector<char> buffer;
+    while(true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && queue.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            task = std::move(queue.back());
+            queue.pop_back();
+            task.run->busy++;
+        }
+        if(task.run->generation == generation) {
+            if(task.files.empty()) {
+                list(task);
+            } else {
+                hash(task, buffer);
+            }
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        Run& run = *task.run;
+        run.busy--;
+        // The last task of a phase moves the run on; the worker counts as busy meanwhile, so no other one does too.
+        // Phases that turn out to have nothing to do are passed through at once
+        while(run.generation == generation && run.busy == 0 && queue.empty() && !done) {
+            run.busy++;
+            guard.unlock();
+            std::vector<Task> next;
+            std::vector<DuplicateGroup> found;
+            bool more = advance(run, &next, &found);
+            guard.lock();
+            run.busy--;
+            if(run.generation != generation) { break; }
+            if(!more) {
+                done = true;
+                finished = std::chrono::steady_clock::now();
+                group_count = found.size();
+                reclaimable = 0;
+                for(size_t i = 0; i < found.size(); i++) {
+                    reclaimable += found[i].size * (int64_t)(found[i].paths.size() - 1);
+                }
+                groups.swap(found);
+                groups_ready = true;
+                wakeUI();
+                break;
+            }
+            for(size_t i = 0; i < next.size(); i++) {
+                next[i].run = task.run;
+                queue.push_back(std::move(next[i]));
+            }
+            wake.notify_all();
+            wakeUI();
+        }
+        // The header shows the counters; refresh it now and then while files are read
+        if(run.generation == generation && !done &&
+           std::chrono::steady_clock::now() - woken > std::chrono::milliseconds(PROGRESS_INTERVAL_MS)) {
+            wakeUI();
+        }
+    }
+}
+
+/* Collects the non-empty regular files of a directory and queues its subdirectories */
+void DuplicateFinder::list(Task& task) {
+    PROFILE_SCOPE("dupfinder.list");
+    Run& run = *task.run;
+    int fd = -1;
+    if(task.parent) {
+        fd = openat(task.parent->fd, task.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    // The directory searched itself, or out of descriptors: fall back to the full path
+    if(fd < 0) {
+        fd = open(task.path.c_str(), (task.parent ? O_NOFOLLOW : 0) | O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    struct stat info;
+    // Mount points of other file systems are not entered
+    if(fd < 0 || fstat(fd, &info) != 0 || (task.parent && info.st_dev != run.device)) {
+        if(fd >= 0) { close(fd); }
+        return;
+    }
+    std::shared_ptr<DirHandle> handle(new DirHandle(fd));
+    if(!task.parent) { run.device = info.st_dev; }
+
+    // fdopendir takes ownership of the descriptor it is given, so hand it a duplicate
+    int list_fd = dup(fd);
+    DIR* dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if(dir == NULL) {
+        if(list_fd >= 0) { close(list_fd); }
+        return;
+    }
+    std::vector<std::string> subdirs;
+    std::vector<std::string> names;
+    std::vector<struct stat> stats;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(run.generation != generation) { closedir(dir); return; }
+        const char* name = entry->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) { continue; }
+        if(entry->d_type == DT_DIR) {
+            subdirs.push_back(name);
+            continue;
+        }
+        // Symlinks, devices, sockets and pipes can't be duplicates of anything
+        if(entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) { continue; }
+        struct stat file_info;
+        if(fstatat(fd, name, &file_info, AT_SYMLINK_NOFOLLOW) != 0) { continue; }
+        if(S_ISDIR(file_info.st_mode)) {
+            subdirs.push_back(name);
+        } else if(S_ISREG(file_info.st_mode) && file_info.st_size > 0) {
+            names.push_back(name);
+            stats.push_back(file_info);
+        }
+    }
+    closedir(dir);
+    files += names.size();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(run.generation != generation) { return; }
+    if(!names.empty()) {
+        uint32_t parent = run.store.addParent(task.path);
+        for(size_t i = 0; i < names.size(); i++) {
+            uint32_t index = run.store.add(parent, names[i], "", ENTRY_OTHER);
+            int64_t mtime = (int64_t)stats[i].st_mtim.tv_sec * 1000000000LL + stats[i].st_mtim.tv_nsec;
+            run.store.setMetadata(index, stats[i].st_size, stats[i].st_mode, mtime);
+            Candidate candidate = {stats[i].st_dev, stats[i].st_ino, 0, 0, false, false};
+            run.files.push_back(candidate);
+        }
+    }
+    for(size_t i = 0; i < subdirs.size(); i++) {
+        Task child;
+        child.run = task.run;
+        child.parent = handle;
+        child.name = subdirs[i];
+        child.path = task.path + "/" + subdirs[i];
+        queue.push_back(std::move(child));
+    }
+    if(!subdirs.empty()) { wake.notify_all(); }
+}
+
+/* Hashes a batch of files, over their ends or in full depending on the run's phase */
+void DuplicateFinder::hash(Task& task, std::vector<char>& buffer) {
+    PROFILE_SCOPE("dupfinder.hash");
+    Run& run = *task.run;
+    bool full = run.phase == Run::FULL;
+    for(size_t i = 0; i < task.files.size() && run.generation == generation; i++) {
+        uint32_t index = task.files[i];
+        Candidate& file = run.files[index];
+        if(!hashFile(run, index, full, buffer)) { continue; }
+        hashed++;
+        // Remember the hashes for the next run over this file
+        std::lock_guard<std::mutex> guard(cache_lock);
+        CachedHash& remembered = cache[std::make_pair(file.dev, file.ino)];
+        remembered.mtime = run.store.modified(index);
+        remembered.size = run.store.size(index);
+        remembered.head = file.head;
+        remembered.full = file.full;
+        remembered.has_full = file.has_full;
+    }
+}
+
+/* Reads file 'index' of the run and sets its head hash (and its full hash too when the ends cover the whole file),
+   or with 'full' its full hash. Returns false if the file couldn't be read, changed since the walk, or the run was
+   cancelled meanwhile */
+bool DuplicateFinder::hashFile(Run& run, uint32_t index, bool full, std::vector<char>& buffer) {
+    Candidate& file = run.files[index];
+    int64_t size = run.store.size(index);
+    std::string path = run.store.path(index);
+    int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY);
+    if(fd < 0) { return false; }
+    struct stat info;
+    int64_t mtime = -1;
+    if(fstat(fd, &info) == 0) { mtime = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec; }
+    // A file replaced or written to since the walk would be compared against the others' old contents
+    if(mtime != run.store.modified(index) || info.st_ino != file.ino || info.st_dev != file.dev || info.st_size != size) {
+        close(fd);
+        return false;
+    }
+
+    bool ok = true;
+    if(!full) {
+        // Both ends in one buffer; for a file of at most twice HEAD_BYTES that is the whole file
+        size_t head = std::min(size, (int64_t)HEAD_BYTES);
+        size_t tail = std::min(size - (int64_t)head, (int64_t)HEAD_BYTES);
+        buffer.resize(std::max(buffer.size(), head + tail));
+        acquireIO();
+        ok = pread(fd, &buffer[0], head, 0) == (ssize_t)head && (tail == 0 || pread(fd, &buffer[head], tail, size - tail) == (ssize_t)tail);
+        releaseIO();
+        if(ok) {
+            file.head = xxh64(&buffer[0], head + tail, 0);
+            file.has_head = true;
+            hashed_bytes += head + tail;
+            if(size <= 2 * HEAD_BYTES) {
+                file.full = file.head;
+                file.has_full = true;
+            }
+        }
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        buffer.resize(std::max(buffer.size(), (size_t)HASH_READ));
+        Hash64 hash(0);
+        int64_t offset = 0;
+        // The I/O slot is held for one read at a time, so a large file doesn't keep the others waiting
+        while(ok && offset < size) {
+            if(run.generation != generation) { ok = false; break; }
+            acquireIO();
+            ssize_t got = pread(fd, &buffer[0], std::min(size - offset, (int64_t)HASH_READ), offset);
+            releaseIO();
+            if(got <= 0) { ok = false; break; }
+            hash.update(&buffer[0], got);
+            offset += got;
+            hashed_bytes += got;
+        }
+        if(ok) {
+            file.full = hash.digest();
+            file.has_full = true;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+/* Moves the run to its next phase once every task of the current one is done, filling 'tasks' with the files it has to
+   hash (their 'run' is left for the caller to set). Once the full hashes are in it fills 'groups_out' instead and returns false */
+bool DuplicateFinder::advance(Run& run, std::vector<Task>* tasks, std::vector<DuplicateGroup>* groups_out) {
+    PROFILE_SCOPE("dupfinder.advance");
+    std::vector<uint32_t> hash_next;
+    if(run.phase == Run::LISTING) {
+        // Files of equal size end up next to each other, and hard links of one inode next to each other within them
+        std::vector<uint32_t> order(run.files.size());
+        for(uint32_t i = 0; i < order.size(); i++) { order[i] = i; }
+        std::sort(order.begin(), order.end(), [&run](uint32_t a, uint32_t b) {
+            if(run.store.size(a) != run.store.size(b)) { return run.store.size(a) < run.store.size(b); }
+            if(run.files[a].dev != run.files[b].dev) { return run.files[a].dev < run.files[b].dev; }
+            if(run.files[a].ino != run.files[b].ino) { return run.files[a].ino < run.files[b].ino; }
+            return a < b;
+        });
+        for(size_t start = 0; start < order.size();) {
+            size_t end = start + 1;
+            while(end < order.size() && run.store.size(order[end]) == run.store.size(order[start])) { end++; }
+            // One file per inode; a size shared only by links of one inode has no duplicates
+            std::vector<uint32_t> distinct;
+            for(size_t i = start; i < end; i++) {
+                const Candidate& file = run.files[order[i]];
+                if(!distinct.empty() && run.files[distinct.back()].dev == file.dev && run.files[distinct.back()].ino == file.ino) { continue; }
+                distinct.push_back(order[i]);
+            }
+            if(distinct.size() > 1) {
+                run.sized.insert(run.sized.end(), distinct.begin(), distinct.end());
+            }
+            start = end;
+        }
+        candidates = run.sized.size();
+        // Hashes of files unchanged since an earlier run are taken from the cache
+        std::lock_guard<std::mutex> guard(cache_lock);
+        for(size_t i = 0; i < run.sized.size(); i++) {
+            uint32_t index = run.sized[i];
+            Candidate& file = run.files[index];
+            std::map<std::pair<dev_t, ino_t>, CachedHash>::iterator found = cache.find(std::make_pair(file.dev, file.ino));
+            if(found != cache.end() && found->second.mtime == run.store.modified(index) && found->second.size == run.store.size(index)) {
+                file.head = found->second.head;
+                file.full = found->second.full;
+                file.has_head = true;
+                file.has_full = found->second.has_full;
+                cached++;
+            } else {
+                hash_next.push_back(index);
+            }
+        }
+        run.phase = Run::HEADS;
+    } else if(run.phase == Run::HEADS) {
+        // Files that still share their size and head hash with another are hashed in full, unless that is known already
+        std::vector<uint32_t> kept;
+        for(size_t i = 0; i < run.sized.size(); i++) {
+            if(run.files[run.sized[i]].has_head) { kept.push_back(run.sized[i]); }
+        }
+        std::sort(kept.begin(), kept.end(), [&run](uint32_t a, uint32_t b) {
+            if(run.store.size(a) != run.store.size(b)) { return run.store.size(a) < run.store.size(b); }
+            return run.files[a].head < run.files[b].head;
+        });
+        run.sized.clear();
+        for(size_t start = 0; start < kept.size();) {
+            size_t end = start + 1;
+            while(end < kept.size() && run.store.size(kept[end]) == run.store.size(kept[start]) &&
+                  run.files[kept[end]].head == run.files[kept[start]].head) {
+                end++;
+            }
+            if(end - start > 1) {
+                for(size_t i = start; i < end; i++) {
+                    run.sized.push_back(kept[i]);
+                    if(!run.files[kept[i]].has_full) { hash_next.push_back(kept[i]); }
+                }
+            }
+            start = end;
+        }
+        run.phase = Run::FULL;
+    } else {
+        // Files of equal size and full hash are the same; each group is listed by path
+        std::vector<uint32_t> kept;
+        for(size_t i = 0; i < run.sized.size(); i++) {
+            if(run.files[run.sized[i]].has_full) { kept.push_back(run.sized[i]); }
+        }
+        std::sort(kept.begin(), kept.end(), [&run](uint32_t a, uint32_t b) {
+            if(run.store.size(a) != run.store.size(b)) { return run.store.size(a) < run.store.size(b); }
+            return run.files[a].full < run.files[b].full;
+        });
+        for(size_t start = 0; start < kept.size();) {
+            size_t end = start + 1;
+            while(end < kept.size() && run.store.size(kept[end]) == run.store.size(kept[start]) &&
+                  run.files[kept[end]].full == run.files[kept[start]].full) {
+                end++;
+            }
+            if(end - start > 1) {
+                DuplicateGroup group;
+                group.size = run.store.size(kept[start]);
+                for(size_t i = start; i < end; i++) { group.paths.push_back(run.store.path(kept[i])); }
+                std::sort(group.paths.begin(), group.paths.end());
+                groups_out->push_back(std::move(group));
+            }
+            start = end;
+        }
+        // Most space to gain first
+        std::stable_sort(groups_out->begin(), groups_out->end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+            return a.size * (int64_t)(a.paths.size() - 1) > b.size * (int64_t)(b.paths.size() - 1);
+        });
+        return false;
+    }
+
+    for(size_t start = 0; start < hash_next.size(); start += HASH_BATCH) {
+        Task task;
+        task.files.assign(hash_next.begin() + start, hash_next.begin() + std::min(hash_next.size(), start + HASH_BATCH));
+        tasks->push_back(std::move(task));
+    }
+    return true;
+}
+
+void DuplicateFinder::acquireIO() {
+    std::unique_lock<std::mutex> guard(io_lock);
+    while(io_busy >= io_limit) {
+        io_free.wait(guard);
+    }
+    io_busy++;
+}
+
+void DuplicateFinder::releaseIO() {
+    std::lock_guard<std::mutex> guard(io_lock);
+    io_busy--;
+    io_free.notify_one();
+}
+
+void DuplicateFinder::wakeUI() {
+    woken = std::chrono::steady_clock::now();
+    // One queued event is enough, the UI thread takes everything pending when it handles it
+    if(!notified) {
+        notified = true;
+        SDL_Event event = {};
+        event.type = notify_event;
+        SDL_PushEvent(&event);
+    }
+}
@@ -0,0 +1,136 @@
+#include "entrystore.h"
+#include <cstdio>
+#include <cstring>
+
+const uint16_t EntryStore::UNMEASURED;
+const uint8_t EntryStore::FLAG_REMOVED;
+const uint8_t EntryStore::FLAG_SELECTED;
+
+EntryType entryTypeFromString(const char* type) {
+    if(type == NULL) { return ENTRY_OTHER; }
+    if(strcmp(type, "dir") == 0) { return ENTRY_DIR; }
+    if(strcmp(type, "exe") == 0) { return ENTRY_EXE; }
+    if(strcmp(type, "img") == 0) { return ENTRY_IMG; }
+    if(strcmp(type, "vid") == 0) { return ENTRY_VID; }
+    if(strcmp(type, "code") == 0) { return ENTRY_CODE; }
+    return ENTRY_OTHER;
+}
+
+IconType entryIcon(EntryType type) {
+    switch(type) {
+        case ENTRY_DIR: return ICON_FOLDER;
+        case ENTRY_EXE: return ICON_EXECUTABLE;
+        case ENTRY_IMG: return ICON_IMAGE;
+        case ENTRY_VID: return ICON_VIDEO;
+        case ENTRY_CODE: return ICON_CODEFILE;
+        default: return ICON_OTHERFILE;
+    }
+}
+
+std::string formatSize(int64_t size) {
+    // Not fetched yet (the scanner fills it in once the row becomes visible)
+    if(size < 0) { return ""; }
+    char text[24];
+    if(size < 1024LL) {
+        snprintf(text, sizeof(text), "%lld B", (long long)size);
+    } else if(size < 1048576LL) {
+        snprintf(text, sizeof(text), "%.2f KiB", size / 1024.0);
+    } else if(size < 1073741824LL) {
+        snprintf(text, sizeof(text), "%.2f MiB", size / 1048576.0);
+    } else if(size < 1099511627776LL) {
+        snprintf(text, sizeof(text), "%.2f GiB", size / 1073741824.0);
+    } else {
+        snprintf(text, sizeof(text), "%.2f TiB", size / 1099511627776.0);
+    }
+    return text;
+}
+
+EntryStore::EntryStore() : high_water_entries(0), high_water_bytes(0) {
+    reset();
+}
+
+void EntryStore::reset() {
+    high_water_entries = highWaterEntries();
+    high_water_bytes = highWaterBytes();
+    names.clear();
+    keys.clear();
+    name_starts.assign(1, 0);
+    key_starts.assign(1, 0);
+    parents.clear();
+    parent_index.clear();
+    parent_of.clear();
+    types.clear();
+    flags.clear();
+    name_widths.clear();
+    modes.clear();
+    sizes.clear();
+    mtimes.clear();
+}
+
+void EntryStore::swap(EntryStore& other) {
+    names.swap(other.names);
+    name_starts.swap(other.name_starts);
+    keys.swap(other.keys);
+    key_starts.swap(other.key_starts);
+    parents.swap(other.parents);
+    parent_index.swap(other.parent_index);
+    parent_of.swap(other.parent_of);
+    types.swap(other.types);
+    flags.swap(other.flags);
+    name_widths.swap(other.name_widths);
+    modes.swap(other.modes);
+    sizes.swap(other.sizes);
+    mtimes.swap(other.mtimes);
+    // Both keep the larger marks, so statistics survive being parked in a snapshot
+    high_water_entries = other.high_water_entries = std::max(highWaterEntries(), other.highWaterEntries());
+    high_water_bytes = other.high_water_bytes = std::max(highWaterBytes(), other.highWaterBytes());
+}
+
+uint32_t EntryStore::addParent(const std::string& dir) {
+    std::unordered_map<std::string, uint32_t>::iterator found = parent_index.find(dir);
+    if(found != parent_index.end()) { return found->second; }
+    uint32_t index = parents.size();
+    parents.push_back(dir);
+    parent_index[dir] = index;
+    return index;
+}
+
+uint32_t EntryStore::add(uint32_t parent, const std::string& name, const std::string& key, EntryType type) {
+    uint32_t entry = types.size();
+    names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+    name_starts.push_back(names.size());
+    keys.insert(keys.end(), key.c_str(), key.c_str() + key.size() + 1);
+    key_starts.push_back(keys.size());
+    parent_of.push_back(parent);
+    types.push_back(type);
+    flags.push_back(0);
+    name_widths.push_back(UNMEASURED);
+    modes.push_back(0);
+    sizes.push_back(-1);
+    mtimes.push_back(-1);
+    return entry;
+}
+
+std::string EntryStore::path(uint32_t entry) const {
+    const std::string& parent = parentPath(entry);
+    std::string result;
+    result.reserve(parent.size() + 1 + nameLength(entry));
+    result.append(parent);
+    result.push_back('/');
+    result.append(name(entry), nameLength(entry));
+    return result;
+}
+
+void EntryStore::setMetadata(uint32_t entry, int64_t size, uint32_t mode, int64_t mtime) {
+    sizes[entry] = size;
+    modes[entry] = mode;
+    mtimes[entry] = mtime;
+}
+
+size_t EntryStore::reservedBytes() const {
+    size_t bytes = names.capacity() + keys.capacity() + (name_starts.capacity() + key_starts.capacity() + parent_of.capacity()) * sizeof(uint32_t) +
+                   types.capacity() + flags.capacity() + name_widths.capacity() * sizeof(uint16_t) + modes.capacity() * sizeof(uint32_t) +
+                   (sizes.capacity() + mtimes.capacity()) * sizeof(int64_t);
+    for(size_t i = 0; i < parents.size(); i++) { bytes += sizeof(std::string) + parents[i].capacity(); }
+    return bytes;
+}
@@ -0,0 +1,549 @@
+#include "fileops.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+// Bytes handed to the kernel per call; progress is reported and cancellation checked between chunks
+#define COPY_CHUNK (8 * 1024 * 1024)
+// Least time between two progress updates (and the events waking the UI for them)
+#define PROGRESS_INTERVAL_MS 100
+
+// Numbered names tried for a copy before giving up ("name (2)" up to "name (1000)")
+#define FREE_NAME_ATTEMPTS 1000
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+/* "path: reason" for a failed system call */
+static std::string describe(const std::string& path, int error) {
+    return path + ": " + strerror(error);
+}
+
+/* Names in the directory open as 'dir_fd', read completely before anything in it is changed */
+static std::vector<std::string> listNames(int dir_fd) {
+    std::vector<std::string> names;
+    // fdopendir takes ownership of the descriptor it is given, so hand it a duplicate
+    int list_fd = dup(dir_fd);
+    DIR* dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if(dir == NULL) {
+        if(list_fd >= 0) { close(list_fd); }
+        return names;
+    }
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) { continue; }
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    return names;
+}
+
+/* Splits 'path' into the directory holding it and its name (trailing slashes ignored) */
+static void splitPath(std::string path, std::string* parent, std::string* name) {
+    while(path.size() > 1 && path[path.size() - 1] == '/') { path.erase(path.size() - 1); }
+    size_t slash = path.rfind('/');
+    if(slash == std::string::npos) {
+        *parent = ".";
+        *name = path;
+    } else {
+        *parent = slash == 0 ? "/" : path.substr(0, slash);
+        *name = path.substr(slash + 1);
+    }
+}
+
+/* Canonical form of 'path' (symlinks resolved), or 'path' itself if it can't be resolved */
+static std::string resolvedPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) != NULL ? std::string(resolved) : path;
+}
+
+static bool nameTaken(int dir_fd, const std::string& name) {
+    struct stat info;
+    return fstatat(dir_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0 || errno != ENOENT;
+}
+
+/* 1 if 'name' exists in the directory open as 'dir_fd', 0 if it doesn't, -1 (with errno set) if that can't be told */
+static int nameExists(int dir_fd, const std::string& name) {
+    struct stat info;
+    if(fstatat(dir_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0) { return 1; }
+    return errno == ENOENT ? 0 : -1;
+}
+
+/* Sets '*out' to 'name' if it is free in the directory open as 'dir_fd', otherwise to the first free "name (2)",
+   "name (3)", ... (numbered before the extension for files: "photo (2).png"; the stem is shortened to keep the name
+   within NAME_MAX). Returns false with errno set if the directory can't be checked or no free name was found */
+static bool freeName(int dir_fd, const std::string& name, bool is_dir, std::string* out) {
+    *out = name;
+    int exists = nameExists(dir_fd, name);
+    if(exists <= 0) { return exists == 0; }
+    size_t dot = name.rfind('.');
+    if(is_dir || dot == std::string::npos || dot == 0) { dot = name.size(); }
+    for(int n = 2; n <= FREE_NAME_ATTEMPTS; n++) {
+        std::string suffix = " (" + std::to_string(n) + ")" + name.substr(dot);
+        if(suffix.size() >= NAME_MAX) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        size_t stem = std::min(dot, (size_t)NAME_MAX - suffix.size());
+        // Don't cut a UTF-8 character in half
+        while(stem > 0 && stem < dot && (name[stem] & 0xC0) == 0x80) { stem--; }
+        *out = name.substr(0, stem) + suffix;
+        exists = nameExists(dir_fd, *out);
+        if(exists == 0) { return true; }
+        if(exists < 0) { return false; }
+    }
+    errno = EEXIST;
+    return false;
+}
+
+FileOperations::FileOperations(Uint32 notify_event)
+    : notify_event(notify_event), generation(0), items_done(0), items_total(0), bytes_done(0), bytes_total(0),
+      running(false), running_kind(FILEOP_COPY), rate(0), sampled_bytes(0), stopping(false), notified(false) {
+    worker = std::thread(&FileOperations::run, this);
+}
+
+FileOperations::~FileOperations() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    worker.join();
+}
+
+void FileOperations::queue(const FileOperation& operation) {
+    std::lock_guard<std::mutex> guard(lock);
+    waiting.push_back(operation);
+    wake.notify_one();
+}
+
+void FileOperations::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    waiting.clear();
+}
+
+bool FileOperations::busy() {
+    std::lock_guard<std::mutex> guard(lock);
+    return running || !waiting.empty();
+}
+
+FileOpProgress FileOperations::progress() {
+    FileOpProgress progress;
+    std::lock_guard<std::mutex> guard(lock);
+    progress.active = running;
+    progress.kind = running_kind;
+    progress.queued = waiting.size();
+    progress.items_done = items_done;
+    progress.items_total = items_total;
+    progress.bytes_done = bytes_done;
+    progress.bytes_total = bytes_total;
+    progress.bytes_per_second = rate;
+    progress.current = current;
+    notified = false;
+    return progress;
+}
+
+void FileOperations::takeResults(std::vector<FileOpResult>* out) {
+    std::lock_guard<std::mutex> guard(lock);
+    out->insert(out->end(), finished.begin(), finished.end());
+    finished.clear();
+    notified = false;
+}
+
+void FileOperations::run() {
+    PROFILE_THREAD("fileops");
+    while(true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && waiting.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            job.operation = std::move(waiting.front());
+            waiting.pop_front();
+            job.generation = generation;
+            running = true;
+            running_kind = job.operation.kind;
+            current.clear();
+            rate = 0;
+            sampled = std::chrono::steady_clock::now();
+            sampled_bytes = 0;
+            items_done = items_total = bytes_done = bytes_total = 0;
+            wakeUI();
+        }
+        job.result.kind = job.operation.kind;
+        job.result.failed = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        execute(job);
+        job.result.cancelled = cancelled(job);
+        job.result.items_done = items_done;
+        job.result.bytes_done = bytes_done;
+        job.result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+        finished.push_back(job.result);
+        wakeUI();
+    }
+}
+
+/* Carries out one operation; failures are recorded in the job's result and don't stop the remaining sources */
+void FileOperations::execute(Job& job) {
+    PROFILE_SCOPE("fileops.execute");
+    const FileOperation& operation = job.operation;
+    int target_fd = -1;
+    if(operation.kind != FILEOP_DELETE) {
+        target_fd = open(operation.target.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(target_fd < 0) {
+            fail(job, describe(operation.target, errno));
+            return;
+        }
+    }
+    if(operation.kind == FILEOP_MKDIR) {
+        items_total = 1;
+        std::string name;
+        if(freeName(target_fd, operation.name, true, &name) && mkdirat(target_fd, name.c_str(), 0777) == 0) {
+            advance(1, 0, name.c_str());
+        } else {
+            fail(job, describe(operation.target + "/" + name, errno));
+        }
+        close(target_fd);
+        return;
+    }
+
+    // Copies and deletes are measured first, so their totals are right from the start; a move only measures the
+    // sources it can't rename
+    if(operation.kind == FILEOP_MOVE) {
+        items_total = operation.sources.size();
+    } else {
+        for(int i = 0; i < operation.sources.size() && !cancelled(job); i++) {
+            std::string parent, name;
+            splitPath(operation.sources[i], &parent, &name);
+            int parent_fd = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if(parent_fd < 0) { continue; }
+            measure(parent_fd, name, job);
+            close(parent_fd);
+        }
+    }
+
+    std::string target_path = target_fd >= 0 ? resolvedPath(operation.target) : "";
+    for(int i = 0; i < operation.sources.size() && !cancelled(job); i++) {
+        const std::string& path = operation.sources[i];
+        std::string parent, name;
+        splitPath(path, &parent, &name);
+        int parent_fd = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(parent_fd < 0) {
+            fail(job, describe(path, errno));
+            continue;
+        }
+        std::string source_path = resolvedPath(path);
+        if(operation.kind == FILEOP_DELETE) {
+            removeItem(parent_fd, path, name, job, true);
+        } else if(target_path == source_path || target_path.compare(0, source_path.size() + 1, source_path + "/") == 0) {
+            fail(job, path + ": a directory can't be put inside itself");
+        } else if(operation.kind == FILEOP_MOVE && resolvedPath(parent) == target_path) {
+            // Already where it is being moved to
+            advance(1, 0, name.c_str());
+        } else if(operation.kind == FILEOP_MOVE) {
+            move(parent_fd, path, name, target_fd, job);
+        } else {
+            struct stat info;
+            bool is_dir = fstatat(parent_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+            std::string copy_name;
+            if(!freeName(target_fd, name, is_dir, &copy_name)) {
+                fail(job, describe(path, errno));
+            }
+            // Only complete copies are kept: a cancelled one is removed with everything it had copied so far
+            else if(!copyItem(parent_fd, path, name, target_fd, copy_name, job) && cancelled(job) && nameTaken(target_fd, copy_name)) {
+                removeItem(target_fd, operation.target + "/" + copy_name, copy_name, job, false);
+            }
+        }
+        close(parent_fd);
+    }
+    if(target_fd >= 0) { close(target_fd); }
+}
+
+/* Adds 'name' and everything below it to the totals */
+void FileOperations::measure(int dir_fd, const std::string& name, const Job& job) {
+    if(cancelled(job)) { return; }
+    struct stat info;
+    if(fstatat(dir_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) { return; }
+    items_total++;
+    if(S_ISREG(info.st_mode)) {
+        bytes_total += info.st_size;
+    } else if(S_ISDIR(info.st_mode)) {
+        int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if(fd < 0) { return; }
+        std::vector<std::string> names = listNames(fd);
+        for(int i = 0; i < names.size(); i++) { measure(fd, names[i], job); }
+        close(fd);
+    }
+}
+
+/* Moves 'name' into the directory open as 'dst_dir' with one rename if both are on the same file system, otherwise by
+   copying it and deleting the source once the copy is complete; if the copy fails or is cancelled, it is removed and the
+   source stays as it was */
+void FileOperations::move(int src_dir, const std::string& path, const std::string& name, int dst_dir, Job& job) {
+    struct stat info;
+    if(fstatat(src_dir, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+        fail(job, describe(path, errno));
+        return;
+    }
+    bool is_dir = S_ISDIR(info.st_mode);
+    std::string dst_name = name;
+    int moved = renameat2(src_dir, name.c_str(), dst_dir, dst_name.c_str(), RENAME_NOREPLACE);
+    // The name is taken: move under a free one (the check can race, but RENAME_NOREPLACE still never replaces anything)
+    if(moved != 0 && errno == EEXIST) {
+        if(!freeName(dst_dir, name, is_dir, &dst_name)) {
+            fail(job, describe(path, errno));
+            return;
+        }
+        moved = renameat2(src_dir, name.c_str(), dst_dir, dst_name.c_str(), RENAME_NOREPLACE);
+    }
+    // File systems that don't support RENAME_NOREPLACE get a plain rename after checking the name is free
+    if(moved != 0 && (errno == EINVAL || errno == ENOSYS)) {
+        if(!freeName(dst_dir, name, is_dir, &dst_name)) {
+            fail(job, describe(path, errno));
+            return;
+        }
+        moved = renameat(src_dir, name.c_str(), dst_dir, dst_name.c_str());
+    }
+    if(moved == 0) {
+        advance(1, 0, name.c_str());
+        return;
+    }
+    if(errno != EXDEV) {
+        fail(job, describe(path, errno));
+        return;
+    }
+
+    // Across file systems: the item was counted as one, now it counts as everything below it
+    items_total--;
+    measure(src_dir, name, job);
+    if(!freeName(dst_dir, name, is_dir, &dst_name)) {
+        fail(job, describe(path, errno));
+        return;
+    }
+    int failed = job.result.failed;
+    bool copied = copyItem(src_dir, path, name, dst_dir, dst_name, job) && job.result.failed == failed && !cancelled(job);
+    if(copied) {
+        // Not cancellable: stopping halfway would leave the item in both places
+        removeItem(src_dir, path, name, job, false);
+    } else if(nameTaken(dst_dir, dst_name)) {
+        removeItem(dst_dir, dst_name, dst_name, job, false);
+    }
+}
+
+/* Copies 'name' (a file, symlink or directory tree) from 'src_dir' to 'dst_name' in 'dst_dir', which must not exist yet.
+   Returns false if anything in it failed or the operation was cancelled; what was copied is left to the caller */
+bool FileOperations::copyItem(int src_dir, const std::string& path, const std::string& name, int dst_dir, const std::string& dst_name,
+                              Job& job) {
+    if(cancelled(job)) { return false; }
+    struct stat info;
+    if(fstatat(src_dir, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+        fail(job, describe(path, errno));
+        return false;
+    }
+
+    if(S_ISREG(info.st_mode)) {
+        return copyFile(src_dir, path, name, dst_dir, dst_name, info, job);
+    }
+    if(S_ISLNK(info.st_mode)) {
+        // Links are copied as links, pointing where the original points
+        std::vector<char> target(std::max((off_t)PATH_MAX, info.st_size + 1));
+        ssize_t length = readlinkat(src_dir, name.c_str(), target.data(), target.size() - 1);
+        if(length < 0) {
+            fail(job, describe(path, errno));
+            return false;
+        }
+        target[length] = '\0';
+        if(symlinkat(target.data(), dst_dir, dst_name.c_str()) != 0) {
+            fail(job, describe(path, errno));
+            return false;
+        }
+        advance(1, 0, name.c_str());
+        return true;
+    }
+    if(!S_ISDIR(info.st_mode)) {
+        fail(job, path + ": not a file, directory or symbolic link");
+        return false;
+    }
+
+    // Created private and given the source's permissions once filled, so even a read-only directory can be filled
+    if(mkdirat(dst_dir, dst_name.c_str(), 0700) != 0) {
+        fail(job, describe(path, errno));
+        return false;
+    }
+    int src_fd = openat(src_dir, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    int dst_fd = openat(dst_dir, dst_name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    bool ok = src_fd >= 0 && dst_fd >= 0;
+    if(!ok) {
+        fail(job, describe(path, errno));
+    } else {
+        std::vector<std::string> names = listNames(src_fd);
+        for(int i = 0; i < names.size() && !cancelled(job); i++) {
+            ok &= copyItem(src_fd, path + "/" + names[i], names[i], dst_fd, names[i], job);
+        }
+        // Set last: filling the directory changed its modification time
+        fchmod(dst_fd, info.st_mode & 07777);
+        struct timespec times[2] = {info.st_atim, info.st_mtim};
+        futimens(dst_fd, times);
+    }
+    if(src_fd >= 0) { close(src_fd); }
+    if(dst_fd >= 0) { close(dst_fd); }
+    advance(1, 0, name.c_str());
+    return ok && !cancelled(job);
+}
+
+/* Copies a regular file's contents, permissions and times; a copy that fails or is cancelled halfway is deleted */
+bool FileOperations::copyFile(int src_dir, const std::string& path, const std::string& name, int dst_dir, const std::string& dst_name,
+                              const struct stat& info, Job& job) {
+    int in = openat(src_dir, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if(in < 0) {
+        fail(job, describe(path, errno));
+        return false;
+    }
+    int out = openat(dst_dir, dst_name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(out < 0) {
+        fail(job, describe(path, errno));
+        close(in);
+        return false;
+    }
+
+    bool ok = false;
+    int error = 0;
+#ifdef FICLONE
+    // A reflink shares the source's extents instead of copying them, so it takes no time whatever the size
+    if(info.st_size > 0 && ioctl(out, FICLONE, in) == 0) {
+        advance(0, info.st_size, name.c_str());
+        ok = true;
+    }
+#endif
+    if(!ok) {
+        // copy_file_range() copies inside the kernel (server-side on NFS and SMB); sendfile() where it isn't supported
+        bool use_sendfile = false;
+        loff_t in_offset = 0, out_offset = 0;
+        off_t offset = 0;
+        int64_t copied = 0;
+        while(!cancelled(job)) {
+            ssize_t length;
+            if(!use_sendfile) {
+                length = copy_file_range(in, &in_offset, out, &out_offset, COPY_CHUNK, 0);
+                if(length < 0 && copied == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP ||
+                                                 errno == EBADF)) {
+                    use_sendfile = true;
+                    continue;
+                }
+            } else {
+                length = sendfile(out, in, &offset, COPY_CHUNK);
+            }
+            if(length < 0 && errno == EINTR) { continue; }
+            if(length < 0) {
+                error = errno;
+                break;
+            }
+            if(length == 0) {
+                ok = true;
+                break;
+            }
+            copied += length;
+            advance(0, length, name.c_str());
+        }
+    }
+
+    if(ok) {
+        fchmod(out, info.st_mode & 07777);
+        struct timespec times[2] = {info.st_atim, info.st_mtim};
+        futimens(out, times);
+    }
+    // Write errors of network file systems may only show up here
+    if(close(out) != 0 && ok) {
+        ok = false;
+        error = errno;
+    }
+    close(in);
+    if(!ok) {
+        unlinkat(dst_dir, dst_name.c_str(), 0);
+        if(!cancelled(job)) { fail(job, describe(path, error)); }
+        return false;
+    }
+    advance(1, 0, name.c_str());
+    return true;
+}
+
+bool FileOperations::removeItem(int dir_fd, const std::string& path, const std::string& name, Job& job, bool counted) {
+    struct stat info;
+    if(fstatat(dir_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+        fail(job, describe(path, errno));
+        return false;
+    }
+    bool ok = true;
+    if(S_ISDIR(info.st_mode)) {
+        int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if(fd < 0) {
+            fail(job, describe(path, errno));
+            return false;
+        }
+        std::vector<std::string> names = listNames(fd);
+        for(int i = 0; i < names.size() && !(counted && cancelled(job)); i++) {
+            ok &= removeItem(fd, path + "/" + names[i], names[i], job, counted);
+        }
+        close(fd);
+        if(!ok || (counted && cancelled(job))) { return false; }
+        if(unlinkat(dir_fd, name.c_str(), AT_REMOVEDIR) != 0) {
+            fail(job, describe(path, errno));
+            return false;
+        }
+    } else if(unlinkat(dir_fd, name.c_str(), 0) != 0) {
+        fail(job, describe(path, errno));
+        return false;
+    }
+    if(counted) { advance(1, 0, name.c_str()); }
+    return true;
+}
+
+void FileOperations::fail(Job& job, const std::string& message) {
+    fprintf(stderr, "Error: %s\n", message.c_str());
+    if(job.result.failed++ == 0) { job.result.error = message; }
+}
+
+/* Counts finished items and copied bytes; every PROGRESS_INTERVAL_MS the throughput is updated and the UI woken */
+void FileOperations::advance(int64_t items, int64_t bytes, const char* name) {
+    items_done += items;
+    bytes_done += bytes;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - sampled).count();
+    if(seconds * 1000 < PROGRESS_INTERVAL_MS) { return; }
+
+    std::lock_guard<std::mutex> guard(lock);
+    double recent = (bytes_done - sampled_bytes) / seconds;
+    // Smoothed over about a second of samples, so the figure doesn't jump with every chunk
+    rate = rate == 0 ? recent : rate * 0.8 + recent * 0.2;
+    sampled = now;
+    sampled_bytes = bytes_done;
+    current = name;
+    wakeUI();
+}
+
+/* Pushes the notify event unless one is already waiting in the queue (call with 'lock' held) */
+void FileOperations::wakeUI() {
+    if(notified) { return; }
+    notified = true;
+    SDL_Event event = {};
+    event.type = notify_event;
+    SDL_PushEvent(&event);
+}
@@ -0,0 +1,134 @@
+#include "filetypes.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bytes read from the start of a file to recognise it; enough for every signature below
+// (an MPEG transport stream is told by the sync byte of its second 188-byte packet)
+#define SNIFF_BYTES 192
+#define TS_PACKET_SIZE 188
+// Longest extension looked up; anything longer is treated as unknown
+#define MAX_EXTENSION 15
+
+typedef struct ExtensionType {
+    const char* extension;
+    // NULL for extensions shared by unrelated formats
+    const char* type;
+} ExtensionType;
+
+// Lowercase extensions in strcmp order (checked at compile time below), looked up by binary search
+static constexpr ExtensionType ExtensionTypes[] = {
+    {"3g2", "vid"}, {"3gp", "vid"}, {"7z", "other"}, {"a", "other"}, {"aac", "other"}, {"aiff", "other"},
+    {"apk", "other"}, {"apng", "img"}, {"arw", "img"}, {"asf", "vid"}, {"asm", "code"}, {"avi", "vid"}, {"avif", "img"},
+    {"awk", "code"}, {"bash", "code"}, {"bat", "code"}, {"bin", NULL}, {"bmp", "img"}, {"bz2", "other"}, {"c", "code"},
+    {"c++", "code"}, {"cc", "code"}, {"cfg", "code"}, {"cjs", "code"}, {"cl", "code"}, {"class", "other"},
+    {"clj", "code"}, {"cljs", "code"}, {"cmake", "code"}, {"cmd", "code"}, {"conf", "other"}, {"cpp", "code"},
+    {"cr2", "img"}, {"cr3", "img"}, {"crt", "other"}, {"cs", "code"}, {"csh", "code"}, {"css", "code"},
+    {"csv", "other"}, {"cu", "code"}, {"cxx", "code"}, {"d", "code"}, {"dart", "code"}, {"dat", NULL}, {"db", "other"},
+    {"dds", "img"}, {"deb", "other"}, {"desktop", "other"}, {"dib", "img"}, {"divx", "vid"}, {"dll", "other"},
+    {"dmg", "other"}, {"dng", "img"}, {"doc", "other"}, {"docx", "other"}, {"dylib", "other"}, {"el", "code"},
+    {"elm", "code"}, {"epub", "other"}, {"erb", "code"}, {"erl", "code"}, {"ex", "code"}, {"exe", "other"},
+    {"exr", "img"}, {"exs", "code"}, {"f", "code"}, {"f4v", "vid"}, {"f90", "code"}, {"f95", "code"}, {"fish", "code"},
+    {"flac", "other"}, {"flv", "vid"}, {"for", "code"}, {"frag", "code"}, {"fs", "code"}, {"fsx", "code"},
+    {"gd", "code"}, {"gif", "img"}, {"glsl", "code"}, {"go", "code"}, {"gradle", "code"}, {"groovy", "code"},
+    {"gz", "other"}, {"h", "code"}, {"h++", "code"}, {"hdr", "img"}, {"heic", "img"}, {"heif", "img"}, {"hh", "code"},
+    {"hlsl", "code"}, {"hpp", "code"}, {"hrl", "code"}, {"hs", "code"}, {"htm", "code"}, {"html", "code"},
+    {"hxx", "code"}, {"icns", "img"}, {"ico", "img"}, {"ics", "other"}, {"img", "other"}, {"ini", "code"},
+    {"inl", "code"}, {"ipp", "code"}, {"iso", "other"}, {"j2k", "img"}, {"jar", "other"}, {"java", "code"},
+    {"jfif", "img"}, {"jl", "code"}, {"jp2", "img"}, {"jpe", "img"}, {"jpeg", "img"}, {"jpg", "img"}, {"js", "code"},
+    {"json", "code"}, {"jsx", "code"}, {"jxl", "img"}, {"key", "other"}, {"ksh", "code"}, {"kt", "code"},
+    {"kts", "code"}, {"less", "code"}, {"lhs", "code"}, {"lib", "other"}, {"lisp", "code"}, {"lock", "other"},
+    {"log", "other"}, {"lua", "code"}, {"lz4", "other"}, {"lzma", "other"}, {"m", NULL}, {"m2ts", "vid"},
+    {"m2v", "vid"}, {"m4a", "other"}, {"m4v", "vid"}, {"mak", "code"}, {"make", "code"}, {"md", "other"},
+    {"mid", "other"}, {"midi", "other"}, {"mjs", "code"}, {"mk", "code"}, {"mkv", "vid"}, {"ml", "code"},
+    {"mli", "code"}, {"mm", "code"}, {"mobi", "other"}, {"mov", "vid"}, {"mp3", "other"}, {"mp4", "vid"},
+    {"mpe", "vid"}, {"mpeg", "vid"}, {"mpg", "vid"}, {"msi", "other"}, {"mts", "vid"}, {"mxf", "vid"}, {"nef", "img"},
+    {"nim", "code"}, {"o", "other"}, {"obj", "other"}, {"odp", "other"}, {"ods", "other"}, {"odt", "other"},
+    {"oga", "other"}, {"ogg", "other"}, {"ogv", "vid"}, {"opus", "other"}, {"orf", "img"}, {"otf", "other"},
+    {"pas", "code"}, {"pbm", "img"}, {"pcx", "img"}, {"pdf", "other"}, {"pef", "img"}, {"pem", "other"}, {"pgm", "img"},
+    {"php", "code"}, {"pl", "code"}, {"pm", "code"}, {"png", "img"}, {"pnm", "img"}, {"ppm", "img"}, {"ppt", "other"},
+    {"pptx", "other"}, {"proto", "code"}, {"ps1", "code"}, {"psd", "img"}, {"pub", "other"}, {"py", "code"},
+    {"pyc", "other"}, {"pyi", "code"}, {"pyw", "code"}, {"qoi", "img"}, {"qt", "vid"}, {"r", "code"}, {"rar", "other"},
+    {"raw", "img"}, {"rb", "code"}, {"rkt", "code"}, {"rm", "vid"}, {"rmvb", "vid"}, {"rpm", "other"}, {"rs", "code"},
+    {"rst", "other"}, {"rtf", "other"}, {"rw2", "img"}, {"s", "code"}, {"sass", "code"}, {"scala", "code"},
+    {"scm", "code"}, {"scss", "code"}, {"sed", "code"}, {"service", "other"}, {"sh", "code"}, {"so", "other"},
+    {"sql", "code"}, {"sqlite", "other"}, {"sqlite3", "other"}, {"srw", "img"}, {"sv", "code"}, {"svelte", "code"},
+    {"svg", "img"}, {"svgz", "img"}, {"swift", "code"}, {"tar", "other"}, {"tcc", "code"}, {"tex", "code"},
+    {"tga", "img"}, {"tgz", "other"}, {"thrift", "code"}, {"tif", "img"}, {"tiff", "img"}, {"tmp", NULL},
+    {"toml", "code"}, {"torrent", "other"}, {"ts", NULL}, {"tsv", "other"}, {"tsx", "code"}, {"ttf", "other"},
+    {"txt", "other"}, {"v", "code"}, {"vb", "code"}, {"vcf", "other"}, {"vert", "code"}, {"vhd", "code"},
+    {"vhdl", "code"}, {"vob", "vid"}, {"vue", "code"}, {"war", "other"}, {"wav", "other"}, {"webm", "vid"},
+    {"webp", "img"}, {"wma", "other"}, {"wmv", "vid"}, {"woff", "other"}, {"woff2", "other"}, {"xbm", "img"},
+    {"xcf", "img"}, {"xhtml", "code"}, {"xls", "other"}, {"xlsx", "other"}, {"xml", "code"}, {"xpm", "img"},
+    {"xsl", "code"}, {"xz", "other"}, {"y4m", "vid"}, {"yaml", "code"}, {"yml", "code"}, {"zig", "code"},
+    {"zip", "other"}, {"zsh", "code"}, {"zst", "other"}
+};
+static const size_t ExtensionTypeCount = sizeof(ExtensionTypes) / sizeof(ExtensionTypes[0]);
+
+constexpr int compareExtensions(const char* a, const char* b) {
+    return *a != *b ? (unsigned char)*a - (unsigned char)*b : (*a == '\0' ? 0 : compareExtensions(a + 1, b + 1));
+}
+
+constexpr bool extensionsSorted(const ExtensionType* table, size_t count) {
+    return count < 2 || (compareExtensions(table[0].extension, table[1].extension) < 0 && extensionsSorted(table + 1, count - 1));
+}
+
+static_assert(extensionsSorted(ExtensionTypes, sizeof(ExtensionTypes) / sizeof(ExtensionTypes[0])),
+              "ExtensionTypes must be sorted by extension without duplicates");
+
+const char* classifyByExtension(const std::string& name) {
+    // Only the final extension counts ("archive.tar.gz" is a ".gz"); a leading dot marks a hidden file, not an extension
+    size_t dot = name.rfind('.');
+    if(dot == std::string::npos || dot == 0 || dot + 1 == name.size() || name.size() - dot - 1 > MAX_EXTENSION) {
+        return NULL;
+    }
+    char extension[MAX_EXTENSION + 1];
+    size_t length = 0;
+    for(size_t i = dot + 1; i < name.size(); i++) {
+        extension[length++] = tolower((unsigned char)name[i]);
+    }
+    extension[length] = '\0';
+
+    const ExtensionType* end = ExtensionTypes + ExtensionTypeCount;
+    const ExtensionType* found = std::lower_bound(ExtensionTypes, end, extension, [](const ExtensionType& entry, const char* key) {
+        return strcmp(entry.extension, key) < 0;
+    });
+    if(found == end || strcmp(found->extension, extension) != 0) { return NULL; }
+    return found->type;
+}
+
+/* True if 'signature' appears at 'offset' in the first 'length' bytes of 'data' */
+static bool matches(const unsigned char* data, size_t length, size_t offset, const char* signature, size_t signature_length) {
+    return offset + signature_length <= length && memcmp(data + offset, signature, signature_length) == 0;
+}
+
+const char* sniffFileType(int dir_fd, const char* name) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if(fd < 0) { return NULL; }
+    unsigned char data[SNIFF_BYTES];
+    ssize_t read_bytes = pread(fd, data, sizeof(data), 0);
+    close(fd);
+    if(read_bytes <= 0) { return NULL; }
+    size_t length = read_bytes;
+
+    // Images
+    if(matches(data, length, 0, "\x89PNG\r\n\x1a\n", 8) || matches(data, length, 0, "\xff\xd8\xff", 3) ||
+       matches(data, length, 0, "GIF87a", 6) || matches(data, length, 0, "GIF89a", 6) ||
+       matches(data, length, 0, "II*\0", 4) || matches(data, length, 0, "MM\0*", 4) || matches(data, length, 0, "BM", 2) ||
+       (matches(data, length, 0, "RIFF", 4) && matches(data, length, 8, "WEBP", 4)) ||
+       matches(data, length, 4, "ftypavif", 8) || matches(data, length, 4, "ftypheic", 8)) {
+        return "img";
+    }
+    // Videos: ISO media (MP4, MOV), Matroska/WebM, AVI, MPEG program and transport streams (sync byte every 188 bytes)
+    if(matches(data, length, 4, "ftyp", 4) || matches(data, length, 4, "moov", 4) || matches(data, length, 0, "\x1a\x45\xdf\xa3", 4) ||
+       (matches(data, length, 0, "RIFF", 4) && matches(data, length, 8, "AVI ", 4)) || matches(data, length, 0, "\0\0\x01\xba", 4) ||
+       (length > TS_PACKET_SIZE && data[0] == 0x47 && data[TS_PACKET_SIZE] == 0x47)) {
+        return "vid";
+    }
+    // Scripts start with an interpreter line
+    if(matches(data, length, 0, "#!", 2)) {
+        return "code";
+    }
+    return NULL;
+}
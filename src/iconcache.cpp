@@ -0,0 +1,76 @@
+#include "iconcache.h"
+#include "profiler.h"
+#include <cstdio>
+
+// File backing each IconType, in enum order
+static const char* icon_files[ICON_COUNT] = {
+    "resrc/images/folder_icon.png",
+    "resrc/images/executable_icon.png",
+    "resrc/images/image_icon.png",
+    "resrc/images/video_icon.png",
+    "resrc/images/codefile_icon.png",
+    "resrc/images/otherfile_icon.png",
+    "resrc/images/home_icon.png",
+    "resrc/images/desktop_icon.png",
+    "resrc/images/recursive_icon.png",
+    "resrc/images/back_icon.png"
+};
+
+IconCache::IconCache() {
+    for(int i = 0; i < ICON_COUNT; i++) { slots[i] = {0, 0, 0, 0}; }
+}
+
+IconCache::~IconCache() {
+    unload();
+}
+
+void IconCache::unload() {
+    atlas.reset();
+}
+
+/* Decodes every icon once, blits them into one surface laid out as a grid, and uploads it as a single texture */
+bool IconCache::load(SDL_Renderer* renderer) {
+    PROFILE_SCOPE("icons.load");
+    int rows = (ICON_COUNT + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+    SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_COLUMNS * CELL_SIZE, rows * CELL_SIZE, 32, SDL_PIXELFORMAT_RGBA32);
+    if(sheet == NULL) {
+        fprintf(stderr, "Error: could not create icon atlas surface: %s\n", SDL_GetError());
+        return false;
+    }
+
+    for(int i = 0; i < ICON_COUNT; i++) {
+        slots[i] = {(i % ATLAS_COLUMNS) * CELL_SIZE, (i / ATLAS_COLUMNS) * CELL_SIZE, CELL_SIZE, CELL_SIZE};
+
+        SDL_Surface *surf = IMG_Load(icon_files[i]);
+        if(surf == NULL) {
+            fprintf(stderr, "Error: could not load icon '%s'\n", icon_files[i]);
+            continue;
+        }
+        // Copy the pixels (including alpha) instead of blending them onto the empty sheet
+        SDL_SetSurfaceBlendMode(surf, SDL_BLENDMODE_NONE);
+        SDL_Rect cell = slots[i];
+        if(surf->w == CELL_SIZE && surf->h == CELL_SIZE) {
+            SDL_BlitSurface(surf, NULL, sheet, &cell);
+        } else {
+            SDL_BlitScaled(surf, NULL, sheet, &cell);
+        }
+        SDL_FreeSurface(surf);
+    }
+
+    atlas.reset(SDL_CreateTextureFromSurface(renderer, sheet));
+    SDL_FreeSurface(sheet);
+    if(!atlas) {
+        fprintf(stderr, "Error: could not create icon atlas texture: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(atlas.get(), SDL_BLENDMODE_BLEND);
+    return true;
+}
+
+void IconCache::draw(SDL_Renderer* renderer, IconType type, const SDL_Rect* dst, SDL_RendererFlip flip) const {
+    if(flip == SDL_FLIP_NONE) {
+        SDL_RenderCopy(renderer, atlas.get(), &slots[type], dst);
+    } else {
+        SDL_RenderCopyEx(renderer, atlas.get(), &slots[type], dst, 0.0, NULL, flip);
+    }
+}
@@ -0,0 +1,162 @@
+#include "launcher.h"
+#include "profiler.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// Program every file is opened with
+#define OPENER "xdg-open"
+
+// Written by the SIGCHLD handler, read by the reaper thread; file scope because signal handlers take no arguments
+static int ChildPipe[2] = {-1, -1};
+
+/* Only async-signal-safe calls are allowed here: wake the reaper and leave */
+static void childExited(int) {
+    int saved_errno = errno;
+    char byte = 0;
+    // The pipe is non-blocking; if it is full the reaper has a wake-up pending anyway
+    ssize_t ignored = write(ChildPipe[1], &byte, 1);
+    (void)ignored;
+    errno = saved_errno;
+}
+
+static double millisecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+Launcher::Launcher(Uint32 notify_event) : notify_event(notify_event), stopping(false) {
+    if(pipe(ChildPipe) != 0) {
+        perror("Launcher: pipe");
+        return;
+    }
+    for(int i = 0; i < 2; i++) {
+        fcntl(ChildPipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    fcntl(ChildPipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = childExited;
+    sigemptyset(&action.sa_mask);
+    // Stopped children aren't interesting, and interrupted system calls elsewhere should just continue
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, NULL);
+
+    reaper = std::thread(&Launcher::reap, this);
+}
+
+Launcher::~Launcher() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    if(ChildPipe[1] >= 0) {
+        char byte = 0;
+        ssize_t ignored = write(ChildPipe[1], &byte, 1);
+        (void)ignored;
+    }
+    if(reaper.joinable()) {
+        reaper.join();
+    }
+    // Openers still running are left to finish on their own; they are reparented once we exit
+    signal(SIGCHLD, SIG_DFL);
+    for(int i = 0; i < 2; i++) {
+        if(ChildPipe[i] >= 0) { close(ChildPipe[i]); }
+        ChildPipe[i] = -1;
+    }
+}
+
+bool Launcher::open(const std::string& path) {
+    PROFILE_SCOPE("launch.spawn");
+    std::chrono::steady_clock::time_point clicked = std::chrono::steady_clock::now();
+
+    // The child starts with default signal handling and mask, and without our stdin
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    char* argv[] = {const_cast<char*>(OPENER), const_cast<char*>(path.c_str()), NULL};
+    pid_t pid;
+    int err;
+    {
+        // Hold the lock across the spawn so the reaper can't see the child exit before it is registered
+        std::lock_guard<std::mutex> guard(lock);
+        err = posix_spawnp(&pid, OPENER, &actions, &attributes, argv, environ);
+        if(err == 0) {
+            Launch launch;
+            launch.path = path;
+            launch.spawned = std::chrono::steady_clock::now();
+            launch.spawn_ms = millisecondsBetween(clicked, launch.spawned);
+            running[pid] = launch;
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    if(err != 0) {
+        fprintf(stderr, "Error: could not start %s for '%s': %s\n", OPENER, path.c_str(), strerror(err));
+        return false;
+    }
+    return true;
+}
+
+void Launcher::takeResults(std::vector<LaunchResult>* out) {
+    std::lock_guard<std::mutex> guard(lock);
+    out->insert(out->end(), finished.begin(), finished.end());
+    finished.clear();
+}
+
+/* Sleeps until SIGCHLD (or the destructor) writes to the pipe, then collects every opener that has exited */
+void Launcher::reap() {
+    PROFILE_THREAD("reaper");
+    while(true) {
+        char bytes[64];
+        ssize_t got = read(ChildPipe[0], bytes, sizeof(bytes));
+        if(got < 0 && errno != EINTR) { return; }
+
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(stopping) { return; }
+            // Only our own openers are waited for, so children started by anything else are left alone
+            std::map<pid_t, Launch>::iterator it = running.begin();
+            while(it != running.end()) {
+                int status;
+                if(waitpid(it->first, &status, WNOHANG) != it->first) {
+                    ++it;
+                    continue;
+                }
+                LaunchResult result;
+                result.path = it->second.path;
+                result.pid = it->first;
+                result.status = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+                result.spawn_ms = it->second.spawn_ms;
+                result.run_ms = millisecondsBetween(it->second.spawned, std::chrono::steady_clock::now());
+                finished.push_back(result);
+                running.erase(it++);
+                notify = true;
+            }
+        }
+        if(notify) {
+            SDL_Event event = {};
+            event.type = notify_event;
+            SDL_PushEvent(&event);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#include "listview.h"
+#include <algorithm>
+
+ListView::ListView(SDL_Rect viewport, SDL_Rect scroll_track, int row_height)
+    : viewport(viewport), track(scroll_track), row_height(row_height),
+      row_count(0), scroll_offset(0), dragging(false), grab_offset(0) {
+}
+
+void ListView::setRowCount(int count) {
+    row_count = count;
+    scrollTo(scroll_offset);
+}
+
+int ListView::maxScroll() const {
+    int content_height = row_count * row_height;
+    return content_height > viewport.h ? content_height - viewport.h : 0;
+}
+
+bool ListView::scrollBy(int pixels) {
+    return scrollTo(scroll_offset + pixels);
+}
+
+bool ListView::scrollTo(int pixels) {
+    int previous = scroll_offset;
+    scroll_offset = std::max(0, std::min(pixels, maxScroll()));
+    return scroll_offset != previous;
+}
+
+int ListView::firstVisibleRow() const {
+    return std::min(row_count, scroll_offset / row_height);
+}
+
+int ListView::endVisibleRow() const {
+    // Round up so a partially visible last row is included
+    int end = (scroll_offset + viewport.h + row_height - 1) / row_height;
+    return std::min(row_count, end);
+}
+
+int ListView::rowAt(int y) const {
+    if(y < viewport.y || y >= viewport.y + viewport.h) { return -1; }
+    int row = (y - viewport.y + scroll_offset) / row_height;
+    return row < row_count ? row : -1;
+}
+
+/* The thumb's height is proportional to the visible fraction of the list, its position to the scroll offset */
+SDL_Rect ListView::scrollThumb() const {
+    int content_height = row_count * row_height;
+    if(content_height <= viewport.h) {
+        return track;
+    }
+    int thumb_height = std::max(20, (int)((long long)track.h * viewport.h / content_height));
+    int thumb_y = track.y + (int)((long long)(track.h - thumb_height) * scroll_offset / maxScroll());
+    SDL_Rect thumb = {track.x, thumb_y, track.w, thumb_height};
+    return thumb;
+}
+
+/* Returns true if the press landed on the scroll bar. Grabbing the thumb starts a drag,
+   clicking the track above or below it pages up or down */
+bool ListView::pressScrollBar(int mouse_x, int mouse_y) {
+    if(mouse_x < track.x || mouse_x >= track.x + track.w || mouse_y < track.y || mouse_y >= track.y + track.h) {
+        return false;
+    }
+    SDL_Rect thumb = scrollThumb();
+    if(mouse_y < thumb.y) {
+        scrollBy(-viewport.h);
+    } else if(mouse_y >= thumb.y + thumb.h) {
+        scrollBy(viewport.h);
+    } else {
+        dragging = true;
+        grab_offset = mouse_y - thumb.y;
+    }
+    return true;
+}
+
+bool ListView::dragScrollBar(int mouse_y) {
+    if(!dragging) { return false; }
+    SDL_Rect thumb = scrollThumb();
+    int travel = track.h - thumb.h;
+    if(travel <= 0) { return false; }
+    int thumb_y = std::max(0, std::min(mouse_y - grab_offset - track.y, travel));
+    return scrollTo((int)((long long)thumb_y * maxScroll() / travel));
+}
+
+void ListView::drawScrollBar(SDL_Renderer* renderer) const {
+    // Purple track across the right side of the window with a gray thumb
+    SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
+    SDL_RenderFillRect(renderer, &track);
+    SDL_Rect thumb = scrollThumb();
+    SDL_SetRenderDrawColor(renderer, 152, 153, 155, 255);
+    SDL_RenderFillRect(renderer, &thumb);
+}
@@ -8,31 +8,217 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <sys/wait.h>
-#include "entries.h"
+#include "entrystore.h"
+#include "listview.h"
+#include "textrenderer.h"
+#include "scanner.h"
+#include "treewalker.h"
+#include "treemodel.h"
+#include "sorter.h"
+#include "launcher.h"
+#include "profiler.h"
+#include "thumbnails.h"
+#include "searchindex.h"
+#include "filetypes.h"
+#include "dirsizes.h"
+#include "prefetcher.h"
+#include "dirwatcher.h"
+#include "fileops.h"
+#include "contentsearch.h"
+#include "dupfinder.h"
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
 
 // Definitions for the width and height of the window
 #define WIDTH 800   
 #define HEIGHT 600
 
+// The content search starts once typing has paused this long (in milliseconds), or on Enter
+#define CONTENT_SEARCH_DELAY 300
+
 // Structure containing all data needed for application
 typedef struct AppData {
-    TTF_Font *font;
-    TTF_Font *recursive_font;
+    // Glyph atlases for the list view (20pt) and the recursive view (15pt)
+    TextRenderer text;
+    TextRenderer recursive_text;
 
-    SDL_Texture* home;
-    SDL_Texture* desktop;
-    SDL_Texture* recursiveview;
-    SDL_Texture* filename_header;
-    SDL_Texture* size_header;
-    SDL_Texture* permissions_header;
+    // Atlas holding every icon (sidebar buttons and entry icons)
+    IconCache icons;
+    // Thumbnails of the image rows on screen
+    ThumbnailAtlas thumbnails;
 
 } AppData;
 
-// Vector of FileEntries containing the various objects whose data will be rendered
-std::vector<FileEntry*> ExplorerEntries;
-// Vector of strings containing just the names of file explorer entries in a specific directory
-std::vector<std::string> RecursiveEntries;
+// The kinds of UI element a click can land on
+enum ClickKind { CLICK_NONE, CLICK_HOME, CLICK_DESKTOP, CLICK_RECURSIVE, CLICK_ENTRY, CLICK_HEADER, CLICK_BACK, CLICK_FORWARD };
+
+// What a click landed on; 'row' is the index into ExplorerEntries for CLICK_ENTRY, 'column' the header for CLICK_HEADER
+typedef struct ClickTarget {
+    ClickKind kind;
+    int row;
+    SortKey column;
+} ClickTarget;
+
+// A button in the sidebar: where it is drawn, its icon (mirrored if 'flipped') and what clicking it means
+typedef struct SidebarButton {
+    SDL_Rect rect;
+    IconType icon;
+    ClickKind kind;
+    bool flipped;
+} SidebarButton;
+
+const SidebarButton SidebarButtons[] = {
+    {{8, 7, 40, 40}, ICON_HOME, CLICK_HOME, false},
+    {{8, 67, 40, 40}, ICON_DESKTOP, CLICK_DESKTOP, false},
+    {{8, 127, 40, 40}, ICON_RECURSIVE, CLICK_RECURSIVE, false},
+    {{8, 187, 40, 40}, ICON_BACK, CLICK_BACK, false},
+    {{8, 247, 40, 40}, ICON_BACK, CLICK_FORWARD, true}
+};
+const int SidebarButtonCount = sizeof(SidebarButtons) / sizeof(SidebarButtons[0]);
+
+// Fixed layout of a row of the entry list, relative to the row's top-left corner; the name's width is per entry
+typedef struct RowLayout {
+    SDL_Rect icon;
+    SDL_Point name;
+    SDL_Point size;
+    SDL_Point permissions;
+} RowLayout;
+
+const RowLayout EntryRow = {{75, 5, 35, 35}, {135, 5}, {475, 5}, {620, 5}};
+
+// A column header above the entry list; clicking it sorts by that column
+typedef struct ColumnHeader {
+    const char* label;
+    SDL_Rect rect;
+    SortKey key;
+} ColumnHeader;
+
+const ColumnHeader ColumnHeaders[] = {
+    {"TYPE", {70, 0, 60, 62}, SORT_TYPE},
+    {"NAME", {130, 0, 340, 62}, SORT_NAME},
+    {"SIZE", {470, 0, 145, 62}, SORT_SIZE},
+    {"PERMISSIONS", {615, 0, 170, 62}, SORT_PERMISSIONS}
+};
+const int ColumnHeaderCount = sizeof(ColumnHeaders) / sizeof(ColumnHeaders[0]);
+
+// Entries of the directory being viewed, stored in the order the scanner published them (so metadata updates are
+// addressed by store index); reset in bulk on every navigation
+EntryStore ExplorerStore;
+// Indices into ExplorerStore in the order they are shown
+std::vector<uint32_t> ExplorerEntries;
+// Order ExplorerEntries is shown in; the scanner itself publishes in ascending name order
+SortOrder ExplorerSort = {SORT_NAME, true};
+// Scroll state of the list ExplorerEntries is drawn into (below the headers, left of the scroll bar)
+ListView EntryList({65, 62, 720, 538}, {785, 0, 15, 600}, 45);
+// Reads directories in the background; created in main() once SDL can hand out an event type
+DirectoryScanner* Scanner = NULL;
+// Tree of everything below the directory shown in the recursive view
+TreeModel RecursiveModel;
+// Scroll state of the recursive view's rows (below the directory name)
+ListView RecursiveList({65, 35, 720, 565}, {785, 0, 15, 600}, 25);
+// Walks the tree for the recursive view (and the search) in the background
+TreeWalker* Walker = NULL;
+// Directory RecursiveModel holds the tree of (empty while no walk is running or complete)
+std::string WalkedDir;
+// Set once the last listing of the walk has been added to RecursiveModel; changes to the tree wait for it
+bool WalkFinished = false;
+// Trigram index of the names in RecursiveModel, extended as listings arrive
+SearchIndex RecursiveIndex;
+// Text typed into the search; while it isn't empty the entry list shows SearchResults instead of ExplorerEntries
+std::string SearchQuery;
+// Nodes of RecursiveModel whose name contains SearchQuery, in the order the walk found them
+std::vector<uint32_t> SearchResults;
+// Indices into SearchStore of the result rows drawn so far (NO_ENTRY until a row is first drawn)
+std::vector<uint32_t> SearchEntries;
+EntryStore SearchStore;
+// Set by Ctrl+F: the search looks for SearchQuery inside the files below the directory instead of in their names,
+// and ContentMatches takes the place of SearchResults
+bool ContentMode = false;
+std::vector<ContentMatch> ContentMatches;
+// Searches file contents in the background
+ContentSearcher* Contents = NULL;
+// Timer that starts the content search for the query typed so far (0 while none is pending), the event it pushes,
+// and the number of the latest one armed (events of earlier timers are ignored)
+SDL_TimerID ContentSearchTimer = 0;
+Uint32 ContentSearchEvent = 0;
+int ContentSearchSerial = 0;
+// Finds files with identical contents below a directory for the duplicates view (Ctrl+D); its hashes are kept for the session
+DuplicateFinder* Duplicates = NULL;
+// Directory the duplicates view is about, and the groups its last run found
+std::string DuplicatesDir;
+std::vector<DuplicateGroup> DuplicateGroups;
+// Rows of the duplicates view: (group, -1) heads a group, (group, i) is the group's i-th file
+std::vector<std::pair<int, int> > DuplicateRows;
+// Scroll state of the duplicates view's rows (below its header)
+ListView DuplicateList({65, 35, 720, 565}, {785, 0, 15, 600}, 25);
+#define NO_ENTRY 0xFFFFFFFFu
+// An entry shown on a row of the entry list, from ExplorerStore or SearchStore
+typedef struct RowEntry {
+    EntryStore* store;
+    uint32_t index;
+} RowEntry;
+// Reads the directories on screen ahead of a click, within this much memory
+#define PREFETCH_BUDGET (32 * 1024 * 1024)
+Prefetcher* Prefetch = NULL;
+// Directories visited most recently (newest last), which the prefetcher favours
+std::deque<std::string> RecentDirs;
+#define RECENT_DIRS 16
+// Row of the entry list under the mouse (-1 if none)
+int HoveredRow = -1;
+// Set once the scanner has published every entry of the current directory; prefetching waits for it
+bool ExplorerScanFinished = false;
+// Adds up the sizes of the directories in the entry list in the background, caching what it listed within this much memory
+#define DIRSIZES_BUDGET (32 * 1024 * 1024)
+DirSizer* DirSizes = NULL;
+// The view of a directory as it was left: its entries (with their metadata, types and measured names), sort and scroll
+typedef struct ViewSnapshot {
+    // Modification time of the directory when it was listed; the snapshot is only shown again while it still matches
+    int64_t mtime;
+    EntryStore store;
+    std::vector<uint32_t> entries;
+    SortOrder sort;
+    int scroll_offset;
+} ViewSnapshot;
+
+// A step of the back/forward history; only the steps nearest the current one keep a snapshot
+typedef struct HistoryStep {
+    std::string dir;
+    std::unique_ptr<ViewSnapshot> snapshot;
+} HistoryStep;
+
+// Directories visited, oldest first; History[HistoryPos] is the one shown and the steps after it can be gone forward to
+std::deque<HistoryStep> History;
+int HistoryPos = -1;
+#define HISTORY_LENGTH 64
+#define HISTORY_SNAPSHOTS 8
+// Modification time of the current directory when its listing started (-1 until it is listed, or if it couldn't be read)
+int64_t ExplorerMtime = -1;
+// Keeps the current directory and the expanded directories of the recursive view up to date
+DirWatcher* Watches = NULL;
+// Directories of the recursive view being watched: the root of the walk and every directory expanded since
+std::set<std::string> WatchedTreeDirs;
+// Changes that arrived while their directory was still being scanned or walked; they are applied once it is done
+std::vector<DirChanges> HeldChanges;
+// Opens files without waiting for the opener to exit
+Launcher* FileLauncher = NULL;
+// Copies, moves, deletes and creates files in the background; the watcher brings the results into the list
+FileOperations* FileOps = NULL;
+// Paths taken with Ctrl+C (or Ctrl+X, which makes the next paste a move) for Ctrl+V to put into the directory shown
+std::vector<std::string> Clipboard;
+bool ClipboardCut = false;
+// Thumbnails of images, kept on disk between sessions
+ThumbnailCache Thumbnails;
+// Decodes the thumbnails missing from Thumbnails in the background
+ThumbnailLoader* ThumbnailDecoder = NULL;
+// Frame time and entry throughput, shown by the overlay toggled with F3
+FrameStats Frames;
+bool ShowOverlay = false;
+// Where F12 writes the trace of a profiling build
+#define TRACE_FILE "fileexplorer-trace.json"
 
 // The user's name
 std::string user;
@@ -45,11 +231,36 @@ std::string home;
 void initialize(SDL_Renderer *renderer, AppData *data_ptr);
 void render(SDL_Renderer *renderer, AppData *data_ptr);
 bool renderRecursiveView(SDL_Renderer* renderer, AppData* data_ptr, std::string dirname);
-void buildRecursiveEntries(std::string dirname, int indent);
-std::string getDirectoryEntries(std::string dirname, SDL_Renderer* renderer, TTF_Font* font);
-std::string parseMouseClick(int mouse_click_x, int mouse_click_y);
-std::string getFilePermissions(struct stat info);
-bool filenameCompare (std::string file1, std::string file2); 
+void renderDuplicateView(SDL_Renderer* renderer, AppData* data_ptr);
+void findDuplicates(const std::string& dirname);
+bool receiveDuplicates();
+void buildRecursiveEntries(std::string dirname);
+bool receiveRecursiveEntries();
+bool receiveContentMatches();
+void startContentSearch(const std::string& dirname);
+void stopContentSearch();
+void updateSearch(const std::string& query, const std::string& dirname);
+RowEntry shownEntry(int row);
+std::string searchLocation(const EntryStore& store, uint32_t entry);
+std::string getDirectoryEntries(std::string dirname);
+std::string navigateHistory(int delta, const std::string& current_dir);
+void leaveDirectory();
+void loadDirectory(const std::string& dirname, std::unique_ptr<ViewSnapshot> snapshot);
+bool receiveDirectoryEntries();
+bool receiveDirectorySizes();
+bool receiveDirectoryChanges();
+bool applyExplorerChanges(const DirChanges& changes);
+bool applyTreeChanges(const DirChanges& changes);
+void watchTreeDirectory(uint32_t node);
+void stopWalk();
+void dropRemovedResults();
+void updatePrefetch();
+void sortExplorerEntries(SortKey key);
+void drawOverlay(SDL_Renderer* renderer, AppData* data_ptr);
+void drawOperationStatus(SDL_Renderer* renderer, AppData* data_ptr);
+std::vector<std::string> selectedPaths();
+void reportFileOperation(const FileOpResult& result);
+ClickTarget parseMouseClick(int mouse_click_x, int mouse_click_y, bool recursive, TextRenderer* text);
 
 /*************************/
 /***** MAIN FUNCTION *****/
@@ -57,9 +268,9 @@ bool filenameCompare (std::string file1, std::string file2);
 int main(int argc, char **argv)
 {
     // Initializing SDL as Video
-    SDL_Init(SDL_INIT_VIDEO);
-    // Initialize PNG IMG library
-    IMG_Init(IMG_INIT_PNG);
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+    // Initialize the IMG library for PNG (icons) and JPEG (thumbnails); other formats are loaded on demand
+    IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG);
     // Initialize TTF library
     TTF_Init();
 
@@ -69,6 +280,31 @@ int main(int argc, char **argv)
     SDL_Window *window;
     // Create the window and renderer
     SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, 0, &window, &renderer);
+    // Typing anywhere in the list searches the tree below the current directory
+    SDL_StartTextInput();
+
+    // The scanner thread wakes the event loop with this event whenever it has new entries
+    Uint32 scanner_event = SDL_RegisterEvents(1);
+    Scanner = new DirectoryScanner(scanner_event);
+    Uint32 walker_event = SDL_RegisterEvents(1);
+    Walker = new TreeWalker(walker_event);
+    Uint32 dirsizes_event = SDL_RegisterEvents(1);
+    DirSizes = new DirSizer(dirsizes_event, DIRSIZES_BUDGET);
+    Prefetch = new Prefetcher(PREFETCH_BUDGET);
+    Uint32 watcher_event = SDL_RegisterEvents(1);
+    Watches = new DirWatcher(watcher_event);
+    Uint32 launcher_event = SDL_RegisterEvents(1);
+    FileLauncher = new Launcher(launcher_event);
+    Uint32 fileops_event = SDL_RegisterEvents(1);
+    FileOps = new FileOperations(fileops_event);
+    Uint32 contents_event = SDL_RegisterEvents(1);
+    Contents = new ContentSearcher(contents_event);
+    ContentSearchEvent = SDL_RegisterEvents(1);
+    Uint32 duplicates_event = SDL_RegisterEvents(1);
+    Duplicates = new DuplicateFinder(duplicates_event);
+    Thumbnails.open(ThumbnailCache::defaultPath());
+    Uint32 thumbnail_event = SDL_RegisterEvents(1);
+    ThumbnailDecoder = new ThumbnailLoader(thumbnail_event, &Thumbnails);
 
     // Declare a new AppData
     AppData data;
@@ -78,76 +314,329 @@ int main(int argc, char **argv)
     // Stores the directory currently being viewed
     std::string current_dir;
     // Call getDirectoryEntries for the user's home directory for startup
-    current_dir = getDirectoryEntries(home, renderer, data.font);
-
-    // Start the rendering loop by calling render()
-    render(renderer, &data);
-    SDL_Event event;
-    SDL_WaitEvent(&event);
+    current_dir = getDirectoryEntries(home);
 
     // Tracks whether recursive viewing mode is enabled or not
     bool recursive_flag = false;
-    // While the user hasn't quit the program, continue rendering and interpreting events
-    while (event.type != SDL_QUIT) 
-    {   
-        // If there was a left click by the user, analyze it by looking at its coordinates 
-        if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT) {
-            int mouse_click_x = event.button.x;
-            int mouse_click_y = event.button.y;
-            
-            // Contains a string representation of the UI element clicked on by the user
-            std::string next_element = parseMouseClick(mouse_click_x, mouse_click_y);
-            // Indicated by a comma, a next element type substring is embedded in the next_element string
-            std::string next_element_type = next_element.substr(next_element.find(',') + 1, std::string::npos);
-
-            // Once next element type has been extracted, delete the substring from next_element
-            int delimiter_loc = next_element.find(',');
-            if(delimiter_loc != -1) { next_element.erase(delimiter_loc, std::string::npos); }
-
-            // Parse the various types of next_element
-            if(next_element == "NULL") {
-                // If NULL, do nothing for this click
-            } else if(next_element == "R") {
-                // If "R", toggle recursive viewing mode either on or off depending on recursive_flag's value 
-                recursive_flag = !recursive_flag;
-                // If the flag is being enabled, build the recursive entries vector in the current directory
-                if(recursive_flag) { buildRecursiveEntries(current_dir, 0); }
-            } else if(next_element_type == "" || next_element_type == "dir" || next_element_type == "HOME" || next_element_type == "DESKTOP") {
-                // Clear any previous ExplorerEntries
-                ExplorerEntries.clear();
-                // Save the current directory from the returned value from getDirectoryEntries
-                current_dir = getDirectoryEntries(next_element, renderer, data.font);
+    // Set while the duplicates view is shown (over either of the other two)
+    bool duplicates_flag = false;
+    // The list that scrolling applies to (the recursive or duplicates view's rows while it is shown)
+    ListView* active_list = &EntryList;
+    // Set whenever something visible changed; a frame is only drawn when it is set
+    bool redraw = true;
+    bool quit = false;
+    SDL_Event event;
+
+    // While the user hasn't quit the program, wait for events and only render when they changed something
+    while(!quit)
+    {
+        // Draw the frame if the last batch of events changed anything, then sleep until the next event
+        if(redraw) {
+            Frames.beginFrame();
+            // The duplicates view covers the others; otherwise the recursive flag decides between the file explorer and recursive view
+            if(duplicates_flag) {
+                renderDuplicateView(renderer, &data);
+            } else if(recursive_flag) {
+                renderRecursiveView(renderer, &data, current_dir);
             } else {
-                // Otherwise, the selection was made on a file, so open it using fork() and xdg-open
-                int pid = fork();
-                std::string open_file_cmd = "xdg-open " + next_element;
-
-                if(pid == -1){
-                    //fork error
-                    std::cout << "Fork Error\n";
-                } else if(pid > 0) {
-                    //parent waits for child
-                    int status;
-                    waitpid(pid, &status, 0);
-                } else if (pid == 0) {
-                    system(open_file_cmd.c_str());
-                    exit(1);
-                }
+                render(renderer, &data);
             }
+            Frames.endFrame();
+            redraw = false;
         }
-        // Wait for another event
         SDL_WaitEvent(&event);
-        // Recursive flag indicates whether to render the normal file explorer view or recursive view
-        if(recursive_flag) {
-            renderRecursiveView(renderer, &data, current_dir);
-        } else {
-            RecursiveEntries.clear();
-            render(renderer, &data); 
-        } 
-        
+
+        // Handle everything that is queued before drawing, so a burst of events produces a single frame
+        do {
+            if(event.type == SDL_QUIT) {
+                quit = true;
+            }
+            // The window was uncovered, resized or restored and its contents must be redrawn
+            else if(event.type == SDL_WINDOWEVENT) {
+                if(event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED ||
+                   event.window.event == SDL_WINDOWEVENT_RESTORED) {
+                    redraw = true;
+                }
+            }
+            // The scanner published more entries of the current directory
+            else if(event.type == scanner_event) {
+                redraw |= receiveDirectoryEntries() && !recursive_flag;
+                // Changes held back until the scan finished
+                if(!HeldChanges.empty()) { redraw |= receiveDirectoryChanges(); }
+            }
+            // The walker listed more directories for the recursive view or the search
+            else if(event.type == walker_event) {
+                redraw |= receiveRecursiveEntries() && (recursive_flag || !SearchQuery.empty());
+                if(!HeldChanges.empty()) { redraw |= receiveDirectoryChanges(); }
+            }
+            // The content search found more matching lines, or finished
+            else if(event.type == contents_event) {
+                redraw |= receiveContentMatches() && !recursive_flag;
+            }
+            // Typing paused long enough to search the contents for what was typed
+            else if(event.type == ContentSearchEvent) {
+                if(event.user.code == ContentSearchSerial) {
+                    startContentSearch(current_dir);
+                    redraw |= !recursive_flag;
+                }
+            }
+            // The duplicate finder got further (the header shows its counters) or finished
+            else if(event.type == duplicates_event) {
+                redraw |= receiveDuplicates() && duplicates_flag;
+            }
+            // Files were added, removed or changed in a watched directory
+            else if(event.type == watcher_event) {
+                redraw |= receiveDirectoryChanges();
+            }
+            // Totals of directories in the list are known; each shows up as soon as its own tree is done
+            else if(event.type == dirsizes_event) {
+                redraw |= receiveDirectorySizes() && !recursive_flag;
+            }
+            // Thumbnails were decoded into the cache; rows showing a placeholder pick them up on the next frame
+            else if(event.type == thumbnail_event) {
+                ThumbnailDecoder->acknowledge();
+                redraw |= !recursive_flag;
+            }
+            // An opener exited; only a failure is reported (nothing on screen changes). How long spawning took is in the trace
+            else if(event.type == launcher_event) {
+                std::vector<LaunchResult> results;
+                FileLauncher->takeResults(&results);
+                for(int i = 0; i < results.size(); i++) {
+                    if(results[i].status != 0) {
+                        fprintf(stderr, "Error: the opener of '%s' exited with status %d\n", results[i].path.c_str(), results[i].status);
+                    }
+                }
+            }
+            // A file operation made progress or finished (the entries it changed arrive through the watcher)
+            else if(event.type == fileops_event) {
+                std::vector<FileOpResult> results;
+                FileOps->takeResults(&results);
+                for(int i = 0; i < results.size(); i++) { reportFileOperation(results[i]); }
+                redraw = true;
+            }
+            // Scroll the list on screen with the mouse wheel (three rows per notch), the keyboard or the scroll bar
+            else if(event.type == SDL_MOUSEWHEEL) {
+                redraw |= active_list->scrollBy(-event.wheel.y * active_list->rowHeight() * 3);
+            } else if(event.type == SDL_MOUSEMOTION) {
+                // Plain mouse motion changes nothing on screen, but the directory under it is the likeliest next click
+                if(active_list->isDragging()) { redraw |= active_list->dragScrollBar(event.motion.y); }
+                int hovered = (!recursive_flag && event.motion.x >= EntryList.area()->x) ? EntryList.rowAt(event.motion.y) : -1;
+                if(hovered != HoveredRow) {
+                    HoveredRow = hovered;
+                    updatePrefetch();
+                }
+            } else if(event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_LEFT) {
+                active_list->releaseScrollBar();
+            } else if(event.type == SDL_KEYDOWN) {
+                if(event.key.keysym.sym == SDLK_PAGEUP) { redraw |= active_list->scrollBy(-active_list->area()->h); }
+                else if(event.key.keysym.sym == SDLK_PAGEDOWN) { redraw |= active_list->scrollBy(active_list->area()->h); }
+                else if(event.key.keysym.sym == SDLK_HOME) { redraw |= active_list->scrollToTop(); }
+                else if(event.key.keysym.sym == SDLK_END) { redraw |= active_list->scrollTo(active_list->rowCount() * active_list->rowHeight()); }
+                // Ctrl+D shows the duplicate files below the directory; Ctrl+D or Escape goes back to the view it was opened over
+                else if(event.key.keysym.sym == SDLK_d && (event.key.keysym.mod & KMOD_CTRL) && !duplicates_flag) {
+                    duplicates_flag = true;
+                    findDuplicates(current_dir);
+                    active_list = &DuplicateList;
+                    redraw = true;
+                } else if(duplicates_flag && (event.key.keysym.sym == SDLK_ESCAPE ||
+                                              (event.key.keysym.sym == SDLK_d && (event.key.keysym.mod & KMOD_CTRL)))) {
+                    duplicates_flag = false;
+                    Duplicates->cancel();
+                    active_list = recursive_flag ? &RecursiveList : &EntryList;
+                    redraw = true;
+                }
+                // The duplicates view only scrolls; the keys below act on the views it covers
+                else if(duplicates_flag) {}
+                // Backspace shortens the search (by one character, not one byte); Escape ends it, and a second one
+                // goes back from searching contents to searching names
+                else if(event.key.keysym.sym == SDLK_BACKSPACE && !recursive_flag && !SearchQuery.empty()) {
+                    size_t end = SearchQuery.size() - 1;
+                    while(end > 0 && (SearchQuery[end] & 0xC0) == 0x80) { end--; }
+                    updateSearch(SearchQuery.substr(0, end), current_dir);
+                    redraw = true;
+                } else if(event.key.keysym.sym == SDLK_ESCAPE && !recursive_flag && !SearchQuery.empty()) {
+                    updateSearch("", current_dir);
+                    redraw = true;
+                } else if(event.key.keysym.sym == SDLK_ESCAPE && !recursive_flag && ContentMode) {
+                    ContentMode = false;
+                    redraw = true;
+                }
+                // Enter starts the content search right away instead of when typing pauses
+                else if(event.key.keysym.sym == SDLK_RETURN && !recursive_flag && ContentMode) {
+                    startContentSearch(current_dir);
+                    redraw = true;
+                }
+                // Ctrl+F switches between searching names and searching contents, and searches again for what was typed
+                else if(event.key.keysym.sym == SDLK_f && (event.key.keysym.mod & KMOD_CTRL) && !recursive_flag) {
+                    std::string query = SearchQuery;
+                    updateSearch("", current_dir);
+                    ContentMode = !ContentMode;
+                    updateSearch(query, current_dir);
+                    redraw = true;
+                }
+                // Otherwise Escape cancels the file operations (undoing the half-done one), or else clears the selection
+                else if(event.key.keysym.sym == SDLK_ESCAPE && FileOps->busy()) {
+                    FileOps->cancel();
+                    redraw = true;
+                } else if(event.key.keysym.sym == SDLK_ESCAPE && !recursive_flag) {
+                    for(int i = 0; i < ExplorerEntries.size(); i++) { ExplorerStore.setSelected(ExplorerEntries[i], false); }
+                    redraw = true;
+                }
+                // Ctrl+A selects every entry; Ctrl+C and Ctrl+X take the selection, Ctrl+V copies or moves it into the directory shown
+                else if(event.key.keysym.sym == SDLK_a && (event.key.keysym.mod & KMOD_CTRL) && !recursive_flag && SearchQuery.empty()) {
+                    for(int i = 0; i < ExplorerEntries.size(); i++) { ExplorerStore.setSelected(ExplorerEntries[i], true); }
+                    redraw = true;
+                } else if((event.key.keysym.sym == SDLK_c || event.key.keysym.sym == SDLK_x) && (event.key.keysym.mod & KMOD_CTRL) &&
+                          !recursive_flag && SearchQuery.empty()) {
+                    std::vector<std::string> selected = selectedPaths();
+                    if(!selected.empty()) {
+                        Clipboard.swap(selected);
+                        ClipboardCut = event.key.keysym.sym == SDLK_x;
+                    }
+                } else if(event.key.keysym.sym == SDLK_v && (event.key.keysym.mod & KMOD_CTRL) && !recursive_flag && SearchQuery.empty() &&
+                          !Clipboard.empty()) {
+                    FileOperation operation;
+                    operation.kind = ClipboardCut ? FILEOP_MOVE : FILEOP_COPY;
+                    operation.sources = Clipboard;
+                    operation.target = current_dir;
+                    FileOps->queue(operation);
+                    // What was cut is moved once; what was copied can be pasted again
+                    if(ClipboardCut) { Clipboard.clear(); }
+                }
+                // Shift+Delete deletes the selection for good (there is no trash)
+                else if(event.key.keysym.sym == SDLK_DELETE && (event.key.keysym.mod & KMOD_SHIFT) && !recursive_flag && SearchQuery.empty()) {
+                    FileOperation operation;
+                    operation.kind = FILEOP_DELETE;
+                    operation.sources = selectedPaths();
+                    if(!operation.sources.empty()) { FileOps->queue(operation); }
+                }
+                // Ctrl+Shift+N creates a directory in the one shown
+                else if(event.key.keysym.sym == SDLK_n && (event.key.keysym.mod & KMOD_CTRL) && (event.key.keysym.mod & KMOD_SHIFT) &&
+                        !recursive_flag) {
+                    FileOperation operation;
+                    operation.kind = FILEOP_MKDIR;
+                    operation.target = current_dir;
+                    operation.name = "New Folder";
+                    FileOps->queue(operation);
+                }
+                // Alt+Left and Alt+Right go back and forward
+                else if(event.key.keysym.sym == SDLK_LEFT && (event.key.keysym.mod & KMOD_ALT)) {
+                    current_dir = navigateHistory(-1, current_dir);
+                    redraw = true;
+                } else if(event.key.keysym.sym == SDLK_RIGHT && (event.key.keysym.mod & KMOD_ALT)) {
+                    current_dir = navigateHistory(1, current_dir);
+                    redraw = true;
+                }
+                // F3 shows or hides the performance overlay
+                else if(event.key.keysym.sym == SDLK_F3) {
+                    ShowOverlay = !ShowOverlay;
+                    redraw = true;
+                }
+                // F12 writes the events recorded by the profiling timers as a Chrome trace
+                else if(event.key.keysym.sym == SDLK_F12) {
+                    if(!profilerEnabled()) {
+                        printf("Tracing is not available: build with 'make PROFILE=1'\n");
+                    } else {
+                        long events = profilerExport(TRACE_FILE);
+                        if(events >= 0) { printf("Wrote %ld trace events to %s\n", events, TRACE_FILE); }
+                    }
+                }
+            }
+            // Typed text extends the search
+            else if(event.type == SDL_TEXTINPUT && !recursive_flag && !duplicates_flag) {
+                updateSearch(SearchQuery + event.text.text, current_dir);
+                redraw = true;
+            }
+            // The mouse's back and forward buttons
+            else if(event.type == SDL_MOUSEBUTTONDOWN && (event.button.button == SDL_BUTTON_X1 || event.button.button == SDL_BUTTON_X2) &&
+                    !duplicates_flag) {
+                current_dir = navigateHistory(event.button.button == SDL_BUTTON_X1 ? -1 : 1, current_dir);
+                redraw = true;
+            }
+            // Presses on the scroll bar only scroll the list
+            else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT &&
+                    active_list->pressScrollBar(event.button.x, event.button.y)) {
+                redraw = true;
+            }
+            // Clicking a file in the duplicates view opens it; nothing else there reacts to clicks
+            else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT && duplicates_flag) {
+                int row = DuplicateList.rowAt(event.button.y);
+                if(event.button.x >= DuplicateList.area()->x && row >= 0 && row < DuplicateRows.size() && DuplicateRows[row].second >= 0) {
+                    FileLauncher->open(DuplicateGroups[DuplicateRows[row].first].paths[DuplicateRows[row].second]);
+                }
+            }
+            // Clicking a directory in the recursive view expands or collapses it
+            else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT &&
+                    recursive_flag && event.button.x >= RecursiveList.area()->x && RecursiveList.rowAt(event.button.y) >= 0) {
+                int row = RecursiveList.rowAt(event.button.y);
+                if(RecursiveModel.toggle(row)) {
+                    watchTreeDirectory(RecursiveModel.rowNode(row));
+                    RecursiveList.setRowCount(RecursiveModel.rowCount());
+                    redraw = true;
+                }
+            }
+            // If there was a left click by the user, analyze it by looking at its coordinates
+            else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT) {
+                // The UI element clicked on by the user
+                ClickTarget target = parseMouseClick(event.button.x, event.button.y, recursive_flag, &data.text);
+                RowEntry clicked = target.kind == CLICK_ENTRY ? shownEntry(target.row) : RowEntry{NULL, NO_ENTRY};
+
+                if(target.kind == CLICK_HEADER) {
+                    // Re-sort the loaded entries; the directory is not read again
+                    sortExplorerEntries(target.column);
+                    redraw = true;
+                } else if(target.kind == CLICK_RECURSIVE) {
+                    // Toggle recursive viewing mode either on or off depending on recursive_flag's value 
+                    recursive_flag = !recursive_flag;
+                    // If the flag is being enabled, walk the current directory (unless the search already is); otherwise stop
+                    // the walk, unless the search still needs it
+                    if(recursive_flag) {
+                        if(WalkedDir != current_dir) { buildRecursiveEntries(current_dir); }
+                    } else if(SearchQuery.empty()) {
+                        stopWalk();
+                    }
+                    active_list = recursive_flag ? &RecursiveList : &EntryList;
+                    redraw = true;
+                } else if(target.kind == CLICK_HOME || target.kind == CLICK_DESKTOP) {
+                    // Save the current directory from the returned value from getDirectoryEntries (this also cancels a scan in flight)
+                    current_dir = getDirectoryEntries(target.kind == CLICK_HOME ? home : home + "/Desktop/");
+                    redraw = true;
+                } else if(target.kind == CLICK_BACK || target.kind == CLICK_FORWARD) {
+                    current_dir = navigateHistory(target.kind == CLICK_BACK ? -1 : 1, current_dir);
+                    redraw = true;
+                } else if(target.kind == CLICK_ENTRY && (SDL_GetModState() & KMOD_CTRL) && SearchQuery.empty()) {
+                    // Ctrl+click selects or deselects the entry instead of opening it
+                    ExplorerStore.setSelected(clicked.index, !ExplorerStore.isSelected(clicked.index));
+                    redraw = true;
+                } else if(target.kind == CLICK_ENTRY && clicked.store->type(clicked.index) == ENTRY_DIR) {
+                    current_dir = getDirectoryEntries(clicked.store->path(clicked.index));
+                    redraw = true;
+                } else if(target.kind == CLICK_ENTRY) {
+                    // Otherwise, the selection was made on a file, so open it with xdg-open; the UI keeps running meanwhile
+                    FileLauncher->open(clicked.store->path(clicked.index));
+                }
+            }
+        } while(!quit && SDL_PollEvent(&event));
     }
 
-    // Clean up
+    // Stop the scanner before SDL goes away (it pushes events)
+    delete Scanner;
+    delete Walker;
+    delete DirSizes;
+    delete Contents;
+    delete Duplicates;
+    delete Prefetch;
+    delete Watches;
+    delete FileLauncher;
+    // Cancelling cleans up the operation in progress before the process exits
+    delete FileOps;
+    delete ThumbnailDecoder;
+
+    // Clean up (textures first, they belong to the renderer)
+    data.text.unload();
+    data.recursive_text.unload();
+    data.icons.unload();
+    data.thumbnails.unload();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -163,107 +652,145 @@ void initialize(SDL_Renderer* renderer, AppData* data_ptr)
     home = getenv("HOME");
     // set color of background when erasing frame
     SDL_SetRenderDrawColor(renderer, 235, 235, 235, 255);
-    // set the font
-    data_ptr->font = TTF_OpenFont("resrc/OpenSans-Regular.ttf", 20);
-    data_ptr->recursive_font = TTF_OpenFont("resrc/OpenSans-Regular.ttf", 15);
-
-    // Create and store constant icon textures in AppData
-    SDL_Surface *surf = IMG_Load("resrc/images/home_icon.png");
-    data_ptr->home = SDL_CreateTextureFromSurface(renderer, surf);
-    surf = IMG_Load("resrc/images/desktop_icon.png");
-    data_ptr->desktop = SDL_CreateTextureFromSurface(renderer, surf);
-    surf = IMG_Load("resrc/images/recursive_icon.png");
-    data_ptr->recursiveview = SDL_CreateTextureFromSurface(renderer, surf);
-    
-    // Create and store header textures in AppData
-    SDL_Color header_color = {0, 0, 0}; 
-    surf = TTF_RenderText_Solid(data_ptr->font, "NAME", header_color);
-    data_ptr->filename_header = SDL_CreateTextureFromSurface(renderer, surf);
-    surf = TTF_RenderText_Solid(data_ptr->font, "SIZE", header_color);
-    data_ptr->size_header = SDL_CreateTextureFromSurface(renderer, surf);
-    surf = TTF_RenderText_Solid(data_ptr->font, "PERMISSIONS", header_color);
-    data_ptr->permissions_header = SDL_CreateTextureFromSurface(renderer, surf);
-
-    SDL_FreeSurface(surf);
+    // set the fonts (each size gets its own glyph atlas)
+    data_ptr->text.load(renderer, "resrc/OpenSans-Regular.ttf", 20);
+    data_ptr->recursive_text.load(renderer, "resrc/OpenSans-Regular.ttf", 15);
+
+    // Decode every icon once into the shared atlas
+    data_ptr->icons.load(renderer);
+    data_ptr->thumbnails.load(renderer);
 }
 
 /* Uses AppData to render objects and phrases to the window */
 void render(SDL_Renderer* renderer, AppData* data_ptr)
 {
+    PROFILE_SCOPE("render");
     // Reset render color to gray
     SDL_SetRenderDrawColor(renderer, 235, 235, 235, 255);
     // Erase renderer content from the previous rendering
     SDL_RenderClear(renderer);
 
-    // Render the constant name header
-    SDL_Rect name_header = {135, 7};
-    SDL_QueryTexture(data_ptr->filename_header, NULL, NULL, &(name_header.w), &(name_header.h));
-    SDL_RenderCopy(renderer, data_ptr->filename_header, NULL, &name_header);
-
-    // Render the constant size header
-    SDL_Rect size_header = {475, 7};
-    SDL_QueryTexture(data_ptr->size_header, NULL, NULL, &(size_header.w), &(size_header.h));
-    SDL_RenderCopy(renderer, data_ptr->size_header, NULL, &size_header);
-
-    // Render the constant permissions header
-    SDL_Rect permissions_header = {620, 7};
-    SDL_QueryTexture(data_ptr->permissions_header, NULL, NULL, &(permissions_header.w), &(permissions_header.h));
-    SDL_RenderCopy(renderer, data_ptr->permissions_header, NULL, &permissions_header);
-    
-    // [NOT IMPLEMENTED] Draw the scroll bar across the right side of the window and color it purple
-    // SDL_Rect scroll_bar_container = {785, 0, 20, 600}; 
-    // SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
-    // SDL_RenderFillRect(renderer, &scroll_bar_container);
-
-    // [NOT IMPLEMENTED] Draw the upper window header across the top of the window and color it purple
-    // SDL_Rect scroll_bar = {785, 0, 20, 100}; 
-    // SDL_SetRenderDrawColor(renderer, 152, 153, 155, 255);
-    // SDL_RenderFillRect(renderer, &scroll_bar);
+    // While searching, the header shows the query and the number of matches instead of the columns
+    SDL_Color text_color = {0, 0, 0, 255};
+    bool searching = !SearchQuery.empty();
+    if(searching || ContentMode) {
+        std::string matches = std::to_string(SearchResults.size()) + (Walker->running() ? " matches so far" : " matches");
+        if(ContentMode) {
+            // Content matches count lines; how much was read shows how far the search has got
+            ContentSearchStats searched = Contents->stats();
+            matches = std::to_string(ContentMatches.size()) + " lines in " + formatSize(searched.bytes) +
+                      (searched.running ? " so far" : searched.truncated ? " (stopped)" : "");
+        }
+        std::string label = (ContentMode ? "Contents: " : "Search: ") + SearchQuery;
+        int width = data_ptr->text.drawText(label, ColumnHeaders[0].rect.x + 5, 7, text_color);
+        SDL_Color count_color = {90, 90, 90, 255};
+        // No count until the content search has started
+        if(searching && !(ContentMode && ContentSearchTimer != 0)) {
+            data_ptr->text.drawText(matches, std::max(ColumnHeaders[2].rect.x + 5, ColumnHeaders[0].rect.x + 25 + width), 7, count_color);
+        }
+    }
+    // Queue the column headers, with a small triangle under the one the list is sorted by (pointing up when ascending)
+    for(int i = 0; i < ColumnHeaderCount && !searching && !ContentMode; i++) {
+        int x = ColumnHeaders[i].rect.x + 5;
+        int width = data_ptr->text.drawText(ColumnHeaders[i].label, x, 7, text_color);
+        if(ColumnHeaders[i].key == ExplorerSort.key) {
+            SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
+            int center = x + width / 2;
+            for(int line = 0; line < 5; line++) {
+                int y = ExplorerSort.ascending ? 40 + line : 44 - line;
+                SDL_RenderDrawLine(renderer, center - line, y, center + line, y);
+            }
+        }
+    }
+
+    // Draw the scroll bar across the right side of the window
+    EntryList.drawScrollBar(renderer);
+
+    // Ask the scanner for the size and permissions of the rows on screen, plus a screenful either side for scrolling
+    // (search results come from the walk, which doesn't fetch them)
+    int page = EntryList.endVisibleRow() - EntryList.firstVisibleRow();
+    int first_wanted = std::max(0, EntryList.firstVisibleRow() - page);
+    int end_wanted = std::min((int)ExplorerEntries.size(), EntryList.endVisibleRow() + page);
+    std::vector<int> wanted;
+    for(int i = first_wanted; i < end_wanted && !searching; i++) {
+        wanted.push_back(ExplorerEntries[i]);
+    }
+    Scanner->requestMetadata(wanted);
+    updatePrefetch();
 
     // Draw a sidebar for separating buttons from file explorer items
     SDL_Rect sidebar1 = {60, 0, 5, 600};
     SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
     SDL_RenderFillRect(renderer, &sidebar1);
 
-    // Render the home, desktop and recursive view icons
-    SDL_Rect home = {8, 7, 40, 40};
-    SDL_RenderCopy(renderer, data_ptr->home, NULL, &home);
-    SDL_Rect desktop = {8, 67, 40, 40}; 
-    SDL_RenderCopy(renderer, data_ptr->desktop, NULL, &desktop);
-    SDL_Rect recursiveview = {8, 127, 40, 40};
-    SDL_RenderCopy(renderer, data_ptr->recursiveview, NULL, &recursiveview);
-
-    // Create containers where the file explorer items will be rendered into
-    SDL_Rect icon_container = {75, 67, 35, 35};
-    SDL_Rect name_container = {135, 67};
-    SDL_Rect size_container = {475, 67};
-    SDL_Rect perms_container = {620, 67};
-
-    // Render each element of the file explorer items stored in ExplorerEntries, increasing the y coordinate by 45 in between renders
-    for(int i = 0; i < ExplorerEntries.size(); i++) {
-        ExplorerEntries[i]->setCoordinates(icon_container.x, icon_container.x + icon_container.w, 
-                                           icon_container.y, icon_container.y + icon_container.h, "icon");
-        SDL_RenderCopy(renderer, ExplorerEntries[i]->data.icon, NULL, &icon_container);
-        icon_container.y += 45;
-
-        SDL_QueryTexture(ExplorerEntries[i]->data.name, NULL, NULL, &(name_container.w), &(name_container.h));
-        ExplorerEntries[i]->setCoordinates(name_container.x, name_container.x + name_container.w, 
-                                           name_container.y, name_container.y + name_container.h, "name");
-        SDL_RenderCopy(renderer, ExplorerEntries[i]->data.name, NULL, &name_container);
-        name_container.y += 45;
-
-        if(ExplorerEntries[i]->entrytype != "dir") {
-            SDL_QueryTexture(ExplorerEntries[i]->data.size, NULL, NULL, &(size_container.w), &(size_container.h));
-            SDL_RenderCopy(renderer, ExplorerEntries[i]->data.size, NULL, &size_container);
+    // Render the home, desktop, recursive view, back and forward icons; back and forward are faded while there is nowhere to go
+    for(int i = 0; i < SidebarButtonCount; i++) {
+        bool unavailable = (SidebarButtons[i].kind == CLICK_BACK && HistoryPos <= 0) ||
+                           (SidebarButtons[i].kind == CLICK_FORWARD && HistoryPos + 1 >= History.size());
+        if(unavailable) { SDL_SetTextureAlphaMod(data_ptr->icons.texture(), 80); }
+        data_ptr->icons.draw(renderer, SidebarButtons[i].icon, &SidebarButtons[i].rect,
+                             SidebarButtons[i].flipped ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
+        if(unavailable) { SDL_SetTextureAlphaMod(data_ptr->icons.texture(), 255); }
+    }
+
+    // Only the rows intersecting the list viewport are drawn; clip so partially scrolled rows don't overlap the headers
+    SDL_RenderSetClipRect(renderer, EntryList.area());
+
+    // Render each element of the visible file explorer items at the fixed offsets of EntryRow
+    data_ptr->thumbnails.beginFrame();
+    for(int i = EntryList.firstVisibleRow(); i < EntryList.endVisibleRow(); i++) {
+        RowEntry shown = shownEntry(i);
+        EntryStore& store = *shown.store;
+        uint32_t entry = shown.index;
+        EntryType type = store.type(entry);
+        int row_y = EntryList.rowTop(i);
+        SDL_Rect icon_container = EntryRow.icon;
+        icon_container.y += row_y;
+        // Selected rows are highlighted behind their contents
+        if(!searching && store.isSelected(entry)) {
+            SDL_Rect highlight = {EntryList.area()->x, row_y, EntryList.area()->w, EntryList.rowHeight()};
+            SDL_SetRenderDrawColor(renderer, 214, 200, 228, 255);
+            SDL_RenderFillRect(renderer, &highlight);
+        }
+        // Images show their thumbnail once it is decoded (which needs the file's size and mtime); the type icon until then
+        const SDL_Rect* thumbnail = NULL;
+        if(type == ENTRY_IMG && store.modified(entry) >= 0) {
+            thumbnail = data_ptr->thumbnails.find(store.path(entry), store.size(entry), store.modified(entry), &Thumbnails, ThumbnailDecoder);
+        }
+        if(thumbnail != NULL) {
+            SDL_Rect fitted = fitThumbnail(icon_container, thumbnail->w, thumbnail->h);
+            SDL_RenderCopy(renderer, data_ptr->thumbnails.texture(), thumbnail, &fitted);
+        } else {
+            data_ptr->icons.draw(renderer, entryIcon(type), &icon_container);
         }
-        size_container.y += 45;
 
-        if(ExplorerEntries[i]->entrytype != "dir") {
-            SDL_QueryTexture(ExplorerEntries[i]->data.permissions, NULL, NULL, &(perms_container.w), &(perms_container.h));
-            SDL_RenderCopy(renderer, ExplorerEntries[i]->data.permissions, NULL, &perms_container);
+        // Text is only queued here; it is drawn in one batch by flush(). Content matches show the line number after the name
+        std::string name = store.name(entry);
+        if(searching && ContentMode) { name += ":" + std::to_string(ContentMatches[i].line); }
+        store.setNameWidth(entry, data_ptr->text.drawText(name, EntryRow.name.x, row_y + EntryRow.name.y, text_color, EntryList.area()));
+
+        // Search results show where they are instead of size and permissions, content matches the matching line
+        if(searching && ContentMode) {
+            SDL_Color line_color = {90, 90, 90, 255};
+            data_ptr->text.drawText(ContentMatches[i].text, EntryRow.size.x, row_y + EntryRow.size.y, line_color, EntryList.area());
+        } else if(searching) {
+            SDL_Color location_color = {90, 90, 90, 255};
+            data_ptr->text.drawText(searchLocation(store, entry), EntryRow.size.x, row_y + EntryRow.size.y, location_color, EntryList.area());
+        } else {
+            // Directories show their total once it has been added up (and no permissions)
+            data_ptr->text.drawText(formatSize(store.size(entry)), EntryRow.size.x, row_y + EntryRow.size.y, text_color, EntryList.area());
+        }
+        if(!searching && type != ENTRY_DIR && store.hasMetadata(entry)) {
+            data_ptr->text.drawText(getFilePermissions((mode_t)store.mode(entry)), EntryRow.permissions.x, row_y + EntryRow.permissions.y,
+                                    text_color, EntryList.area());
         }
-        perms_container.y += 45;
     }
+    SDL_RenderSetClipRect(renderer, NULL);
+
+    // Draw all queued text in a single call
+    data_ptr->text.flush();
+    drawOperationStatus(renderer, data_ptr);
+    drawOverlay(renderer, data_ptr);
 
     // Show rendered frame
     SDL_RenderPresent(renderer);
@@ -271,6 +798,7 @@ void render(SDL_Renderer* renderer, AppData* data_ptr)
 
 /* Render the recursive viewing mode */
 bool renderRecursiveView(SDL_Renderer* renderer, AppData* data_ptr, std::string dirname) {
+    PROFILE_SCOPE("render.recursive");
     // Reset render color to gray
     SDL_SetRenderDrawColor(renderer, 235, 235, 235, 255);
     // Erase renderer content from the previous rendering
@@ -282,275 +810,798 @@ bool renderRecursiveView(SDL_Renderer* renderer, AppData* data_ptr, std::string
     SDL_RenderFillRect(renderer, &sidebar1);
 
     // Render the recursiveView button
-    SDL_Rect recursiveview = {8, 127, 40, 40};
-    SDL_RenderCopy(renderer, data_ptr->recursiveview, NULL, &recursiveview);
-
-    // Create a RecursiveTextures array to hold the textures of the RecursiveEntries
-    std::vector<SDL_Texture*> RecursiveTextures;
-    
-    // Transform the string vector into renderable textures, store them in RecursiveTextures
-    SDL_Color name_color = {0, 0, 0}; 
-    SDL_Surface *surf;
-
-    // Fill the RecursiveTextures array
-    for(int i = 0; i < RecursiveEntries.size(); i++) {
-        surf = TTF_RenderText_Solid(data_ptr->recursive_font, RecursiveEntries[i].c_str(), name_color);
-        RecursiveTextures.push_back(SDL_CreateTextureFromSurface(renderer, surf));
-        // Recursive rendering limit - beyond this value, the program becomes too slow to take in inputs
-        if(i == 100) { break; }
-    }
-
-    // Render the directory name
-    surf = TTF_RenderText_Solid(data_ptr->recursive_font, dirname.c_str(), name_color);
-    SDL_Texture* dir_texture = SDL_CreateTextureFromSurface(renderer, surf);
-    SDL_FreeSurface(surf);
-    SDL_Rect starting_row = {75, 10};
-    SDL_QueryTexture(dir_texture, NULL, NULL, &(starting_row.w), &(starting_row.h));
-    SDL_RenderCopy(renderer, dir_texture, NULL, &starting_row);
-    starting_row.x += 25;
-    starting_row.y += 25;
-
-    // Render everything inside the directory
-    for(int i = 0; i < RecursiveTextures.size(); i++) {
-        SDL_QueryTexture(RecursiveTextures[i], NULL, NULL, &(starting_row.w), &(starting_row.h));
-        SDL_RenderCopy(renderer, RecursiveTextures[i], NULL, &starting_row);
-        starting_row.y += 25;
-        // Recursive rendering limit - beyond this value, the program becomes too slow to take in inputs
-        if(i == 100) { break; }
+    data_ptr->icons.draw(renderer, ICON_RECURSIVE, &SidebarButtons[CLICK_RECURSIVE - CLICK_HOME].rect);
+
+    // Render the scroll bar
+    RecursiveList.drawScrollBar(renderer);
+
+    // Render the directory name and how many entries have been found below it so far
+    SDL_Color name_color = {0, 0, 0, 255};
+    std::string header = dirname + "  (" + std::to_string(RecursiveModel.size()) + (Walker->running() ? " entries so far)" : " entries)");
+    data_ptr->recursive_text.drawText(header, 75, 10, name_color);
+
+    // Render only the rows inside the viewport; each level of depth is indented by 20 pixels
+    SDL_RenderSetClipRect(renderer, RecursiveList.area());
+    for(int row = RecursiveList.firstVisibleRow(); row < RecursiveList.endVisibleRow(); row++) {
+        uint32_t node = RecursiveModel.rowNode(row);
+        int row_y = RecursiveList.rowTop(row) + 3;
+        int x = 80 + 20 * RecursiveModel.depth(node);
+
+        // Directories get a +/- marker showing whether they are expanded
+        if(RecursiveModel.isDir(node)) {
+            data_ptr->recursive_text.drawText(RecursiveModel.isExpanded(node) ? "-" : "+", x - 14, row_y, name_color, RecursiveList.area());
+        }
+        SDL_Rect icon = {x, row_y, 18, 18};
+        data_ptr->icons.draw(renderer, RecursiveModel.isDir(node) ? ICON_FOLDER : ICON_OTHERFILE, &icon);
+        data_ptr->recursive_text.drawText(RecursiveModel.name(node), x + 24, row_y, name_color, RecursiveList.area());
     }
+    SDL_RenderSetClipRect(renderer, NULL);
+    data_ptr->recursive_text.flush();
+    drawOperationStatus(renderer, data_ptr);
+    drawOverlay(renderer, data_ptr);
     SDL_RenderPresent(renderer);
     return true;
 }
 
-/* Comparator for sorting files alphabetically */
-bool filenameCompare(std::string a, std::string b) 
-{
-    // Make copies of the filenames 
-    std::string file1 = a;
-    std::string file2 = b;
+/* Render the duplicates view: each group of identical files under a line saying how much deleting all but one copy
+   would free, largest first. While the finder runs, the header shows how far it has got */
+void renderDuplicateView(SDL_Renderer* renderer, AppData* data_ptr) {
+    PROFILE_SCOPE("render.duplicates");
+    // Reset render color to gray
+    SDL_SetRenderDrawColor(renderer, 235, 235, 235, 255);
+    // Erase renderer content from the previous rendering
+    SDL_RenderClear(renderer);
+
+    // Render the sidebar
+    SDL_Rect sidebar1 = {60, 0, 5, 600};
+    SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
+    SDL_RenderFillRect(renderer, &sidebar1);
+    DuplicateList.drawScrollBar(renderer);
+
+    SDL_Color text_color = {0, 0, 0, 255};
+    DuplicateStats found = Duplicates->stats();
+    std::string header = DuplicatesDir + "  (";
+    if(found.running) {
+        header += std::to_string(found.files) + " files, " + formatSize(found.hashed_bytes) + " compared so far)";
+    } else {
+        header += std::to_string(found.groups) + " groups of duplicates, " + formatSize(found.reclaimable) + " reclaimable)";
+    }
+    data_ptr->recursive_text.drawText(header, 75, 10, text_color);
+
+    // Files are shown by their path below the directory, indented under their group's line
+    SDL_RenderSetClipRect(renderer, DuplicateList.area());
+    SDL_Color group_color = {81, 12, 118, 255};
+    for(int row = DuplicateList.firstVisibleRow(); row < DuplicateList.endVisibleRow(); row++) {
+        const DuplicateGroup& group = DuplicateGroups[DuplicateRows[row].first];
+        int row_y = DuplicateList.rowTop(row) + 3;
+        if(DuplicateRows[row].second < 0) {
+            int64_t copies = group.paths.size();
+            std::string line = std::to_string(copies) + " copies of " + formatSize(group.size) + ", " +
+                               formatSize(group.size * (copies - 1)) + " reclaimable";
+            data_ptr->recursive_text.drawText(line, 80, row_y, group_color, DuplicateList.area());
+            continue;
+        }
+        const std::string& path = group.paths[DuplicateRows[row].second];
+        std::string shown = path.substr(std::min(path.size(), DuplicatesDir.size()));
+        while(!shown.empty() && shown[0] == '/') { shown.erase(0, 1); }
+        const char* type = classifyByExtension(path.substr(path.rfind('/') + 1));
+        SDL_Rect icon = {100, row_y, 18, 18};
+        data_ptr->icons.draw(renderer, entryIcon(entryTypeFromString(type)), &icon);
+        data_ptr->recursive_text.drawText(shown, 124, row_y, text_color, DuplicateList.area());
+    }
+    SDL_RenderSetClipRect(renderer, NULL);
+    data_ptr->recursive_text.flush();
+    drawOperationStatus(renderer, data_ptr);
+    drawOverlay(renderer, data_ptr);
+    SDL_RenderPresent(renderer);
+}
 
-    // Make all characters lowercase for the sake of comparison
-    for(int i = 0; i < file1.size(); i++) { file1[i] = tolower(file1[i]); }
-    for(int i = 0; i < file2.size(); i++) { file2[i] = tolower(file2[i]); }
+/* Draws frame time, entry throughput, the number of live textures, the prefetcher's hit rate and how large the entry
+   store ever got in the bottom-right corner (if enabled with F3). The frame time shown is the previous frame's, since
+   this one isn't finished yet */
+void drawOverlay(SDL_Renderer* renderer, AppData* data_ptr) {
+    if(!ShowOverlay) { return; }
+    char line[128];
+    snprintf(line, sizeof(line), "frame %.2f ms (avg %.2f)  %.0f entries/s  %d textures",
+             Frames.frameMs(), Frames.averageFrameMs(), Frames.entriesPerSecond(), TextureHandle::liveCount());
+    PrefetchStats prefetched = Prefetch->stats();
+    char prefetch_line[128];
+    snprintf(prefetch_line, sizeof(prefetch_line), "prefetch %ld/%ld hits  %ld read, %ld unused  %.1f MiB", prefetched.hits,
+             prefetched.hits + prefetched.misses, prefetched.fetched, prefetched.wasted, prefetched.bytes / 1048576.0);
+    // Should track the largest directory visited, not the session length
+    char store_line[128];
+    snprintf(store_line, sizeof(store_line), "entry store peak %zu entries  %.1f MiB", ExplorerStore.highWaterEntries(),
+             ExplorerStore.highWaterBytes() / 1048576.0);
+
+    SDL_Rect box = {385, 522, 398, 76};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
+    SDL_RenderFillRect(renderer, &box);
+    SDL_Color color = {255, 255, 255, 255};
+    data_ptr->recursive_text.drawText(line, box.x + 8, box.y + 4, color, &box);
+    data_ptr->recursive_text.drawText(prefetch_line, box.x + 8, box.y + 28, color, &box);
+    data_ptr->recursive_text.drawText(store_line, box.x + 8, box.y + 52, color, &box);
+    data_ptr->recursive_text.flush();
+}
+
+/* Draws what the running file operation is doing, how far it has got and how fast it goes in the bottom-left corner */
+void drawOperationStatus(SDL_Renderer* renderer, AppData* data_ptr) {
+    FileOpProgress progress = FileOps->progress();
+    if(!progress.active) { return; }
+    static const char* const verbs[] = {"Copying", "Moving", "Deleting", "Creating"};
+    std::string first = std::string(verbs[progress.kind]) + " " + progress.current;
+    std::string second = std::to_string(progress.items_done) + " of " + std::to_string(progress.items_total) + " items";
+    if(progress.queued > 0) { second += ", " + std::to_string(progress.queued) + " more queued"; }
+    second += " (Esc cancels)";
+    std::string third;
+    if(progress.bytes_total > 0) {
+        third = formatSize(progress.bytes_done) + " of " + formatSize(progress.bytes_total) + ", " +
+                formatSize((int64_t)progress.bytes_per_second) + "/s";
+    }
+
+    SDL_Rect box = {70, 524, 310, 74};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
+    SDL_RenderFillRect(renderer, &box);
+    // The bar follows the bytes when there are any to copy, the items otherwise
+    double done = progress.bytes_total > 0 ? (double)progress.bytes_done / progress.bytes_total :
+                  progress.items_total > 0 ? (double)progress.items_done / progress.items_total : 0;
+    SDL_Rect bar = {box.x, box.y + box.h - 4, (int)(box.w * std::min(1.0, done)), 4};
+    SDL_SetRenderDrawColor(renderer, 81, 12, 118, 255);
+    SDL_RenderFillRect(renderer, &bar);
+    SDL_Color color = {255, 255, 255, 255};
+    data_ptr->recursive_text.drawText(first, box.x + 8, box.y + 4, color, &box);
+    data_ptr->recursive_text.drawText(second, box.x + 8, box.y + 25, color, &box);
+    data_ptr->recursive_text.drawText(third, box.x + 8, box.y + 46, color, &box);
+    data_ptr->recursive_text.flush();
+}
+
+/* Prints how a finished file operation went */
+void reportFileOperation(const FileOpResult& result) {
+    static const char* const verbs[] = {"Copied", "Moved", "Deleted", "Created"};
+    double seconds = result.elapsed_ms / 1000.0;
+    printf("%s %lld items (%s) in %.2f s, %s/s%s\n", verbs[result.kind], (long long)result.items_done, formatSize(result.bytes_done).c_str(),
+           seconds, formatSize(seconds > 0 ? (int64_t)(result.bytes_done / seconds) : 0).c_str(), result.cancelled ? ", then cancelled" : "");
+    if(result.failed > 0) {
+        printf("%d items failed, the first because of '%s'\n", result.failed, result.error.c_str());
+    }
+}
 
-    // Perform a standard string comparison
-    return file1 < file2;
-}    
+/* Paths of the selected entries of the directory shown, in the order they are listed */
+std::vector<std::string> selectedPaths() {
+    std::vector<std::string> paths;
+    for(int i = 0; i < ExplorerEntries.size(); i++) {
+        if(ExplorerStore.isSelected(ExplorerEntries[i])) { paths.push_back(ExplorerStore.path(ExplorerEntries[i])); }
+    }
+    return paths;
+}
 
-/* Gets everything (files and directories) inside directory 'dirname' and creates FileEntry instances containing information about them */
-std::string getDirectoryEntries(std::string dirname, SDL_Renderer* renderer, TTF_Font* font)
+/* Starts showing directory 'dirname' as a new step of the history (dropping the steps ahead of the current one);
+   its entries arrive through receiveDirectoryEntries() */
+std::string getDirectoryEntries(std::string dirname)
 {
-    // Struct containing the information about the current directory
-    struct stat info;
-    // Gather information about the current directory and store it in 'info'
-    int err = stat(dirname.c_str(), &info);
-    // As long as the passed-in dirname matched with a valid directory, start looking at that directory's contents
-    if (err == 0 && S_ISDIR(info.st_mode))
-    {
-        // Stores information about the files in the current directory
-        std::vector<std::string> files;
-        DIR* dir = opendir(dirname.c_str());
-        struct dirent *entry;
-        // Read in the contents of the directory to the 'files' vector
-        while ((entry = readdir(dir)) != NULL) {
-            files.push_back(entry->d_name);
+    leaveDirectory();
+    History.erase(History.begin() + (HistoryPos + 1), History.end());
+    HistoryStep step;
+    step.dir = dirname;
+    History.push_back(std::move(step));
+    if(History.size() > HISTORY_LENGTH) { History.pop_front(); }
+    HistoryPos = History.size() - 1;
+    loadDirectory(dirname, std::unique_ptr<ViewSnapshot>());
+    return dirname;
+}
+
+/* Goes 'delta' steps back (negative) or forward in the history; returns the directory shown afterwards */
+std::string navigateHistory(int delta, const std::string& current_dir) {
+    int target = HistoryPos + delta;
+    if(target < 0 || target >= History.size()) { return current_dir; }
+    leaveDirectory();
+    HistoryPos = target;
+    loadDirectory(History[HistoryPos].dir, std::move(History[HistoryPos].snapshot));
+    return History[HistoryPos].dir;
+}
+
+/* Stops all background work on the directory being left and empties the entry list. A completely listed directory is
+   kept as the snapshot of its history step; only the HISTORY_SNAPSHOTS steps nearest the current one keep theirs */
+void leaveDirectory() {
+    // Thumbnails still queued for the old directory would only delay the new one's
+    ThumbnailDecoder->clear();
+    // A search (and the walk it started) belongs to the directory it was typed in
+    if(!SearchQuery.empty()) {
+        SearchQuery.clear();
+        SearchResults.clear();
+        SearchEntries.clear();
+        SearchStore.reset();
+        ContentMatches.clear();
+        stopContentSearch();
+        stopWalk();
+    }
+    // Cancel the scan of the old directory and the totals of its subdirectories
+    Scanner->cancel();
+    DirSizes->cancel();
+    if(HistoryPos >= 0) { Watches->unwatch(History[HistoryPos].dir); }
+
+    if(ExplorerScanFinished && ExplorerMtime >= 0 && HistoryPos >= 0) {
+        std::unique_ptr<ViewSnapshot> snapshot(new ViewSnapshot());
+        snapshot->mtime = ExplorerMtime;
+        snapshot->store.swap(ExplorerStore);
+        snapshot->entries.swap(ExplorerEntries);
+        snapshot->sort = ExplorerSort;
+        snapshot->scroll_offset = EntryList.scrollOffset();
+        History[HistoryPos].snapshot = std::move(snapshot);
+
+        int kept = 0;
+        for(int i = 0; i < History.size(); i++) { kept += History[i].snapshot ? 1 : 0; }
+        while(kept > HISTORY_SNAPSHOTS) {
+            int farthest = -1;
+            for(int i = 0; i < History.size(); i++) {
+                if(History[i].snapshot && (farthest < 0 || std::abs(i - HistoryPos) > std::abs(farthest - HistoryPos))) { farthest = i; }
+            }
+            History[farthest].snapshot.reset();
+            kept--;
         }
-        closedir(dir);
-
-        // Sort the files in the files vector in alphabetical order using the sort() function
-        std::sort(files.begin(), files.end(), filenameCompare);
-        
-        // Stores information about each individual entry (file or another directory) within the current directory
-        struct stat file_info;
-
-        // Loop through all the files that were read in
-        for(int i = 0; i < files.size(); i++) {
-            // Get the file name; ignore the "." directory by skipping the current iteration
-            std::string curfile_name = files[i].c_str();
-            if(curfile_name == ".") { continue; }
-            // Get the file path and size
-            std::string curfile_path = dirname + "/" + files[i].c_str();
-            err = stat(curfile_path.c_str(), &file_info);
-            int curfile_size = file_info.st_size;
-            std::string curfile_perms = getFilePermissions(file_info);
-            if(err == 1) { std::cout << "DEBUG MSG: something went wrong obtaining file info" << std::endl;}
-            
-            /************************************/
-            /* THE CURRENT ENTRY IS A DIRECTORY */
-            /************************************/
-            if(S_ISDIR(file_info.st_mode)) {
-                // Create an instance of FileEntry::Directory, constructing it with values parsed from the current file
-                Directory* dir = new Directory(curfile_name, "dir", curfile_size, curfile_path, curfile_perms, renderer, font);
-                dir->setIcon(renderer);
-                // Add the FileEntry::Directory to the ExplorerEntries array 
-                ExplorerEntries.push_back(dir);
-
-            /***************************************/
-            /* THE CURRENT ENTRY IS A REGULAR FILE */
-            /***************************************/
-            } else if(S_ISREG(file_info.st_mode)) {
-                // Find the "." character in the current file name
-                int pos = files[i].find(".", 1);
-                std::string extension;
-                // Make a substring of the current file's extension by making a substring from "." to the end of the string
-                if(pos == -1) { extension = "noext"; } else { extension = files[i].substr(pos); }
-
-                /* EXECUTABLE (the current user has execute permissions (what about groups and others?)) */
-                if(file_info.st_mode & S_IXUSR) {
-                    // Create an instance of FileEntry::Executable, constructing it with values parsed from the current file
-                    Executable* exe = new Executable(curfile_name, "exe", curfile_size, curfile_path, curfile_perms, renderer, font);
-                    exe->setIcon(renderer);
-                    // Add the FileEntry::Executable to the ExplorerEntries array 
-                    ExplorerEntries.push_back(exe);
-                }
+    }
+    // Clear whatever is left (dropping the entries all at once) and scroll back to the top
+    ExplorerEntries.clear();
+    ExplorerStore.reset();
+    EntryList.setRowCount(0);
+    EntryList.scrollToTop();
+    ExplorerScanFinished = false;
+}
 
-                /* IMAGE (file extension matches) */
-                else if(extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
-                        extension == ".tif" || extension == ".tiff" || extension == ".gif") {                
-                    // Create an instance of FileEntry::Image, constructing it with values parsed from the current file
-                    Image* img = new Image(curfile_name, "img", curfile_size, curfile_path, curfile_perms, renderer, font);
-                    img->setIcon(renderer);
-                    // Add the FileEntry::Image to the ExplorerEntries array 
-                    ExplorerEntries.push_back(img);
-
-                /* VIDEO (file extension matches) */
-                } else if(extension == ".mp4" || extension == ".mov" || extension == ".mkv" ||
-                          extension == ".avi" || extension == ".webm") {
-
-                    // Create an instance of FileEntry::Video, constructing it with values parsed from the current file
-                    Video* vid = new Video(curfile_name, "vid", curfile_size, curfile_path, curfile_perms, renderer, font);
-                    vid->setIcon(renderer);
-                    // Add the FileEntry::Video to the ExplorerEntries array 
-                    ExplorerEntries.push_back(vid);
-
-                /* CODE FILE (file extension matches) */
-                } else if(extension == ".h" || extension == ".c"    || extension == ".cpp" ||
-                          extension == ".py"|| extension == ".java" || extension == ".js") {
-
-                    // Create an instance of FileEntry::CodeFile, constructing it with values parsed from the current file
-                    CodeFile* code = new CodeFile(curfile_name, "code", curfile_size, curfile_path, curfile_perms, renderer, font);
-                    code->setIcon(renderer);
-                    // Add the FileEntry::CodeFile to the ExplorerEntries array 
-                    ExplorerEntries.push_back(code);
-
-                /* OTHER FILE (none of the above) */
-                } else {
-
-                    // Create an instance of FileEntry::OtherFile, constructing it with values parsed from the current file
-                    OtherFile* other = new OtherFile(curfile_name, "other", curfile_size, curfile_path, curfile_perms, renderer, font);
-                    other->setIcon(renderer);
-                    // Add the FileEntry::OtherFile to the ExplorerEntries array 
-                    ExplorerEntries.push_back(other);
-                }
+/* Shows 'dirname' in the emptied entry list: straight from 'snapshot' if there is one (the scanner checks that the
+   directory hasn't changed since it was taken, see receiveDirectoryEntries()), otherwise by scanning it (from a
+   prefetched listing if there is one). Nothing here touches the disk, so a hung mount can't freeze the window */
+void loadDirectory(const std::string& dirname, std::unique_ptr<ViewSnapshot> snapshot) {
+    // Asked for before the directory is read; a change that falls between the listing and the watch is caught
+    // by the mtime the watcher reports (see applyExplorerChanges())
+    Watches->watch(dirname, false);
+    ExplorerMtime = -1;
+    // Directories read ahead start without touching the disk; reading ahead waits until this one is listed
+    Prefetch->pause();
+
+    if(snapshot) {
+        ExplorerMtime = snapshot->mtime;
+        ExplorerStore.swap(snapshot->store);
+        ExplorerEntries.swap(snapshot->entries);
+        if(snapshot->sort.key != ExplorerSort.key || snapshot->sort.ascending != ExplorerSort.ascending) {
+            sortEntries(ExplorerStore, &ExplorerEntries, ExplorerSort);
+        }
+        EntryList.setRowCount(ExplorerEntries.size());
+        EntryList.scrollTo(snapshot->scroll_offset);
+        ExplorerScanFinished = true;
+
+        // The scanner only has to fetch what was still unknown when the directory was left (directories never need anything)
+        Scanner->resume(dirname, ExplorerStore, snapshot->mtime);
+        if(sortNeedsMetadata(ExplorerSort)) { Scanner->requestAllMetadata(); }
+        // Directory totals come from the sizer's cache unless something below them changed
+        for(uint32_t i = 0; i < ExplorerStore.count(); i++) {
+            if(!ExplorerStore.isRemoved(i) && ExplorerStore.type(i) == ENTRY_DIR) { DirSizes->request(i, ExplorerStore.path(i)); }
+        }
+    } else {
+        Scanner->start(dirname, Prefetch->take(dirname));
+    }
+    RecentDirs.push_back(dirname);
+    if(RecentDirs.size() > RECENT_DIRS) { RecentDirs.pop_front(); }
+}
+
+/* Adds the entries the scanner has published since the last call to ExplorerStore and fills in
+   the sizes and permissions it has fetched; returns true if anything arrived */
+bool receiveDirectoryEntries()
+{
+    PROFILE_SCOPE("receiveDirectoryEntries");
+    std::vector<ScannedEntry> scanned;
+    bool finished;
+    bool stale;
+    Scanner->takeEntries(&scanned, &finished, &stale);
+    if(stale) {
+        // The directory changed since the snapshot on screen was taken; it is read again
+        std::string dirname = History[HistoryPos].dir;
+        leaveDirectory();
+        History[HistoryPos].snapshot.reset();
+        loadDirectory(dirname, std::unique_ptr<ViewSnapshot>());
+        return true;
+    }
+    std::vector<EntryMetadata> metadata;
+    Scanner->takeMetadata(&metadata);
+    if(finished) {
+        ExplorerScanFinished = true;
+        ExplorerMtime = Scanner->listedMtime();
+    }
+    if(scanned.empty() && metadata.empty()) { return finished; }
+
+    size_t sorted_count = ExplorerEntries.size();
+    uint32_t parent = ExplorerStore.addParent(History[HistoryPos].dir);
+    for(int i = 0; i < scanned.size(); i++) {
+        uint32_t entry = ExplorerStore.add(parent, scanned[i].name, scanned[i].sort_key, scanned[i].type);
+        ExplorerStore.setMetadata(entry, scanned[i].size, scanned[i].mode, scanned[i].modified);
+        // Directories get their recursive total in the background
+        if(scanned[i].type == ENTRY_DIR) { DirSizes->request(entry, ExplorerStore.path(entry)); }
+        ExplorerEntries.push_back(entry);
+    }
+    if(SearchQuery.empty()) { EntryList.setRowCount(ExplorerEntries.size()); }
+    Frames.addEntries(scanned.size());
+
+    // New entries arrive in ascending name order; for any other order they are merged into place
+    if(!scanned.empty() && !(ExplorerSort.key == SORT_NAME && ExplorerSort.ascending)) {
+        mergeEntries(ExplorerStore, &ExplorerEntries, sorted_count, ExplorerSort);
+        if(sortNeedsMetadata(ExplorerSort)) { Scanner->requestAllMetadata(); }
+    }
 
-            /* THE CURRENT ENTRY IS NOT A DIRECTORY OR REGULAR FILE */
-            } else { continue; }
+    for(int i = 0; i < metadata.size(); i++) {
+        uint32_t entry = metadata[i].index;
+        if(entry >= ExplorerStore.count() || ExplorerStore.isRemoved(entry)) { continue; }
+        // The execute bit (and the contents of files with an unknown extension) are only known now; until here the entry was typed from its name
+        if(metadata[i].executable) {
+            ExplorerStore.setType(entry, ENTRY_EXE);
+        } else if(metadata[i].typed) {
+            ExplorerStore.setType(entry, metadata[i].type);
         }
+        ExplorerStore.setMetadata(entry, metadata[i].size, metadata[i].mode, metadata[i].modified);
     }
-    else
-    {
-        fprintf(stderr, "Error: directory argument passed into getDirectoryEntries '%s' not found\n", dirname.c_str());
+    // Sizes, permissions or types changed, which moves entries unless the list is sorted by name
+    if(!metadata.empty() && ExplorerSort.key != SORT_NAME) {
+        sortEntries(ExplorerStore, &ExplorerEntries, ExplorerSort);
     }
-    return dirname;
+    return true;
+}
+
+/* Hands the prefetcher the directories on screen, likeliest first: the hovered one, then those visited recently (most
+   recent first), then the rest from the top. Nothing is read ahead while the current directory is still being listed */
+void updatePrefetch() {
+    if(!ExplorerScanFinished || !SearchQuery.empty()) { return; }
+    std::vector<std::string> dirs;
+    for(int i = EntryList.firstVisibleRow(); i < EntryList.endVisibleRow() && i < ExplorerEntries.size(); i++) {
+        if(ExplorerStore.type(ExplorerEntries[i]) == ENTRY_DIR) { dirs.push_back(ExplorerStore.path(ExplorerEntries[i])); }
+    }
+    std::vector<std::string> candidates;
+    if(HoveredRow >= EntryList.firstVisibleRow() && HoveredRow < EntryList.endVisibleRow() && HoveredRow < ExplorerEntries.size() &&
+       ExplorerStore.type(ExplorerEntries[HoveredRow]) == ENTRY_DIR) {
+        candidates.push_back(ExplorerStore.path(ExplorerEntries[HoveredRow]));
+    }
+    for(int r = RecentDirs.size() - 1; r >= 0; r--) {
+        for(int i = 0; i < dirs.size(); i++) {
+            if(dirs[i] == RecentDirs[r] && std::find(candidates.begin(), candidates.end(), RecentDirs[r]) == candidates.end()) {
+                candidates.push_back(RecentDirs[r]);
+            }
+        }
+    }
+    for(int i = 0; i < dirs.size(); i++) {
+        if(std::find(candidates.begin(), candidates.end(), dirs[i]) == candidates.end()) { candidates.push_back(dirs[i]); }
+    }
+    Prefetch->setCandidates(candidates);
+}
+
+/* Fills in the directory totals computed since the last call; returns true if any arrived */
+bool receiveDirectorySizes() {
+    std::vector<DirSizeResult> results;
+    DirSizes->takeResults(&results);
+    for(int i = 0; i < results.size(); i++) {
+        if(results[i].index < 0 || results[i].index >= ExplorerStore.count() || ExplorerStore.isRemoved(results[i].index)) { continue; }
+        ExplorerStore.setSize(results[i].index, results[i].bytes);
+    }
+    if(!results.empty() && ExplorerSort.key == SORT_SIZE) {
+        sortEntries(ExplorerStore, &ExplorerEntries, ExplorerSort);
+    }
+    return !results.empty();
 }
 
-/* Modified version of listDirectory() from class that builds the RecursiveEntries string vector */
-void buildRecursiveEntries(std::string dirname, int indent) {
+/* Applies the changes the watcher reported to the entry list and the recursive view; returns true if anything changed.
+   Changes to a directory still being scanned or walked wait until it is done (applying one twice does no harm) */
+bool receiveDirectoryChanges() {
+    PROFILE_SCOPE("receiveDirectoryChanges");
+    Watches->takeChanges(&HeldChanges);
+    std::string explorer_dir = HistoryPos >= 0 ? History[HistoryPos].dir : "";
+    std::vector<DirChanges> changes;
+    changes.swap(HeldChanges);
+    bool changed = false;
+    for(int i = 0; i < changes.size(); i++) {
+        bool for_explorer = changes[i].dir == explorer_dir;
+        bool for_tree = WatchedTreeDirs.count(changes[i].dir) > 0;
+        // Batches of directories no longer watched are dropped
+        if(!for_explorer && !for_tree) { continue; }
+        if((for_explorer && !ExplorerScanFinished) || (for_tree && !WalkFinished)) {
+            HeldChanges.push_back(std::move(changes[i]));
+            continue;
+        }
+        if(for_explorer) { changed |= applyExplorerChanges(changes[i]); }
+        if(for_tree) { changed |= applyTreeChanges(changes[i]); }
+    }
+    return changed;
+}
 
-    // Append spaces depending on the value of 'indent'
-    std::string space = "          ";
-	for(int i = 0; i < indent; i++) { space += "          "; }
+/* Inserts, updates and removes the entries of the current directory that changed, keeping the list sorted.
+   Entries are only ever appended to ExplorerStore; removed ones stay there, flagged */
+bool applyExplorerChanges(const DirChanges& changes) {
+    // Changes were lost, or the directory changed after it was listed but before it was watched;
+    // only reading it again is sure to be right
+    if(changes.complete || (ExplorerMtime >= 0 && changes.mtime > ExplorerMtime)) {
+        std::string dirname = History[HistoryPos].dir;
+        leaveDirectory();
+        History[HistoryPos].snapshot.reset();
+        loadDirectory(dirname, std::unique_ptr<ViewSnapshot>());
+        return true;
+    }
+    // Store index of the entry with each changed name (-1 for names that are new)
+    std::unordered_map<std::string, int> indices;
+    for(int i = 0; i < changes.entries.size(); i++) { indices[changes.entries[i].name] = -1; }
+    for(uint32_t i = 0; i < ExplorerStore.count(); i++) {
+        if(ExplorerStore.isRemoved(i)) { continue; }
+        std::unordered_map<std::string, int>::iterator found = indices.find(ExplorerStore.name(i));
+        if(found != indices.end()) { found->second = i; }
+    }
+
+    size_t sorted_count = ExplorerEntries.size();
+    size_t removed = 0;
+    bool resort = false;
+    uint32_t parent = ExplorerStore.addParent(changes.dir);
+    for(int i = 0; i < changes.entries.size(); i++) {
+        const WatchedEntry& changed = changes.entries[i];
+        int index = indices[changed.name];
+        if(!changed.exists) {
+            if(index >= 0) {
+                ExplorerStore.remove(index);
+                removed++;
+            }
+        } else if(index < 0) {
+            uint32_t entry = ExplorerStore.add(parent, changed.name, collationKey(changed.name), changed.type);
+            ExplorerStore.setMetadata(entry, changed.size, changed.mode, changed.modified);
+            ExplorerEntries.push_back(entry);
+            if(changed.type == ENTRY_DIR) { DirSizes->request(entry, ExplorerStore.path(entry)); }
+        } else if(changed.type != ExplorerStore.type(index)) {
+            // Became a directory, or a file whose type changed (it keeps its place in the store)
+            ExplorerStore.setType(index, changed.type);
+            ExplorerStore.setMetadata(index, changed.size, changed.mode, changed.modified);
+            if(changed.type == ENTRY_DIR) { DirSizes->request(index, ExplorerStore.path(index)); }
+            resort = true;
+        } else if(changed.is_dir) {
+            // Something in it was added or removed; its total is added up again (unchanged directories below come from the cache)
+            DirSizes->request(index, ExplorerStore.path(index));
+        } else {
+            ExplorerStore.setMetadata(index, changed.size, changed.mode, changed.modified);
+            resort = true;
+        }
+    }
 
-    // Get info about the current file
-    struct stat info;
-    int err = stat(dirname.c_str(), &info);
+    if(removed > 0) {
+        ExplorerEntries.erase(std::remove_if(ExplorerEntries.begin(), ExplorerEntries.end(), [](uint32_t entry) {
+            return ExplorerStore.isRemoved(entry);
+        }), ExplorerEntries.end());
+        sorted_count -= removed;
+    }
+    // New entries are merged into place; changed sizes, permissions or types move entries unless sorted by name
+    if(resort && ExplorerSort.key != SORT_NAME) {
+        sortEntries(ExplorerStore, &ExplorerEntries, ExplorerSort);
+    } else if(sorted_count < ExplorerEntries.size()) {
+        mergeEntries(ExplorerStore, &ExplorerEntries, sorted_count, ExplorerSort);
+    }
+    if(SearchQuery.empty()) { EntryList.setRowCount(ExplorerEntries.size()); }
+    return !changes.entries.empty() && SearchQuery.empty();
+}
 
-    // Files array of strings stores entry names
-    std::vector<std::string> files;
+/* Adds and removes the children of a directory of the recursive view that changed; the search picks up the new nodes */
+bool applyTreeChanges(const DirChanges& changes) {
+    // Only the explorer needs the mtime a new watch reports
+    if(!changes.complete && changes.entries.empty()) { return false; }
+    int node = RecursiveModel.findDirectory(changes.dir);
+    // The directory itself was removed from the tree
+    if(node < 0) {
+        WatchedTreeDirs.erase(changes.dir);
+        Watches->unwatch(changes.dir);
+        return false;
+    }
+    std::vector<WalkEntry> present;
+    std::vector<std::string> gone;
+    for(int i = 0; i < changes.entries.size(); i++) {
+        if(!changes.entries[i].exists) {
+            gone.push_back(changes.entries[i].name);
+            continue;
+        }
+        WalkEntry entry;
+        entry.name = changes.entries[i].name;
+        entry.is_dir = changes.entries[i].is_dir;
+        entry.node = -1;
+        present.push_back(entry);
+    }
+    bool changed = RecursiveModel.updateChildren(node, present, gone, changes.complete);
+    RecursiveList.setRowCount(RecursiveModel.rowCount());
+
+    // Directories that keep changing leave removed records behind; once they are most of the tree it is renumbered
+    // without them, and the index and the search are built again for the new node numbers
+    if(RecursiveModel.compact()) {
+        RecursiveIndex.reset();
+        RecursiveIndex.update(RecursiveModel);
+        if(!SearchQuery.empty() && !ContentMode) {
+            RecursiveIndex.find(SearchQuery, NULL, &SearchResults);
+            SearchEntries.assign(SearchResults.size(), NO_ENTRY);
+            SearchStore.reset();
+            EntryList.setRowCount(SearchResults.size());
+        }
+        return true;
+    }
+    uint32_t first_new = RecursiveIndex.update(RecursiveModel);
+    if(!SearchQuery.empty() && !ContentMode) {
+        RecursiveIndex.findFrom(SearchQuery, first_new, &SearchResults);
+        SearchEntries.resize(SearchResults.size(), NO_ENTRY);
+        dropRemovedResults();
+        EntryList.setRowCount(SearchResults.size());
+        changed = true;
+    }
+    return changed;
+}
 
-    // Get all the entries in the directory (just their names) and add them to files[]
-    if (err == 0 && S_ISDIR(info.st_mode)) {
-        DIR* dir = opendir(dirname.c_str());		
-		
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            files.push_back(entry->d_name);
+/* Watches a directory of the recursive view while it is expanded. One the walk never listed (created after the walk
+   passed its parent) is listed by the watcher */
+void watchTreeDirectory(uint32_t node) {
+    std::string path = RecursiveModel.path(node);
+    if(RecursiveModel.isExpanded(node)) {
+        if(WatchedTreeDirs.insert(path).second) {
+            Watches->watch(path, !RecursiveModel.isListed(node) && WalkFinished);
         }
-        closedir(dir);
-    }
-    
-    // Sort the files array
-	std::sort(files.begin(), files.end(), filenameCompare);
-	
-	int i, file_err;
-	struct stat file_info;
-	
-    // Recursively add to the RecursiveEntries array
-	for(int i = 0; i < files.size(); i++) {
-		std::string full_path = dirname + "/" + files[i];
-		file_err = stat(full_path.c_str(), &file_info);
-		if(file_err) {
-            // Print an error message (should never happen)
-			fprintf(stderr, "Uh, oh, shouldnt be here");
-		} else if(S_ISDIR(file_info.st_mode)) {
-            // Add a directory, and recurse
-            RecursiveEntries.push_back(space + files[i]);
-			if(files[i] != "." && files[i] != "..") {
-				buildRecursiveEntries(full_path, indent + 1);
-			}				
-		} else {
-            // Add a file
-            RecursiveEntries.push_back(space + files[i]);
-		}
-    }
-}
-
-/* Determine what UI element the user clicked on using x and y coordinates and return a string containing information representing that element */
-std::string parseMouseClick(int mouse_click_x, int mouse_click_y) {
-
-    /**** CLICKED ON HOME ICON ****/
-    if((mouse_click_x >= 8 && mouse_click_x <= 48) && (mouse_click_y >= 7 && mouse_click_y <= 47)) {
-        // Return to the home directory
-        return home + ",HOME";
-    }
-    /**** CLICKED ON DESKTOP ***/
-    else if((mouse_click_x >= 8 && mouse_click_x <= 48) && (mouse_click_y >= 67 && mouse_click_y <= 107))  {
-        return home + "/Desktop/,DESKTOP";
-    }
-    /**** CLICKED ON RECURSIVE VIEW ****/
-    else if((mouse_click_x >= 8 && mouse_click_x <= 48) && (mouse_click_y >= 127 && mouse_click_y <= 167))  {
-        return "R";
+    } else if(WatchedTreeDirs.erase(path)) {
+        Watches->unwatch(path);
+    }
+}
 
-    /**** CLICKED ON A FILE OR DIRECTORY ****/
+/* Cancels the walk behind the recursive view and the search, and stops watching its directories */
+void stopWalk() {
+    Walker->cancel();
+    WalkedDir.clear();
+    for(std::set<std::string>::iterator it = WatchedTreeDirs.begin(); it != WatchedTreeDirs.end(); ++it) {
+        Watches->unwatch(*it);
+    }
+    WatchedTreeDirs.clear();
+}
+
+/* Drops the search results (and the rows made for them) whose nodes were removed from the tree */
+void dropRemovedResults() {
+    size_t kept = 0;
+    for(size_t i = 0; i < SearchResults.size(); i++) {
+        if(RecursiveModel.isRemoved(SearchResults[i])) { continue; }
+        SearchResults[kept] = SearchResults[i];
+        SearchEntries[kept] = SearchEntries[i];
+        kept++;
+    }
+    SearchResults.resize(kept);
+    SearchEntries.resize(kept);
+}
+
+/* Re-sorts the loaded entries by column 'key'; choosing the column already sorted by flips the direction */
+void sortExplorerEntries(SortKey key) {
+    PROFILE_SCOPE("sortExplorerEntries");
+    if(ExplorerSort.key == key) {
+        ExplorerSort.ascending = !ExplorerSort.ascending;
     } else {
-        for(int i = 0; i < ExplorerEntries.size(); i++) {
-            if((mouse_click_x >= ExplorerEntries[i]->icon_coordinates[0] && mouse_click_x <= ExplorerEntries[i]->icon_coordinates[1]) &&
-            (mouse_click_y >= ExplorerEntries[i]->icon_coordinates[2] && mouse_click_y <= ExplorerEntries[i]->icon_coordinates[3])) {
-                    return ExplorerEntries[i]->filepath + "," + ExplorerEntries[i]->entrytype;
-            }
+        ExplorerSort.key = key;
+        ExplorerSort.ascending = true;
+    }
+    sortEntries(ExplorerStore, &ExplorerEntries, ExplorerSort);
+    // Sizes and permissions are only fetched for visible rows; sorting by them needs all of them
+    if(sortNeedsMetadata(ExplorerSort)) { Scanner->requestAllMetadata(); }
+}
 
-            if((mouse_click_x >= ExplorerEntries[i]->name_coordinates[0] && mouse_click_x <= ExplorerEntries[i]->name_coordinates[1]) &&
-            (mouse_click_y >= ExplorerEntries[i]->name_coordinates[2] && mouse_click_y <= ExplorerEntries[i]->name_coordinates[3])) {
-                    return ExplorerEntries[i]->filepath + "," + ExplorerEntries[i]->entrytype;
-            }
+/* Starts walking the tree under 'dirname' for the recursive view; listings arrive through receiveRecursiveEntries() */
+void buildRecursiveEntries(std::string dirname) {
+    stopWalk();
+    WatchedTreeDirs.insert(dirname);
+    Watches->watch(dirname, false);
+    RecursiveModel.reset(dirname);
+    RecursiveIndex.reset();
+    WalkFinished = false;
+    WalkedDir = dirname;
+    RecursiveList.setRowCount(0);
+    RecursiveList.scrollToTop();
+    Walker->start(dirname);
+}
+
+/* Adds the listings completed by the walker to RecursiveModel; returns true if anything arrived (the header shows the running count) */
+bool receiveRecursiveEntries() {
+    PROFILE_SCOPE("receiveRecursiveEntries");
+    std::vector<WalkListing> listings;
+    bool finished;
+    Walker->takeListings(&listings, &finished);
+    if(finished) { WalkFinished = true; }
+
+    // Listings of collapsed directories only extend the tree; the visible rows change only for expanded ones
+    for(int i = 0; i < listings.size(); i++) {
+        RecursiveModel.addListing(listings[i]);
+        Frames.addEntries(listings[i].entries.size());
+    }
+    RecursiveList.setRowCount(RecursiveModel.rowCount());
+
+    // New nodes are indexed as they arrive, and the ones matching the search are appended to its results
+    uint32_t first_new = RecursiveIndex.update(RecursiveModel);
+    if(!SearchQuery.empty() && !ContentMode) {
+        RecursiveIndex.findFrom(SearchQuery, first_new, &SearchResults);
+        SearchEntries.resize(SearchResults.size(), NO_ENTRY);
+        EntryList.setRowCount(SearchResults.size());
+    }
+    return !listings.empty() || finished;
+}
+
+/* Appends the lines the content search found since the last call to the results; returns true if the list or its
+   header changed */
+bool receiveContentMatches() {
+    PROFILE_SCOPE("receiveContentMatches");
+    std::vector<ContentMatch> matches;
+    bool finished;
+    Contents->takeMatches(&matches, &finished);
+    if(!ContentMode || SearchQuery.empty()) { return false; }
+    ContentMatches.insert(ContentMatches.end(), std::make_move_iterator(matches.begin()), std::make_move_iterator(matches.end()));
+    SearchEntries.resize(ContentMatches.size(), NO_ENTRY);
+    EntryList.setRowCount(ContentMatches.size());
+    return !matches.empty() || finished;
+}
+
+/* Starts looking for duplicate files below 'dirname' for the duplicates view; the groups arrive through receiveDuplicates() */
+void findDuplicates(const std::string& dirname) {
+    DuplicatesDir = dirname;
+    DuplicateGroups.clear();
+    DuplicateRows.clear();
+    DuplicateList.setRowCount(0);
+    DuplicateList.scrollToTop();
+    Duplicates->start(dirname);
+}
+
+/* Lays out the groups of a finished duplicate search as rows. Returns true, as even an event without groups means the
+   finder's counters in the header moved */
+bool receiveDuplicates() {
+    std::vector<DuplicateGroup> groups;
+    if(!Duplicates->takeGroups(&groups)) { return true; }
+    DuplicateGroups.swap(groups);
+    DuplicateRows.clear();
+    for(int i = 0; i < DuplicateGroups.size(); i++) {
+        DuplicateRows.push_back(std::make_pair(i, -1));
+        for(int j = 0; j < DuplicateGroups[i].paths.size(); j++) { DuplicateRows.push_back(std::make_pair(i, j)); }
+    }
+    DuplicateList.setRowCount(DuplicateRows.size());
+    return true;
+}
+
+/* Runs on SDL's timer thread once typing paused: wakes the event loop to start the content search */
+Uint32 contentSearchDue(Uint32 interval, void* serial) {
+    SDL_Event event = {};
+    event.type = ContentSearchEvent;
+    event.user.code = (Sint32)(intptr_t)serial;
+    SDL_PushEvent(&event);
+    // Fires once
+    return 0;
+}
+
+/* Starts the content search for SearchQuery below 'dirname' now if one is still waiting for typing to pause */
+void startContentSearch(const std::string& dirname) {
+    if(ContentSearchTimer == 0) { return; }
+    SDL_RemoveTimer(ContentSearchTimer);
+    ContentSearchTimer = 0;
+    Contents->start(dirname, SearchQuery);
+}
+
+/* Cancels the content search in flight, and the one waiting for typing to pause */
+void stopContentSearch() {
+    if(ContentSearchTimer != 0) {
+        SDL_RemoveTimer(ContentSearchTimer);
+        ContentSearchTimer = 0;
+    }
+    Contents->cancel();
+}
+
+/* Sets the search text to 'query' and shows what matches it in the tree under 'dirname', starting to walk that tree if
+   needed (or, in ContentMode, starting the content search); results found later stream in through receiveRecursiveEntries().
+   An empty query shows the directory again */
+void updateSearch(const std::string& query, const std::string& dirname) {
+    PROFILE_SCOPE("updateSearch");
+    // Contents are searched from scratch for every change to the query, but only once typing pauses (a search reads
+    // the whole tree, so one per keystroke would mostly be cancelled); matches stream in through receiveContentMatches()
+    if(ContentMode) {
+        SearchQuery = query;
+        ContentMatches.clear();
+        SearchEntries.clear();
+        SearchStore.reset();
+        stopContentSearch();
+        if(!query.empty()) {
+            ContentSearchSerial++;
+            ContentSearchTimer = SDL_AddTimer(CONTENT_SEARCH_DELAY, contentSearchDue, (void*)(intptr_t)ContentSearchSerial);
+            // Without a timer, search right away
+            if(ContentSearchTimer == 0) { Contents->start(dirname, query); }
         }
+        EntryList.setRowCount(SearchQuery.empty() ? ExplorerEntries.size() : 0);
+        EntryList.scrollToTop();
+        return;
+    }
+    if(!query.empty() && WalkedDir != dirname) {
+        buildRecursiveEntries(dirname);
     }
-    // Nothing important was clicked on
-    return "NULL";
+    // A query containing the previous one can only match a subset of its results
+    bool narrowed = !SearchQuery.empty() && query.find(SearchQuery) != std::string::npos;
+    std::vector<uint32_t> results;
+    if(!query.empty()) {
+        RecursiveIndex.find(query, narrowed ? &SearchResults : NULL, &results);
+    }
+    SearchQuery = query;
+    SearchResults.swap(results);
+    SearchEntries.assign(SearchResults.size(), NO_ENTRY);
+    SearchStore.reset();
+    dropRemovedResults();
+    EntryList.setRowCount(SearchQuery.empty() ? ExplorerEntries.size() : SearchResults.size());
+    EntryList.scrollToTop();
+}
+
+/* The entry on row 'row' of the entry list: a search result while searching, or the file of a content match (added to
+   SearchStore the first time it is needed) */
+RowEntry shownEntry(int row) {
+    if(SearchQuery.empty()) { return RowEntry{&ExplorerStore, ExplorerEntries[row]}; }
+    if(SearchEntries[row] == NO_ENTRY) {
+        std::string path = ContentMode ? ContentMatches[row].path : RecursiveModel.path(SearchResults[row]);
+        bool is_dir = !ContentMode && RecursiveModel.isDir(SearchResults[row]);
+        size_t slash = path.rfind('/');
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        const char* type = is_dir ? "dir" : classifyByExtension(name);
+        uint32_t parent = SearchStore.addParent(slash == std::string::npos ? "" : path.substr(0, slash));
+        // Results are shown in the order they were found, so they need no collation key
+        SearchEntries[row] = SearchStore.add(parent, name, "", entryTypeFromString(type ? type : "other"));
+    }
+    return RowEntry{&SearchStore, SearchEntries[row]};
 }
 
-/* Get a string representation of the permissions for a file using its stat structure */
-std::string getFilePermissions(struct stat info) {
-    std::string permissions = "";
-    if(info.st_mode & S_IRUSR) { permissions.append("r"); } else permissions.append("-");
-    if(info.st_mode & S_IWUSR) { permissions.append("w"); } else permissions.append("-");
-    if(info.st_mode & S_IXUSR) { permissions.append("x"); } else permissions.append("-");
-    if(info.st_mode & S_IRGRP) { permissions.append("r"); } else permissions.append("-");
-    if(info.st_mode & S_IWGRP) { permissions.append("w"); } else permissions.append("-");
-    if(info.st_mode & S_IXGRP) { permissions.append("x"); } else permissions.append("-");
-    if(info.st_mode & S_IROTH) { permissions.append("r"); } else permissions.append("-");
-    if(info.st_mode & S_IWOTH) { permissions.append("w"); } else permissions.append("-");
-    if(info.st_mode & S_IXOTH) { permissions.append("x"); } else permissions.append("-");
+/* Directory of a search result relative to the searched directory ("." for the directory itself) */
+std::string searchLocation(const EntryStore& store, uint32_t entry) {
+    const std::string& parent = store.parentPath(entry);
+    std::string location = parent.substr(std::min(WalkedDir.size(), parent.size()));
+    while(!location.empty() && location[0] == '/') { location.erase(0, 1); }
+    while(!location.empty() && location[location.size() - 1] == '/') { location.erase(location.size() - 1); }
+    return location.empty() ? "." : location;
+}
 
-    return permissions;
+/* Determine what UI element the user clicked on using x and y coordinates. Rows have a fixed height,
+   so the row under the cursor is computed directly from the scroll offset instead of searching the entries.
+   Only what the shown view draws is hit: 'recursive' is set while the recursive view is shown */
+ClickTarget parseMouseClick(int mouse_click_x, int mouse_click_y, bool recursive, TextRenderer* text) {
+    ClickTarget target = {CLICK_NONE, -1, SORT_NAME};
+    SDL_Point click = {mouse_click_x, mouse_click_y};
+
+    /**** THE RECURSIVE VIEW ONLY DRAWS ITS OWN BUTTON (its rows are handled by the event loop) ****/
+    if(recursive) {
+        if(SDL_PointInRect(&click, &SidebarButtons[CLICK_RECURSIVE - CLICK_HOME].rect)) {
+            target.kind = CLICK_RECURSIVE;
+        }
+        return target;
+    }
+
+    /**** CLICKED ON HOME, DESKTOP OR RECURSIVE VIEW ****/
+    for(int i = 0; i < SidebarButtonCount; i++) {
+        if(SDL_PointInRect(&click, &SidebarButtons[i].rect)) {
+            target.kind = SidebarButtons[i].kind;
+            return target;
+        }
+    }
+
+    /**** CLICKED ON A COLUMN HEADER (they are hidden while searching) ****/
+    for(int i = 0; i < ColumnHeaderCount && SearchQuery.empty() && !ContentMode; i++) {
+        if(SDL_PointInRect(&click, &ColumnHeaders[i].rect)) {
+            target.kind = CLICK_HEADER;
+            target.column = ColumnHeaders[i].key;
+            return target;
+        }
+    }
+
+    /**** CLICKED ON A FILE OR DIRECTORY ****/
+    int row = EntryList.rowAt(mouse_click_y);
+    if(row < 0 || row >= EntryList.rowCount()) {
+        return target;
+    }
+    RowEntry shown = shownEntry(row);
+    int row_y = EntryList.rowTop(row);
+    SDL_Rect icon = EntryRow.icon;
+    icon.y += row_y;
+    // Names are measured when drawn; measure here if the row hasn't been drawn yet
+    if(shown.store->nameWidth(shown.index) < 0) {
+        shown.store->setNameWidth(shown.index, text->measure(shown.store->name(shown.index)));
+    }
+    SDL_Rect name = {EntryRow.name.x, row_y + EntryRow.name.y, shown.store->nameWidth(shown.index), text->lineHeight()};
+    if(SDL_PointInRect(&click, &icon) || SDL_PointInRect(&click, &name)) {
+        target.kind = CLICK_ENTRY;
+        target.row = row;
+    }
+    // Nothing important was clicked on otherwise
+    return target;
 }
@@ -0,0 +1,167 @@
+#include "prefetcher.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* Milliseconds on a monotonic clock */
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Rough heap footprint of a listing, for the memory budget */
+static size_t listingBytes(const DirectoryListing& listing) {
+    size_t bytes = sizeof(DirectoryListing) + listing.metadata.size() * sizeof(FileMetadata);
+    for(size_t i = 0; i < listing.files.size(); i++) {
+        // Name and key strings with their own allocations, plus the vector slots holding them
+        bytes += listing.files[i].first.capacity() + listing.keys[i].capacity() + 2 * sizeof(std::string) + 16;
+    }
+    return bytes;
+}
+
+Prefetcher::Prefetcher(size_t memory_budget)
+    : memory_budget(memory_budget), generation(0), stopping(false), use_clock(0) {
+    counters.hits = counters.misses = counters.fetched = counters.wasted = 0;
+    counters.bytes = 0;
+    worker = std::thread(&Prefetcher::work, this);
+}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        generation++;
+        wake.notify_all();
+    }
+    worker.join();
+}
+
+void Prefetcher::setCandidates(const std::vector<std::string>& paths) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(paths == accepted) { return; }
+    accepted = paths;
+    candidates = paths;
+    generation++;
+    wake.notify_all();
+}
+
+void Prefetcher::pause() {
+    std::lock_guard<std::mutex> guard(lock);
+    candidates.clear();
+    // The same list is read ahead again once it is set after the pause
+    accepted.clear();
+    generation++;
+}
+
+std::shared_ptr<const DirectoryListing> Prefetcher::take(const std::string& path) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Cached>::iterator found = cache.find(path);
+    if(found == cache.end() || nowMs() - found->second.fetched_ms > PREFETCH_MAX_AGE_MS) {
+        counters.misses++;
+        return std::shared_ptr<const DirectoryListing>();
+    }
+    counters.hits++;
+    found->second.used = true;
+    found->second.last_used = ++use_clock;
+    return found->second.listing;
+}
+
+PrefetchStats Prefetcher::stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return counters;
+}
+
+/* Drops least recently used listings until 'needed' more bytes fit in the budget (call with 'lock' held) */
+void Prefetcher::evict(size_t needed) {
+    while(!cache.empty() && counters.bytes + needed > memory_budget) {
+        std::map<std::string, Cached>::iterator oldest = cache.begin();
+        for(std::map<std::string, Cached>::iterator it = cache.begin(); it != cache.end(); ++it) {
+            if(it->second.last_used < oldest->second.last_used) { oldest = it; }
+        }
+        if(!oldest->second.used) { counters.wasted++; }
+        counters.bytes -= oldest->second.bytes;
+        cache.erase(oldest);
+    }
+}
+
+void Prefetcher::work() {
+    PROFILE_THREAD("prefetcher");
+    // Read ahead only when nothing else wants the disk: lower this thread's priority (Linux applies nice per thread)
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+    while(true) {
+        std::vector<std::string> paths;
+        unsigned int candidates_id;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && candidates.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            paths.swap(candidates);
+            candidates_id = generation;
+        }
+        for(size_t i = 0; i < paths.size() && generation == candidates_id; i++) {
+            fetch(paths[i], candidates_id);
+        }
+    }
+}
+
+/* Reads one candidate's listing (and its first rows' metadata) unless a fresh, unchanged copy is cached */
+void Prefetcher::fetch(const std::string& path, unsigned int candidates_id) {
+    PROFILE_SCOPE("prefetch.fetch");
+    int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd < 0) { return; }
+    int64_t mtime = directoryMtime(dir_fd);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<std::string, Cached>::iterator found = cache.find(path);
+        // Still current: refresh its age instead of reading it again (a hovered directory keeps its listing warm)
+        if(found != cache.end() && found->second.listing->mtime == mtime && nowMs() - found->second.fetched_ms < PREFETCH_MAX_AGE_MS / 2) {
+            found->second.last_used = ++use_clock;
+            close(dir_fd);
+            return;
+        }
+    }
+
+    std::shared_ptr<DirectoryListing> listing = std::make_shared<DirectoryListing>();
+    if(!readDirectoryListing(dir_fd, listing.get(), &generation, candidates_id)) {
+        close(dir_fd);
+        return;
+    }
+    // The first screenful of files gets its size and permissions too, so they are on screen at once
+    size_t rows = std::min(listing->files.size(), (size_t)PREFETCH_METADATA_ROWS);
+    listing->metadata.resize(rows);
+    for(size_t i = 0; i < rows && generation == candidates_id; i++) {
+        FileMetadata& metadata = listing->metadata[i];
+        metadata.known = false;
+        if(listing->files[i].second == DT_DIR) { continue; }
+        off_t size;
+        metadata.known = fetchMetadata(dir_fd, listing->files[i].first.c_str(), &metadata.mode, &size, &metadata.mtime);
+        metadata.size = size;
+    }
+    close(dir_fd);
+
+    size_t bytes = listingBytes(*listing);
+    std::lock_guard<std::mutex> guard(lock);
+    if(bytes > memory_budget) { return; }
+    std::map<std::string, Cached>::iterator old = cache.find(path);
+    if(old != cache.end()) {
+        if(!old->second.used) { counters.wasted++; }
+        counters.bytes -= old->second.bytes;
+        cache.erase(old);
+    }
+    evict(bytes);
+    Cached cached;
+    cached.listing = listing;
+    cached.bytes = bytes;
+    cached.fetched_ms = nowMs();
+    cached.last_used = ++use_clock;
+    cached.used = false;
+    cache[path] = cached;
+    counters.bytes += bytes;
+    counters.fetched++;
+}
@@ -0,0 +1,174 @@
+#include "profiler.h"
+#include <cstdio>
+
+static const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+
+uint64_t profilerNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch).count();
+}
+
+#ifdef FE_PROFILE
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Events kept per thread; at about 30 bytes each this is under 512 KiB per thread
+#define RING_EVENTS 16384
+
+/* The fields are atomics so an export can read a ring while its thread keeps writing;
+   a slot overwritten mid-export at worst yields one event with mixed fields */
+typedef struct TraceEvent {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> duration;
+    std::atomic<int> tid;
+} TraceEvent;
+
+typedef struct ThreadRing {
+    int tid;
+    std::atomic<const char*> thread_name;
+    // Events written so far; slot 'head % RING_EVENTS' is written next
+    std::atomic<uint64_t> head;
+    bool in_use;
+    TraceEvent events[RING_EVENTS];
+} ThreadRing;
+
+// Rings outlive their threads (their events stay exportable) and are handed to new threads once free
+static std::mutex RegistryLock;
+static std::vector<ThreadRing*> Rings;
+
+/* Gives each thread a ring on its first event and frees it for reuse when the thread exits */
+struct RingOwner {
+    ThreadRing* ring;
+    RingOwner() {
+        std::lock_guard<std::mutex> guard(RegistryLock);
+        ring = NULL;
+        for(size_t i = 0; i < Rings.size() && ring == NULL; i++) {
+            if(!Rings[i]->in_use) { ring = Rings[i]; }
+        }
+        if(ring == NULL) {
+            ring = new ThreadRing();
+            ring->head = 0;
+            Rings.push_back(ring);
+        }
+        ring->in_use = true;
+        ring->tid = syscall(SYS_gettid);
+        ring->thread_name = NULL;
+    }
+    ~RingOwner() {
+        std::lock_guard<std::mutex> guard(RegistryLock);
+        ring->in_use = false;
+    }
+};
+
+static ThreadRing* threadRing() {
+    static thread_local RingOwner owner;
+    return owner.ring;
+}
+
+void profilerRecord(const char* name, uint64_t start, uint64_t end) {
+    ThreadRing* ring = threadRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head % RING_EVENTS];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.duration.store(end - start, std::memory_order_relaxed);
+    event.tid.store(ring->tid, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void profilerNameThread(const char* name) {
+    threadRing()->thread_name = name;
+}
+
+bool profilerEnabled() {
+    return true;
+}
+
+long profilerExport(const char* path) {
+    FILE* file = fopen(path, "w");
+    if(file == NULL) {
+        perror(path);
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(RegistryLock);
+    long written = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for(size_t r = 0; r < Rings.size(); r++) {
+        ThreadRing* ring = Rings[r];
+        const char* thread_name = ring->thread_name;
+        if(thread_name != NULL) {
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                    written ? ",\n" : "", ring->tid, thread_name);
+            written++;
+        }
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+        for(uint64_t i = first; i < head; i++) {
+            const TraceEvent& event = ring->events[i % RING_EVENTS];
+            // Complete events ("X") with microsecond timestamps
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    written ? ",\n" : "", event.name.load(std::memory_order_relaxed), event.tid.load(std::memory_order_relaxed),
+                    event.start.load(std::memory_order_relaxed) / 1000.0, event.duration.load(std::memory_order_relaxed) / 1000.0);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return written;
+}
+
+#else
+
+void profilerRecord(const char*, uint64_t, uint64_t) {}
+void profilerNameThread(const char*) {}
+bool profilerEnabled() { return false; }
+long profilerExport(const char*) { return -1; }
+
+#endif
+
+FrameStats::FrameStats() : last_ms(0), average_ms(0) {
+    for(int i = 0; i < FRAME_ARRIVAL_BUCKETS; i++) {
+        arrival_slot[i] = -1;
+        arrival_count[i] = 0;
+    }
+}
+
+/* Index of the current 100 ms slot of the steady clock */
+static int64_t arrivalSlot() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 100;
+}
+
+void FrameStats::beginFrame() {
+    frame_start = std::chrono::steady_clock::now();
+}
+
+void FrameStats::endFrame() {
+    last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+    // Exponential moving average over roughly the last 20 frames
+    average_ms = average_ms == 0 ? last_ms : average_ms * 0.95 + last_ms * 0.05;
+}
+
+/* A bucket still holding a slot from a second or more ago is reused, so this takes fixed memory however often it is called */
+void FrameStats::addEntries(int count) {
+    if(count <= 0) { return; }
+    int64_t slot = arrivalSlot();
+    int bucket = slot % FRAME_ARRIVAL_BUCKETS;
+    if(arrival_slot[bucket] != slot) {
+        arrival_slot[bucket] = slot;
+        arrival_count[bucket] = 0;
+    }
+    arrival_count[bucket] += count;
+}
+
+double FrameStats::entriesPerSecond() {
+    int64_t slot = arrivalSlot();
+    int64_t total = 0;
+    for(int i = 0; i < FRAME_ARRIVAL_BUCKETS; i++) {
+        if(arrival_slot[i] > slot - FRAME_ARRIVAL_BUCKETS) { total += arrival_count[i]; }
+    }
+    return total;
+}
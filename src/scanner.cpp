@@ -0,0 +1,451 @@
+#include "scanner.h"
+#include "sorter.h"
+#include "filetypes.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The first batch is sized to fill the window so it can be drawn right away; later ones are larger
+#define FIRST_BATCH_SIZE 16
+#define BATCH_SIZE 256
+
+// Buffer getdents64() fills with directory records; large enough for thousands of names per call
+#define DIRENT_BUFFER_SIZE (256 * 1024)
+
+// What is still unknown about a published entry
+#define MISSING_METADATA 1
+#define MISSING_TYPE 2
+
+/* statx() is asked for only the fields the list view (and its thumbnails) need and is allowed to use cached
+   attributes, which saves round trips on network file systems */
+bool fetchMetadata(int dir_fd, const char* name, mode_t* mode, off_t* size, int64_t* mtime) {
+    PROFILE_SCOPE("scan.statx");
+#ifdef STATX_MODE
+    struct statx stx;
+    if(statx(dir_fd, name, AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, &stx) == 0) {
+        *mode = stx.stx_mode;
+        *size = stx.stx_size;
+        *mtime = (int64_t)stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+        return true;
+    }
+    if(errno != ENOSYS) { return false; }
+#endif
+    struct stat info;
+    if(fstatat(dir_fd, name, &info, 0) != 0) { return false; }
+    *mode = info.st_mode;
+    *size = info.st_size;
+    *mtime = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    return true;
+}
+
+int64_t directoryMtime(int dir_fd) {
+    struct stat info;
+    if(fstat(dir_fd, &info) != 0) { return -1; }
+    return (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+}
+
+bool readDirectoryListing(int dir_fd, DirectoryListing* out, const std::atomic<unsigned int>* generation, unsigned int id) {
+    // Taken before reading, so a change made while reading makes the listing look stale rather than current
+    out->mtime = directoryMtime(dir_fd);
+    out->files.clear();
+    out->keys.clear();
+    out->metadata.clear();
+    // The descriptor may have been read before (a watcher listing a directory again)
+    if(lseek(dir_fd, 0, SEEK_SET) != 0) { return false; }
+    // Read in the names and types; sorting them before anything else lets the first screenful be published immediately
+    {
+        PROFILE_SCOPE("scan.getdents");
+        std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+        while(true) {
+            if(*generation != id) { return false; }
+            ssize_t length = getdents64(dir_fd, buffer.data(), buffer.size());
+            if(length < 0) { return false; }
+            if(length == 0) { break; }
+            // Records are variable length: d_reclen leads from one to the next
+            for(ssize_t at = 0; at < length; ) {
+                const struct dirent64* entry = (const struct dirent64*)(buffer.data() + at);
+                at += entry->d_reclen;
+                // Ignore the "." directory
+                if(entry->d_name[0] == '.' && entry->d_name[1] == '\0') { continue; }
+                out->files.push_back(std::make_pair(std::string(entry->d_name), entry->d_type));
+            }
+        }
+    }
+    PROFILE_SCOPE("scan.sort");
+    sortByName(&out->files, [](const std::pair<std::string, unsigned char>& file) -> const std::string& { return file.first; }, &out->keys);
+    return true;
+}
+
+/* Type of a regular file from its name; 'mode' is only consulted when it is known.
+   Sets 'sniff' when the name doesn't decide the type and the contents have to (see sniffFileType()) */
+static EntryType classifyFile(const std::string& name, bool mode_known, mode_t mode, bool* sniff) {
+    *sniff = false;
+    // EXECUTABLE (the current user has execute permissions)
+    if(mode_known && (mode & S_IXUSR)) { return ENTRY_EXE; }
+
+    const char* type = classifyByExtension(name);
+    if(type != NULL) { return entryTypeFromString(type); }
+    *sniff = true;
+    return ENTRY_OTHER;
+}
+
+void DirectoryScanner::NameList::add(const char* name, size_t length) {
+    starts.push_back(chars.size());
+    chars.insert(chars.end(), name, name + length + 1);
+}
+
+DirectoryScanner::DirectoryScanner(Uint32 notify_event)
+    : notify_event(notify_event), generation(0), pending_finished(false), pending_stale(false), listed_mtime(-1),
+      notified(false), requested_all(false) {
+}
+
+DirectoryScanner::~DirectoryScanner() {
+    cancel();
+    // Only here are the workers waited for; they all stop soon after the generation changed
+    if(worker.joinable()) { worker.join(); }
+    for(int i = 0; i < retired.size(); i++) {
+        retired[i].join();
+    }
+}
+
+/* Doesn't wait for the worker: it notices the generation change on its own (between entries, or while it waits
+   for requests) and whatever it still publishes is dropped. A worker stuck on a slow mount can't hold up the UI */
+void DirectoryScanner::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+    requested.notify_all();
+    if(worker.joinable()) { retired.push_back(std::move(worker)); }
+    // Reap the workers that returned since; the rest are joined by a later cancel() or the destructor
+    for(int i = 0; i < retired.size(); ) {
+        std::vector<std::thread::id>::iterator done = std::find(exited.begin(), exited.end(), retired[i].get_id());
+        if(done == exited.end()) { i++; continue; }
+        exited.erase(done);
+        retired[i].join();
+        retired.erase(retired.begin() + i);
+    }
+    pending.clear();
+    pending_metadata.clear();
+    pending_finished = false;
+    pending_stale = false;
+    listed_mtime = -1;
+    notified = false;
+    requested_rows.clear();
+    requested_all = false;
+}
+
+/* Called by a worker as the last thing it does, so cancel() can join it without waiting */
+void DirectoryScanner::markExited() {
+    std::lock_guard<std::mutex> guard(lock);
+    exited.push_back(std::this_thread::get_id());
+}
+
+void DirectoryScanner::start(const std::string& dirname, std::shared_ptr<const DirectoryListing> prefetched) {
+    cancel();
+    unsigned int scan_id = generation.load();
+    worker = std::thread([this, dirname, prefetched, scan_id]() {
+        run(dirname, prefetched, scan_id);
+        markExited();
+    });
+}
+
+void DirectoryScanner::resume(const std::string& dirname, const EntryStore& entries, int64_t mtime) {
+    cancel();
+    std::shared_ptr<NameList> names = std::make_shared<NameList>();
+    names->chars.reserve(entries.count() * 16);
+    names->starts.reserve(entries.count());
+    // Unknown rows lack what a fresh scan would leave out: the metadata, and the contents' type if the name doesn't decide it
+    std::vector<unsigned char> missing(entries.count(), 0);
+    for(uint32_t i = 0; i < entries.count(); i++) {
+        names->add(entries.name(i), entries.nameLength(i));
+        if(entries.isRemoved(i) || entries.type(i) == ENTRY_DIR || entries.hasMetadata(i)) { continue; }
+        missing[i] = MISSING_METADATA;
+        if(classifyByExtension(entries.name(i)) == NULL) { missing[i] |= MISSING_TYPE; }
+    }
+    unsigned int scan_id = generation.load();
+    worker = std::thread([this, dirname, names, missing, mtime, scan_id]() {
+        runResumed(dirname, names, missing, mtime, scan_id);
+        markExited();
+    });
+}
+
+void DirectoryScanner::takeEntries(std::vector<ScannedEntry>* out, bool* finished, bool* stale) {
+    std::vector<ScannedEntry> front;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        front.swap(pending);
+        *finished = pending_finished;
+        *stale = pending_stale;
+        pending_finished = false;
+        pending_stale = false;
+        notified = false;
+    }
+    if(out->empty()) {
+        out->swap(front);
+    } else {
+        out->insert(out->end(), std::make_move_iterator(front.begin()), std::make_move_iterator(front.end()));
+    }
+}
+
+int64_t DirectoryScanner::listedMtime() {
+    std::lock_guard<std::mutex> guard(lock);
+    return listed_mtime;
+}
+
+void DirectoryScanner::takeMetadata(std::vector<EntryMetadata>* out) {
+    std::vector<EntryMetadata> front;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        front.swap(pending_metadata);
+        notified = false;
+    }
+    out->insert(out->end(), std::make_move_iterator(front.begin()), std::make_move_iterator(front.end()));
+}
+
+void DirectoryScanner::requestMetadata(const std::vector<int>& indices) {
+    std::lock_guard<std::mutex> guard(lock);
+    requested_rows = indices;
+    requested.notify_all();
+}
+
+void DirectoryScanner::requestAllMetadata() {
+    std::lock_guard<std::mutex> guard(lock);
+    requested_all = true;
+    requested.notify_all();
+}
+
+/* Pushes the notify event unless one is already waiting in the queue (call with 'lock' held) */
+void DirectoryScanner::wakeUI() {
+    if(notified) { return; }
+    notified = true;
+    SDL_Event event = {};
+    event.type = notify_event;
+    SDL_PushEvent(&event);
+}
+
+/* Hands a batch to the UI thread, unless the scan has been cancelled in the meantime */
+void DirectoryScanner::publish(std::vector<ScannedEntry>* batch, bool last, unsigned int scan_id) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(generation != scan_id) { return; }
+    if(pending.empty()) {
+        pending.swap(*batch);
+    } else {
+        pending.insert(pending.end(), std::make_move_iterator(batch->begin()), std::make_move_iterator(batch->end()));
+    }
+    batch->clear();
+    pending_finished = last;
+    // One queued event is enough, the UI thread takes everything pending when it handles it
+    wakeUI();
+}
+
+void DirectoryScanner::publishMetadata(std::vector<EntryMetadata>* batch, unsigned int scan_id) {
+    if(batch->empty()) { return; }
+    std::lock_guard<std::mutex> guard(lock);
+    if(generation != scan_id) { return; }
+    pending_metadata.insert(pending_metadata.end(), std::make_move_iterator(batch->begin()), std::make_move_iterator(batch->end()));
+    batch->clear();
+    wakeUI();
+}
+
+/* Lists everything (files and directories) inside directory 'dirname', then serves metadata requests for it until cancelled */
+void DirectoryScanner::run(std::string dirname, std::shared_ptr<const DirectoryListing> prefetched, unsigned int scan_id) {
+    PROFILE_THREAD("scanner");
+    std::vector<ScannedEntry> batch;
+
+    // Opening with O_DIRECTORY checks that dirname exists and is a directory without a separate stat()
+    int dir_fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DirectoryListing listing;
+    bool listed = false;
+    if(dir_fd >= 0 && prefetched && prefetched->mtime >= 0 && prefetched->mtime == directoryMtime(dir_fd)) {
+        listing = *prefetched;
+        listed = true;
+    } else if(dir_fd >= 0) {
+        listed = readDirectoryListing(dir_fd, &listing, &generation, scan_id);
+        if(!listed && generation != scan_id) { close(dir_fd); return; }
+    }
+    if(!listed) {
+        fprintf(stderr, "Error: directory argument passed into getDirectoryEntries '%s' not found\n", dirname.c_str());
+        if(dir_fd >= 0) { close(dir_fd); }
+        publish(&batch, true, scan_id);
+        return;
+    }
+    std::vector<std::pair<std::string, unsigned char> >& files = listing.files;
+    std::vector<std::string>& keys = listing.keys;
+
+    // Name of every published entry (in publishing order), and what is still unknown about it (MISSING_* bits)
+    NameList published;
+    published.starts.reserve(files.size());
+    std::vector<unsigned char> missing;
+    size_t batch_limit = FIRST_BATCH_SIZE;
+
+    for(int i = 0; i < files.size(); i++) {
+        // A newer navigation request replaced this scan
+        if(generation != scan_id) { close(dir_fd); return; }
+
+        ScannedEntry scanned;
+        scanned.name = files[i].first;
+        scanned.size = -1;
+        scanned.modified = -1;
+        scanned.mode = 0;
+        scanned.sort_key = std::move(keys[i]);
+        bool sniff = false;
+
+        unsigned char d_type = files[i].second;
+        // A prefetched listing may carry the metadata of its first rows
+        bool known = i < listing.metadata.size() && listing.metadata[i].known;
+        mode_t mode = known ? listing.metadata[i].mode : 0;
+        off_t size = known ? listing.metadata[i].size : 0;
+        int64_t mtime = known ? listing.metadata[i].mtime : -1;
+        if(d_type == DT_DIR) {
+            // Directories show neither size nor permissions, so they never need a stat
+            scanned.type = ENTRY_DIR;
+        } else if(d_type == DT_REG && !known) {
+            scanned.type = classifyFile(scanned.name, false, 0, &sniff);
+        } else if(d_type == DT_REG || d_type == DT_UNKNOWN || d_type == DT_LNK) {
+            // The file system didn't say (or it's a symlink, which is followed), so the type has to come from statx
+            if(!known && !fetchMetadata(dir_fd, scanned.name.c_str(), &mode, &size, &mtime)) { continue; }
+            if(S_ISDIR(mode)) {
+                scanned.type = ENTRY_DIR;
+            } else if(S_ISREG(mode)) {
+                scanned.type = classifyFile(scanned.name, true, mode, &sniff);
+                scanned.size = size;
+                scanned.modified = mtime;
+                scanned.mode = mode;
+            } else {
+                continue;
+            }
+        } else {
+            // Not a directory or regular file
+            continue;
+        }
+
+        published.add(files[i].first.c_str(), files[i].first.size());
+        unsigned char unknown = 0;
+        if(scanned.type != ENTRY_DIR && scanned.mode == 0) { unknown |= MISSING_METADATA; }
+        if(sniff) { unknown |= MISSING_TYPE; }
+        missing.push_back(unknown);
+        batch.push_back(std::move(scanned));
+        if(batch.size() >= batch_limit) {
+            publish(&batch, false, scan_id);
+            batch_limit = BATCH_SIZE;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(generation == scan_id) { listed_mtime = listing.mtime; }
+    }
+    publish(&batch, true, scan_id);
+    serve(dir_fd, published, missing, scan_id);
+    close(dir_fd);
+}
+
+/* Reopens 'dirname' and, if it hasn't changed since 'mtime', serves metadata requests for entries a previous scan published */
+void DirectoryScanner::runResumed(std::string dirname, std::shared_ptr<NameList> published, std::vector<unsigned char> missing,
+                                  int64_t mtime, unsigned int scan_id) {
+    PROFILE_THREAD("scanner");
+    int dir_fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    // Checked here rather than by the UI, which must not wait on a slow mount
+    if(dir_fd < 0 || mtime < 0 || directoryMtime(dir_fd) != mtime) {
+        if(dir_fd >= 0) { close(dir_fd); }
+        std::lock_guard<std::mutex> guard(lock);
+        if(generation != scan_id) { return; }
+        pending_stale = true;
+        wakeUI();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(generation == scan_id) { listed_mtime = mtime; }
+    }
+    serve(dir_fd, *published, missing, scan_id);
+    close(dir_fd);
+}
+
+/* Fetches size and permissions (and sniffs types) only for the rows the UI asks for, until the next scan replaces this one */
+void DirectoryScanner::serve(int dir_fd, const NameList& published, std::vector<unsigned char>& missing, unsigned int scan_id) {
+    std::vector<EntryMetadata> updates;
+    // Row and the MISSING_* bits wanted for it
+    std::vector<std::pair<int, unsigned char> > rows;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(generation == scan_id) {
+                rows.clear();
+                // Rows on screen get everything they lack
+                for(int i = 0; i < requested_rows.size(); i++) {
+                    int row = requested_rows[i];
+                    if(row >= 0 && row < published.size() && missing[row]) { rows.push_back(std::make_pair(row, missing[row])); }
+                }
+                // A request for every entry (to sort by size) only needs the metadata; reading contents is left to visible rows
+                if(requested_all) {
+                    for(int i = 0; i < published.size(); i++) {
+                        if(missing[i] & MISSING_METADATA) { rows.push_back(std::make_pair(i, (unsigned char)MISSING_METADATA)); }
+                    }
+                    requested_all = false;
+                }
+                if(!rows.empty()) { break; }
+                requested.wait(guard);
+            }
+            if(generation != scan_id) { break; }
+        }
+
+        for(int i = 0; i < rows.size() && generation == scan_id; i++) {
+            int row = rows[i].first;
+            unsigned char work = rows[i].second & missing[row];
+            if(!work) { continue; }
+            missing[row] &= ~work;
+            const char* name = published[row];
+
+            // Updates always carry the metadata, so a sniffed row fetches it again even if it was known
+            mode_t mode;
+            off_t size;
+            int64_t mtime;
+            if(!fetchMetadata(dir_fd, name, &mode, &size, &mtime)) { continue; }
+            EntryMetadata metadata;
+            metadata.index = row;
+            metadata.size = size;
+            metadata.modified = mtime;
+            metadata.mode = mode;
+            metadata.executable = S_ISREG(mode) && (mode & S_IXUSR);
+            metadata.typed = false;
+            metadata.type = ENTRY_OTHER;
+            // Executables are typed by their permissions; anything else undecided by its name is typed by its first bytes
+            if((work & MISSING_TYPE) && !metadata.executable) {
+                PROFILE_SCOPE("scan.sniff");
+                const char* type = sniffFileType(dir_fd, name);
+                if(type != NULL) {
+                    metadata.typed = true;
+                    metadata.type = entryTypeFromString(type);
+                }
+            }
+            updates.push_back(metadata);
+            // Long requests (every entry, for sorting) are shown progressively
+            if(updates.size() >= BATCH_SIZE) { publishMetadata(&updates, scan_id); }
+        }
+        publishMetadata(&updates, scan_id);
+    }
+}
+
+/* Get a string representation of the permissions for a file using its stat structure */
+std::string getFilePermissions(struct stat info) {
+    return getFilePermissions(info.st_mode);
+}
+
+/* Get a string representation of the permissions for a file using its mode bits */
+std::string getFilePermissions(mode_t mode) {
+    std::string permissions = "";
+    if(mode & S_IRUSR) { permissions.append("r"); } else permissions.append("-");
+    if(mode & S_IWUSR) { permissions.append("w"); } else permissions.append("-");
+    if(mode & S_IXUSR) { permissions.append("x"); } else permissions.append("-");
+    if(mode & S_IRGRP) { permissions.append("r"); } else permissions.append("-");
+    if(mode & S_IWGRP) { permissions.append("w"); } else permissions.append("-");
+    if(mode & S_IXGRP) { permissions.append("x"); } else permissions.append("-");
+    if(mode & S_IROTH) { permissions.append("r"); } else permissions.append("-");
+    if(mode & S_IWOTH) { permissions.append("w"); } else permissions.append("-");
+    if(mode & S_IXOTH) { permissions.append("x"); } else permissions.append("-");
+
+    return permissions;
+}
@@ -0,0 +1,134 @@
+#include "searchindex.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <string.h>
+
+static inline unsigned char foldByte(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static std::string foldQuery(const std::string& query) {
+    std::string folded(query);
+    for(size_t i = 0; i < folded.size(); i++) { folded[i] = foldByte(folded[i]); }
+    return folded;
+}
+
+/* Trigram starting at 'text' (three already folded bytes) */
+static inline uint32_t trigram(const char* text) {
+    return (uint32_t)(unsigned char)text[0] << 16 | (uint32_t)(unsigned char)text[1] << 8 | (unsigned char)text[2];
+}
+
+SearchIndex::SearchIndex() {
+    reset();
+}
+
+void SearchIndex::reset() {
+    postings.clear();
+    folded_names.clear();
+    // Node 0 (the root) is never a result; it gets an empty slot so node ids index folded_starts directly
+    folded_starts.assign(2, 0);
+    indexed_end = 1;
+}
+
+/* Does the name of 'node' contain 'folded' (an already case folded query)? */
+bool SearchIndex::contains(uint32_t node, const std::string& folded) const {
+    size_t length = folded_starts[node + 1] - folded_starts[node] - 1;
+    return memmem(&folded_names[folded_starts[node]], length, folded.data(), folded.size()) != NULL;
+}
+
+uint32_t SearchIndex::update(const TreeModel& model) {
+    PROFILE_SCOPE("search.index");
+    uint32_t first = indexed_end;
+    uint32_t end = model.size() + 1;
+    std::vector<uint32_t> grams;
+    for(uint32_t node = first; node < end; node++) {
+        const char* name = model.name(node);
+        size_t start = folded_names.size();
+        for(const char* c = name; *c; c++) { folded_names.push_back(foldByte(*c)); }
+        folded_names.push_back('\0');
+        folded_starts.push_back(folded_names.size());
+        const char* folded = &folded_names[start];
+        size_t length = folded_names.size() - start - 1;
+        if(length < 3) { continue; }
+        grams.clear();
+        for(size_t i = 0; i + 3 <= length; i++) { grams.push_back(trigram(folded + i)); }
+        // A name repeating a trigram is listed once under it
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        for(size_t i = 0; i < grams.size(); i++) {
+            postings[grams[i]].push_back(node);
+        }
+    }
+    indexed_end = end;
+    return first;
+}
+
+void SearchIndex::find(const std::string& query, const std::vector<uint32_t>* narrowing, std::vector<uint32_t>* out) const {
+    PROFILE_SCOPE("search.find");
+    out->clear();
+    std::string folded = foldQuery(query);
+
+    // The lists of every trigram of the query, shortest first; a trigram no name has means no results
+    std::vector<const std::vector<uint32_t>*> lists;
+    for(size_t i = 0; i + 3 <= folded.size(); i++) {
+        auto found = postings.find(trigram(&folded[i]));
+        if(found == postings.end()) { return; }
+        lists.push_back(&found->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+
+    // Queries shorter than a trigram (and refinements of a query with few results) are checked name by name
+    if(lists.empty() || (narrowing != NULL && narrowing->size() <= lists[0]->size())) {
+        if(narrowing != NULL) {
+            for(size_t i = 0; i < narrowing->size(); i++) {
+                if(contains((*narrowing)[i], folded)) { out->push_back((*narrowing)[i]); }
+            }
+        } else {
+            findFrom(query, 1, out);
+        }
+        return;
+    }
+
+    // Every candidate from the shortest list must be in all the others. They are sorted, so each candidate is looked
+    // for by galloping forward from the previous one: cheap when the lists are alike, logarithmic when they aren't
+    std::vector<uint32_t> candidates(*lists[0]);
+    for(size_t l = 1; l < lists.size() && !candidates.empty(); l++) {
+        const uint32_t* from = lists[l]->data();
+        const uint32_t* end = from + lists[l]->size();
+        size_t kept = 0;
+        for(size_t i = 0; i < candidates.size() && from < end; i++) {
+            size_t step = 1;
+            while(from + step < end && from[step] < candidates[i]) { step *= 2; }
+            from = std::lower_bound(from, std::min(from + step + 1, end), candidates[i]);
+            if(from < end && *from == candidates[i]) { candidates[kept++] = candidates[i]; }
+        }
+        candidates.resize(kept);
+    }
+    // Having all the trigrams doesn't mean having them in a row ("abcXbcd" for "abcd")
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(folded.size() == 3 || contains(candidates[i], folded)) { out->push_back(candidates[i]); }
+    }
+}
+
+void SearchIndex::findFrom(const std::string& query, uint32_t first, std::vector<uint32_t>* out) const {
+    std::string folded = foldQuery(query);
+    first = std::max(first, (uint32_t)1);
+    if(first >= indexed_end || folded.empty()) {
+        for(uint32_t node = first; node < indexed_end && folded.empty(); node++) { out->push_back(node); }
+        return;
+    }
+    // Search the names of the whole range in one go; the query has no NUL, so a match never spans two names
+    const char* begin = &folded_names[0];
+    const char* at = begin + folded_starts[first];
+    const char* end = begin + folded_starts[indexed_end];
+    uint32_t node = first;
+    while(at < end) {
+        const char* match = (const char*)memmem(at, end - at, folded.data(), folded.size());
+        if(match == NULL) { break; }
+        // Names are in node order, so the node holding the match is found by moving forward from the last one
+        while(begin + folded_starts[node + 1] <= match) { node++; }
+        out->push_back(node);
+        at = begin + folded_starts[node + 1];
+    }
+}
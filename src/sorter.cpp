@@ -0,0 +1,82 @@
+#include "sorter.h"
+#include <cctype>
+#include <cstring>
+
+/* Builds the collation key of a name: letters are folded to lowercase and every run of digits
+   becomes '0', the run's length (leading zeros dropped) and the digits, so longer numbers sort
+   after shorter ones and equal-length numbers compare digit by digit */
+std::string collationKey(const std::string& name) {
+    std::string key;
+    key.reserve(name.size() + 4);
+    size_t i = 0;
+    while(i < name.size()) {
+        unsigned char c = name[i];
+        if(!isdigit(c)) {
+            key.push_back(tolower(c));
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while(i < name.size() && isdigit((unsigned char)name[i])) { i++; }
+        // "007" and "7" get the same key; the raw name breaks the tie
+        while(start + 1 < i && name[start] == '0') { start++; }
+        size_t length = std::min<size_t>(i - start, 255);
+        key.push_back('0');
+        key.push_back((char)length);
+        key.append(name, start, i - start);
+    }
+    return key;
+}
+
+/* Comparison by name: collation key first, then the raw name */
+static int compareNames(const EntryStore& store, uint32_t a, uint32_t b) {
+    size_t a_length = store.keyLength(a), b_length = store.keyLength(b);
+    int cmp = memcmp(store.key(a), store.key(b), std::min(a_length, b_length));
+    if(cmp != 0) { return cmp; }
+    if(a_length != b_length) { return a_length < b_length ? -1 : 1; }
+    return strcmp(store.name(a), store.name(b));
+}
+
+/* Three-way comparison of two entries by 'key', falling back to the name */
+static int compareEntries(const EntryStore& store, uint32_t a, uint32_t b, SortKey key) {
+    int cmp = 0;
+    if(key == SORT_SIZE) {
+        // Entries whose size isn't known yet (-1; directories until their total is added up) come first
+        cmp = (store.size(a) > store.size(b)) - (store.size(a) < store.size(b));
+    } else if(key == SORT_TYPE) {
+        cmp = (int)store.type(a) - (int)store.type(b);
+    } else if(key == SORT_PERMISSIONS) {
+        // "rwxr-xr-x" compares character by character like the nine permission bits compare as a number, with a
+        // set bit after a clear one; entries whose permissions aren't known come first
+        uint32_t a_bits = store.hasMetadata(a) ? 01000 | (store.mode(a) & 0777) : 0;
+        uint32_t b_bits = store.hasMetadata(b) ? 01000 | (store.mode(b) & 0777) : 0;
+        cmp = (a_bits > b_bits) - (a_bits < b_bits);
+    }
+    if(cmp != 0) { return cmp; }
+    return compareNames(store, a, b);
+}
+
+/* Strict weak ordering of entries for one SortOrder */
+struct EntryLess {
+    const EntryStore* store;
+    SortOrder order;
+    bool operator()(uint32_t a, uint32_t b) const {
+        int cmp = compareEntries(*store, a, b, order.key);
+        return order.ascending ? cmp < 0 : cmp > 0;
+    }
+};
+
+void sortEntries(const EntryStore& store, std::vector<uint32_t>* entries, SortOrder order) {
+    EntryLess less = {&store, order};
+    parallelSort(entries->begin(), entries->end(), less);
+}
+
+void mergeEntries(const EntryStore& store, std::vector<uint32_t>* entries, size_t sorted_count, SortOrder order) {
+    EntryLess less = {&store, order};
+    parallelSort(entries->begin() + sorted_count, entries->end(), less);
+    std::inplace_merge(entries->begin(), entries->begin() + sorted_count, entries->end(), less);
+}
+
+bool sortNeedsMetadata(SortOrder order) {
+    return order.key == SORT_SIZE || order.key == SORT_PERMISSIONS;
+}
@@ -0,0 +1,229 @@
+#include "textrenderer.h"
+#include "profiler.h"
+#include <cstdio>
+#include <algorithm>
+
+/* Decodes the next code point of a UTF-8 string; invalid bytes are taken as Latin-1 so nothing is dropped */
+static Uint32 nextCodepoint(const std::string& text, size_t* pos) {
+    unsigned char c = text[*pos];
+    int length = 1;
+    Uint32 codepoint = c;
+    if(c >= 0xC0 && c < 0xE0) { length = 2; codepoint = c & 0x1F; }
+    else if(c >= 0xE0 && c < 0xF0) { length = 3; codepoint = c & 0x0F; }
+    else if(c >= 0xF0 && c < 0xF8) { length = 4; codepoint = c & 0x07; }
+
+    if(length > 1) {
+        if(*pos + length > text.size()) {
+            length = 1;
+            codepoint = c;
+        } else {
+            for(int i = 1; i < length; i++) {
+                unsigned char next = text[*pos + i];
+                if((next & 0xC0) != 0x80) { length = 1; codepoint = c; break; }
+                codepoint = (codepoint << 6) | (next & 0x3F);
+            }
+        }
+    }
+    *pos += length;
+    return codepoint;
+}
+
+TextRenderer::TextRenderer()
+    : renderer(NULL), font(NULL), line_height(0), pen_x(0), pen_y(0), shelf_height(0) {
+    for(int i = 0; i < 128; i++) { ascii_loaded[i] = false; }
+}
+
+TextRenderer::~TextRenderer() {
+    unload();
+}
+
+bool TextRenderer::load(SDL_Renderer* target, const char* font_path, int point_size) {
+    renderer = target;
+    font = TTF_OpenFont(font_path, point_size);
+    if(font == NULL) {
+        fprintf(stderr, "Error: could not open font '%s'\n", font_path);
+        return false;
+    }
+    line_height = TTF_FontHeight(font);
+
+    atlas.reset(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, ATLAS_SIZE, ATLAS_SIZE));
+    if(!atlas) {
+        fprintf(stderr, "Error: could not create glyph atlas: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(atlas.get(), SDL_BLENDMODE_BLEND);
+
+    // Everything a typical file name needs is rasterized up front
+    for(Uint32 c = 32; c < 127; c++) { glyph(c); }
+    return true;
+}
+
+void TextRenderer::unload() {
+    atlas.reset();
+    if(font != NULL) { TTF_CloseFont(font); }
+    font = NULL;
+    extended.clear();
+    for(int i = 0; i < 128; i++) { ascii_loaded[i] = false; }
+    pen_x = pen_y = shelf_height = 0;
+}
+
+/* Renders one glyph (white, so vertex colors can tint it) and copies it into the next free spot of the atlas */
+bool TextRenderer::rasterize(Uint32 codepoint, Glyph* out) {
+    PROFILE_SCOPE("text.rasterize");
+    // SDL_ttf glyph functions only take code points from the Basic Multilingual Plane
+    if(codepoint > 0xFFFF || !TTF_GlyphIsProvided(font, (Uint16)codepoint)) {
+        return false;
+    }
+    int minx, maxx, miny, maxy, advance;
+    TTF_GlyphMetrics(font, (Uint16)codepoint, &minx, &maxx, &miny, &maxy, &advance);
+    out->advance = advance;
+    out->offset_x = std::min(0, minx);
+    out->src = {0, 0, 0, 0};
+
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface *surf = TTF_RenderGlyph_Blended(font, (Uint16)codepoint, white);
+    if(surf == NULL) {
+        // Glyphs without pixels (like space) only advance the pen
+        return true;
+    }
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(surf);
+    if(converted == NULL) {
+        return true;
+    }
+
+    // Start a new shelf when the current one is full; give up once the atlas is
+    if(pen_x + converted->w > ATLAS_SIZE) {
+        pen_x = 0;
+        pen_y += shelf_height + 1;
+        shelf_height = 0;
+    }
+    if(pen_y + converted->h > ATLAS_SIZE) {
+        SDL_FreeSurface(converted);
+        return false;
+    }
+
+    out->src = {pen_x, pen_y, converted->w, converted->h};
+    {
+        PROFILE_SCOPE("text.upload");
+        SDL_UpdateTexture(atlas.get(), &out->src, converted->pixels, converted->pitch);
+    }
+    pen_x += converted->w + 1;
+    shelf_height = std::max(shelf_height, converted->h);
+    SDL_FreeSurface(converted);
+    return true;
+}
+
+/* Looks up a glyph, rasterizing it on first use. Characters the font (or the atlas) can't hold fall back to '?', and
+   the fallback is remembered in their place so they aren't rasterized again every frame ('?' itself draws nothing) */
+const TextRenderer::Glyph* TextRenderer::glyph(Uint32 codepoint) {
+    if(codepoint < 128) {
+        if(!ascii_loaded[codepoint]) {
+            if(!rasterize(codepoint, &ascii[codepoint])) {
+                ascii[codepoint] = fallbackGlyph(codepoint);
+            }
+            ascii_loaded[codepoint] = true;
+        }
+        return &ascii[codepoint];
+    }
+
+    auto found = extended.find(codepoint);
+    if(found != extended.end()) {
+        return &found->second;
+    }
+    Glyph g;
+    if(!rasterize(codepoint, &g)) {
+        g = fallbackGlyph(codepoint);
+    }
+    return &(extended[codepoint] = g);
+}
+
+/* What is drawn for a character that couldn't be rasterized: '?', or nothing if that failed too */
+TextRenderer::Glyph TextRenderer::fallbackGlyph(Uint32 codepoint) {
+    if(codepoint != '?') { return *glyph('?'); }
+    Glyph empty = {{0, 0, 0, 0}, 0, 0};
+    return empty;
+}
+
+/* Appends a textured quad, trimming it (and its source rectangle) against the clip rectangle */
+void TextRenderer::pushQuad(SDL_Rect dst, SDL_Rect src, SDL_Color color, const SDL_Rect* clip) {
+    if(clip != NULL) {
+        int left = std::max(dst.x, clip->x);
+        int top = std::max(dst.y, clip->y);
+        int right = std::min(dst.x + dst.w, clip->x + clip->w);
+        int bottom = std::min(dst.y + dst.h, clip->y + clip->h);
+        if(left >= right || top >= bottom) { return; }
+        // Glyphs are drawn 1:1, so trimming the destination trims the source by the same amount
+        src.x += left - dst.x;
+        src.y += top - dst.y;
+        src.w = right - left;
+        src.h = bottom - top;
+        dst = {left, top, right - left, bottom - top};
+    }
+
+    float u0 = (float)src.x / ATLAS_SIZE;
+    float v0 = (float)src.y / ATLAS_SIZE;
+    float u1 = (float)(src.x + src.w) / ATLAS_SIZE;
+    float v1 = (float)(src.y + src.h) / ATLAS_SIZE;
+    float x0 = (float)dst.x;
+    float y0 = (float)dst.y;
+    float x1 = (float)(dst.x + dst.w);
+    float y1 = (float)(dst.y + dst.h);
+
+    int base = vertices.size();
+    vertices.push_back({{x0, y0}, color, {u0, v0}});
+    vertices.push_back({{x1, y0}, color, {u1, v0}});
+    vertices.push_back({{x1, y1}, color, {u1, v1}});
+    vertices.push_back({{x0, y1}, color, {u0, v1}});
+    int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+    indices.insert(indices.end(), quad, quad + 6);
+}
+
+int TextRenderer::drawText(const std::string& text, int x, int y, SDL_Color color, const SDL_Rect* clip) {
+    if(font == NULL) { return 0; }
+    int pen = x;
+    Uint32 previous = 0;
+    size_t pos = 0;
+    while(pos < text.size()) {
+        Uint32 codepoint = nextCodepoint(text, &pos);
+        const Glyph* g = glyph(codepoint);
+        if(g == NULL) { continue; }
+        if(previous != 0 && previous <= 0xFFFF && codepoint <= 0xFFFF) {
+            pen += TTF_GetFontKerningSizeGlyphs(font, (Uint16)previous, (Uint16)codepoint);
+        }
+        if(g->src.w > 0) {
+            SDL_Rect dst = {pen + g->offset_x, y, g->src.w, g->src.h};
+            pushQuad(dst, g->src, color, clip);
+        }
+        pen += g->advance;
+        previous = codepoint;
+    }
+    return pen - x;
+}
+
+int TextRenderer::measure(const std::string& text) {
+    if(font == NULL) { return 0; }
+    int width = 0;
+    Uint32 previous = 0;
+    size_t pos = 0;
+    while(pos < text.size()) {
+        Uint32 codepoint = nextCodepoint(text, &pos);
+        const Glyph* g = glyph(codepoint);
+        if(g == NULL) { continue; }
+        if(previous != 0 && previous <= 0xFFFF && codepoint <= 0xFFFF) {
+            width += TTF_GetFontKerningSizeGlyphs(font, (Uint16)previous, (Uint16)codepoint);
+        }
+        width += g->advance;
+        previous = codepoint;
+    }
+    return width;
+}
+
+void TextRenderer::flush() {
+    PROFILE_SCOPE("text.flush");
+    if(!indices.empty()) {
+        SDL_RenderGeometry(renderer, atlas.get(), vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+    vertices.clear();
+    indices.clear();
+}
@@ -0,0 +1,192 @@
+#include "thumbcache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Bump when the layout changes; a file with another version is reset
+#define CACHE_VERSION 1
+#define SLOT_COUNT 16384
+// Slots tried after the home slot before one is overwritten
+#define PROBE_LENGTH 8
+
+typedef struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t thumb_size;
+    uint32_t reserved;
+} CacheHeader;
+
+struct ThumbnailCache::Slot {
+    uint64_t path_hash;
+    int64_t size;
+    int64_t mtime_ns;
+    uint16_t width;
+    uint16_t height;
+    // A ThumbnailState; written last, so a slot interrupted while being filled reads as missing
+    uint32_t state;
+    Uint32 pixels[THUMB_SIZE * THUMB_SIZE];
+};
+
+static const char CacheMagic[8] = {'F', 'E', 'T', 'H', 'U', 'M', 'B', '\0'};
+
+/* 64-bit FNV-1a */
+static uint64_t hashPath(const std::string& path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < path.size(); i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ThumbnailKey thumbnailKey(const std::string& path, int64_t size, int64_t mtime_ns) {
+    ThumbnailKey key = {hashPath(path), size, mtime_ns};
+    return key;
+}
+
+ThumbnailCache::ThumbnailCache() : mapping(NULL), mapping_size(0), slots(NULL) {
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    close();
+}
+
+std::string ThumbnailCache::defaultPath() {
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    std::string dir = cache_home && cache_home[0] ? cache_home : std::string(getenv("HOME") ? getenv("HOME") : "/tmp") + "/.cache";
+    return dir + "/fileexplorer/thumbnails.bin";
+}
+
+bool ThumbnailCache::open(const std::string& path) {
+    close();
+    mapping_size = sizeof(CacheHeader) + (size_t)SLOT_COUNT * sizeof(Slot);
+
+    // Create the cache directory (one level below the cache home) if needed
+    size_t slash = path.rfind('/');
+    if(slash != std::string::npos) {
+        std::string dir = path.substr(0, slash);
+        size_t parent = dir.rfind('/');
+        if(parent != std::string::npos && parent > 0) { mkdir(dir.substr(0, parent).c_str(), 0700); }
+        mkdir(dir.c_str(), 0700);
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd >= 0) {
+        CacheHeader header;
+        struct stat info;
+        bool valid = fstat(fd, &info) == 0 && (size_t)info.st_size == mapping_size &&
+                     pread(fd, &header, sizeof(header), 0) == sizeof(header) && memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+                     header.version == CACHE_VERSION && header.slot_count == SLOT_COUNT && header.thumb_size == THUMB_SIZE;
+        if(!valid) {
+            // Start over with an empty (sparse) file of the right size
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+            header.version = CACHE_VERSION;
+            header.slot_count = SLOT_COUNT;
+            header.thumb_size = THUMB_SIZE;
+            valid = ftruncate(fd, 0) == 0 && ftruncate(fd, mapping_size) == 0 && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+        }
+        if(valid) {
+            void* mapped = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(mapped != MAP_FAILED) { mapping = (char*)mapped; }
+        }
+        ::close(fd);
+    }
+
+    bool persistent = mapping != NULL;
+    if(!persistent) {
+        fprintf(stderr, "Warning: thumbnail cache '%s' unavailable, thumbnails will not be kept after exit\n", path.c_str());
+        void* mapped = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED) {
+            mapping_size = 0;
+            return false;
+        }
+        mapping = (char*)mapped;
+    }
+    slots = (Slot*)(mapping + sizeof(CacheHeader));
+    return persistent;
+}
+
+void ThumbnailCache::close() {
+    std::lock_guard<std::mutex> guard(lock);
+    if(mapping != NULL) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = NULL;
+    slots = NULL;
+    mapping_size = 0;
+}
+
+/* The slot holding 'key', or NULL */
+ThumbnailCache::Slot* ThumbnailCache::find(const ThumbnailKey& key) {
+    if(slots == NULL) { return NULL; }
+    for(int i = 0; i < PROBE_LENGTH; i++) {
+        Slot* slot = &slots[(key.path_hash + i) % SLOT_COUNT];
+        if(slot->state != THUMB_MISSING && slot->path_hash == key.path_hash) {
+            // Same file but a different version is as good as missing; place() will overwrite it
+            return slot->size == key.size && slot->mtime_ns == key.mtime_ns ? slot : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* The slot to write 'key' into: the file's old slot, a free one, or else the home slot */
+ThumbnailCache::Slot* ThumbnailCache::place(const ThumbnailKey& key) {
+    if(slots == NULL) { return NULL; }
+    Slot* free_slot = NULL;
+    for(int i = 0; i < PROBE_LENGTH; i++) {
+        Slot* slot = &slots[(key.path_hash + i) % SLOT_COUNT];
+        if(slot->state != THUMB_MISSING && slot->path_hash == key.path_hash) { return slot; }
+        if(slot->state == THUMB_MISSING && free_slot == NULL) { free_slot = slot; }
+    }
+    return free_slot ? free_slot : &slots[key.path_hash % SLOT_COUNT];
+}
+
+ThumbnailState ThumbnailCache::lookup(const ThumbnailKey& key, Uint32* pixels, int* width, int* height) {
+    std::lock_guard<std::mutex> guard(lock);
+    Slot* slot = find(key);
+    if(slot == NULL) { return THUMB_MISSING; }
+    if(slot->state == THUMB_READY) {
+        *width = slot->width;
+        *height = slot->height;
+        memcpy(pixels, slot->pixels, sizeof(slot->pixels));
+    }
+    return (ThumbnailState)slot->state;
+}
+
+ThumbnailState ThumbnailCache::state(const ThumbnailKey& key) {
+    std::lock_guard<std::mutex> guard(lock);
+    Slot* slot = find(key);
+    return slot ? (ThumbnailState)slot->state : THUMB_MISSING;
+}
+
+void ThumbnailCache::store(const ThumbnailKey& key, const Uint32* pixels, int width, int height) {
+    std::lock_guard<std::mutex> guard(lock);
+    Slot* slot = place(key);
+    if(slot == NULL) { return; }
+    slot->state = THUMB_MISSING;
+    slot->path_hash = key.path_hash;
+    slot->size = key.size;
+    slot->mtime_ns = key.mtime_ns;
+    slot->width = width;
+    slot->height = height;
+    memcpy(slot->pixels, pixels, sizeof(slot->pixels));
+    slot->state = THUMB_READY;
+}
+
+void ThumbnailCache::storeUndecodable(const ThumbnailKey& key) {
+    std::lock_guard<std::mutex> guard(lock);
+    Slot* slot = place(key);
+    if(slot == NULL) { return; }
+    slot->state = THUMB_MISSING;
+    slot->path_hash = key.path_hash;
+    slot->size = key.size;
+    slot->mtime_ns = key.mtime_ns;
+    slot->width = slot->height = 0;
+    slot->state = THUMB_UNDECODABLE;
+}
@@ -0,0 +1,223 @@
+#include "thumbnails.h"
+#include "profiler.h"
+#include <SDL_image.h>
+#include <algorithm>
+
+// Grid of thumbnail slots in the atlas texture (enough for several screenfuls of rows)
+#define ATLAS_COLUMNS 8
+#define ATLAS_ROWS 8
+
+ThumbnailLoader::ThumbnailLoader(Uint32 notify_event, ThumbnailCache* cache, int thread_count)
+    : notify_event(notify_event), cache(cache), stopping(false), notified(false) {
+    if(thread_count <= 0) {
+        // Decoding is CPU bound, but leave cores for the UI, the scanner and the walker
+        thread_count = std::max(1, std::min(4, (int)std::thread::hardware_concurrency() / 2));
+    }
+    for(int i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&ThumbnailLoader::work, this));
+    }
+}
+
+ThumbnailLoader::~ThumbnailLoader() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    for(int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ThumbnailLoader::request(const std::string& path, int64_t size, int64_t mtime_ns) {
+    Job job;
+    job.path = path;
+    job.key = thumbnailKey(path, size, mtime_ns);
+    std::lock_guard<std::mutex> guard(lock);
+    if(!queued.insert(job.key.path_hash).second) { return; }
+    queue.push_back(job);
+    std::push_heap(queue.begin(), queue.end());
+    wake.notify_one();
+}
+
+void ThumbnailLoader::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    for(int i = 0; i < queue.size(); i++) {
+        queued.erase(queue[i].key.path_hash);
+    }
+    queue.clear();
+}
+
+void ThumbnailLoader::acknowledge() {
+    std::lock_guard<std::mutex> guard(lock);
+    notified = false;
+}
+
+/* Pushes the notify event unless one is already waiting (call with 'lock' held) */
+void ThumbnailLoader::notify() {
+    if(notified) { return; }
+    notified = true;
+    SDL_Event event = {};
+    event.type = notify_event;
+    SDL_PushEvent(&event);
+}
+
+void ThumbnailLoader::work() {
+    PROFILE_THREAD("thumbnails");
+    while(true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && queue.empty()) {
+                wake.wait(guard);
+            }
+            if(stopping) { return; }
+            std::pop_heap(queue.begin(), queue.end());
+            job = queue.back();
+            queue.pop_back();
+        }
+
+        // Another session (or an earlier request) may already have produced it
+        if(cache->state(job.key) == THUMB_MISSING) {
+            decode(job);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        queued.erase(job.key.path_hash);
+        notify();
+    }
+}
+
+/* Decodes one image and stores a box-filtered thumbnail of it in the cache */
+void ThumbnailLoader::decode(const Job& job) {
+    PROFILE_SCOPE("thumbnails.decode");
+    SDL_Surface* image = IMG_Load(job.path.c_str());
+    SDL_Surface* converted = image ? SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0) : NULL;
+    if(image) { SDL_FreeSurface(image); }
+    if(converted == NULL || converted->w <= 0 || converted->h <= 0) {
+        if(converted) { SDL_FreeSurface(converted); }
+        cache->storeUndecodable(job.key);
+        return;
+    }
+
+    // Fit inside THUMB_SIZE x THUMB_SIZE keeping the aspect ratio; small images are not enlarged
+    int width = converted->w, height = converted->h;
+    if(width > THUMB_SIZE || height > THUMB_SIZE) {
+        if(width >= height) {
+            height = std::max(1, height * THUMB_SIZE / width);
+            width = THUMB_SIZE;
+        } else {
+            width = std::max(1, width * THUMB_SIZE / height);
+            height = THUMB_SIZE;
+        }
+    }
+
+    // Each thumbnail pixel is the average of the block of source pixels it covers (premultiplied by alpha, so
+    // transparent pixels don't darken the edges)
+    std::vector<Uint32> pixels(THUMB_SIZE * THUMB_SIZE, 0);
+    const Uint8* source = (const Uint8*)converted->pixels;
+    for(int y = 0; y < height; y++) {
+        int y0 = y * converted->h / height;
+        int y1 = std::max(y0 + 1, (y + 1) * converted->h / height);
+        for(int x = 0; x < width; x++) {
+            int x0 = x * converted->w / width;
+            int x1 = std::max(x0 + 1, (x + 1) * converted->w / width);
+            uint64_t a = 0, r = 0, g = 0, b = 0;
+            for(int sy = y0; sy < y1; sy++) {
+                const Uint32* row = (const Uint32*)(source + sy * converted->pitch);
+                for(int sx = x0; sx < x1; sx++) {
+                    Uint32 pixel = row[sx];
+                    Uint32 alpha = pixel >> 24;
+                    a += alpha;
+                    r += ((pixel >> 16) & 0xff) * alpha;
+                    g += ((pixel >> 8) & 0xff) * alpha;
+                    b += (pixel & 0xff) * alpha;
+                }
+            }
+            uint64_t count = (uint64_t)(y1 - y0) * (x1 - x0);
+            if(a > 0) {
+                pixels[y * THUMB_SIZE + x] = (Uint32)(a / count) << 24 | (Uint32)(r / a) << 16 | (Uint32)(g / a) << 8 | (Uint32)(b / a);
+            }
+        }
+    }
+    SDL_FreeSurface(converted);
+    cache->store(job.key, pixels.data(), width, height);
+}
+
+ThumbnailAtlas::ThumbnailAtlas() : frame(0) {
+}
+
+bool ThumbnailAtlas::load(SDL_Renderer* renderer) {
+    atlas.reset(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                  ATLAS_COLUMNS * THUMB_SIZE, ATLAS_ROWS * THUMB_SIZE));
+    if(!atlas) {
+        fprintf(stderr, "Error: could not create thumbnail atlas: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(atlas.get(), SDL_BLENDMODE_BLEND);
+    slots.resize(ATLAS_COLUMNS * ATLAS_ROWS);
+    for(int i = 0; i < slots.size(); i++) {
+        slots[i].used = false;
+        slots[i].last_frame = 0;
+        slots[i].rect = {(i % ATLAS_COLUMNS) * THUMB_SIZE, (i / ATLAS_COLUMNS) * THUMB_SIZE, 0, 0};
+    }
+    return true;
+}
+
+void ThumbnailAtlas::unload() {
+    atlas.reset(NULL);
+    slots.clear();
+}
+
+const SDL_Rect* ThumbnailAtlas::find(const std::string& path, int64_t size, int64_t mtime_ns, ThumbnailCache* cache, ThumbnailLoader* loader) {
+    if(!atlas) { return NULL; }
+    ThumbnailKey key = thumbnailKey(path, size, mtime_ns);
+    uint64_t version = key.path_hash ^ (uint64_t)key.mtime_ns * 0x9E3779B97F4A7C15ULL ^ (uint64_t)key.size;
+    if(undecodable.count(version)) { return NULL; }
+
+    // Already uploaded
+    Slot* oldest = &slots[0];
+    for(int i = 0; i < slots.size(); i++) {
+        Slot& slot = slots[i];
+        if(slot.used && slot.key.path_hash == key.path_hash && slot.key.size == key.size && slot.key.mtime_ns == key.mtime_ns) {
+            slot.last_frame = frame;
+            return &slot.rect;
+        }
+        if(oldest->used && (!slot.used || slot.last_frame < oldest->last_frame)) { oldest = &slot; }
+    }
+    // Every slot is on screen this frame; draw the plain icon instead
+    if(oldest->used && oldest->last_frame == frame) { return NULL; }
+
+    // In the cache: copy it into the least recently drawn slot
+    std::vector<Uint32> pixels(THUMB_SIZE * THUMB_SIZE);
+    int width, height;
+    ThumbnailState state = cache->lookup(key, pixels.data(), &width, &height);
+    if(state == THUMB_UNDECODABLE) {
+        undecodable.insert(version);
+        return NULL;
+    }
+    if(state == THUMB_MISSING) {
+        if(loader) { loader->request(path, size, mtime_ns); }
+        return NULL;
+    }
+    PROFILE_SCOPE("thumbnails.upload");
+    oldest->rect.w = width;
+    oldest->rect.h = height;
+    SDL_UpdateTexture(atlas.get(), &oldest->rect, pixels.data(), THUMB_SIZE * sizeof(Uint32));
+    oldest->key = key;
+    oldest->used = true;
+    oldest->last_frame = frame;
+    return &oldest->rect;
+}
+
+SDL_Rect fitThumbnail(SDL_Rect box, int width, int height) {
+    SDL_Rect fitted = box;
+    if(width * box.h > height * box.w) {
+        fitted.h = std::max(1, height * box.w / width);
+        fitted.y += (box.h - fitted.h) / 2;
+    } else {
+        fitted.w = std::max(1, width * box.h / height);
+        fitted.x += (box.w - fitted.w) / 2;
+    }
+    return fitted;
+}
@@ -0,0 +1,403 @@
+#include "treemodel.h"
+#include "sorter.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// compact() leaves trees with fewer removed records than this alone, however sparse
+#define COMPACT_MIN_REMOVED 4096
+
+/* FNV-1a, used to place names in the intern table */
+static uint32_t hashName(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Definitions for the static constants (C++11 needs them when they are bound to references)
+const uint8_t TreeModel::NODE_DIR;
+const uint8_t TreeModel::NODE_EXPANDED;
+const uint8_t TreeModel::NODE_LISTED;
+const uint8_t TreeModel::NODE_REMOVED;
+const uint32_t TreeModel::NONE;
+
+TreeModel::TreeModel() : interned_count(0), removed_count(0) {
+}
+
+void TreeModel::reset(const std::string& root_path) {
+    nodes.clear();
+    names.clear();
+    intern_slots.assign(1024, 0);
+    interned_count = 0;
+    removed_count = 0;
+    walk_to_node.assign(1, 0);
+    visible.clear();
+    row_of.clear();
+
+    Node root;
+    root.name = intern(root_path);
+    root.parent = NONE;
+    root.first_child = 0;
+    root.child_count = 0;
+    root.depth = 0;
+    root.flags = NODE_DIR | NODE_EXPANDED;
+    nodes.push_back(root);
+}
+
+/* Returns the offset of 'name' in the string pool, adding it the first time it is seen */
+uint32_t TreeModel::intern(const std::string& name) {
+    if((interned_count + 1) * 2 > intern_slots.size()) {
+        growInternTable();
+    }
+    size_t mask = intern_slots.size() - 1;
+    size_t slot = hashName(name.c_str(), name.size()) & mask;
+    while(intern_slots[slot] != 0) {
+        const char* existing = &names[intern_slots[slot] - 1];
+        if(strcmp(existing, name.c_str()) == 0) {
+            return intern_slots[slot] - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    uint32_t offset = names.size();
+    names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+    intern_slots[slot] = offset + 1;
+    interned_count++;
+    return offset;
+}
+
+void TreeModel::growInternTable() {
+    std::vector<uint32_t> old;
+    old.swap(intern_slots);
+    intern_slots.assign(std::max((size_t)1024, old.size() * 2), 0);
+    size_t mask = intern_slots.size() - 1;
+    for(size_t i = 0; i < old.size(); i++) {
+        if(old[i] == 0) { continue; }
+        const char* existing = &names[old[i] - 1];
+        size_t slot = hashName(existing, strlen(existing)) & mask;
+        while(intern_slots[slot] != 0) { slot = (slot + 1) & mask; }
+        intern_slots[slot] = old[i];
+    }
+}
+
+/* A node is on screen when every one of its ancestors is expanded */
+bool TreeModel::isShown(uint32_t node) const {
+    for(uint32_t parent = nodes[node].parent; parent != NONE; parent = nodes[parent].parent) {
+        if(!(nodes[parent].flags & NODE_EXPANDED)) { return false; }
+    }
+    return true;
+}
+
+/* Row of a shown node; -1 for the root, which is not a row */
+int TreeModel::rowOf(uint32_t node) const {
+    if(node == 0) { return -1; }
+    return row_of[node];
+}
+
+/* Every change to the visible rows goes through these two, so 'row_of' stays current */
+void TreeModel::insertRows(int at, const std::vector<uint32_t>& rows) {
+    if(rows.empty()) { return; }
+    visible.insert(visible.begin() + at, rows.begin(), rows.end());
+    numberRows(at);
+}
+
+void TreeModel::eraseRows(int from, int to) {
+    if(from == to) { return; }
+    visible.erase(visible.begin() + from, visible.begin() + to);
+    numberRows(from);
+}
+
+/* Records the row of every node from row 'from' on (the rows before it didn't move) */
+void TreeModel::numberRows(int from) {
+    if(row_of.size() < nodes.size()) { row_of.resize(nodes.size()); }
+    for(int row = from; row < (int)visible.size(); row++) {
+        row_of[visible[row]] = row;
+    }
+}
+
+/* Appends the rows below an expanded node: its children, and recursively those of expanded children */
+void TreeModel::collectRows(uint32_t node, std::vector<uint32_t>* rows) const {
+    const Node& n = nodes[node];
+    for(uint32_t i = 0; i < n.child_count; i++) {
+        uint32_t child = n.first_child + i;
+        if(nodes[child].flags & NODE_REMOVED) { continue; }
+        rows->push_back(child);
+        if((nodes[child].flags & (NODE_EXPANDED | NODE_LISTED)) == (NODE_EXPANDED | NODE_LISTED)) {
+            collectRows(child, rows);
+        }
+    }
+}
+
+bool TreeModel::addListing(const WalkListing& listing) {
+    if(listing.node < 0 || listing.node >= (int)walk_to_node.size() || walk_to_node[listing.node] == NONE) {
+        return false;
+    }
+    uint32_t parent = walk_to_node[listing.node];
+    uint8_t child_depth = nodes[parent].depth == 255 ? 255 : nodes[parent].depth + 1;
+
+    // Children are appended contiguously, so the parent only needs the first index and a count
+    uint32_t first = nodes.size();
+    for(size_t i = 0; i < listing.entries.size(); i++) {
+        const WalkEntry& entry = listing.entries[i];
+        Node child;
+        child.name = intern(entry.name);
+        child.parent = parent;
+        child.first_child = 0;
+        child.child_count = 0;
+        child.depth = child_depth;
+        child.flags = entry.is_dir ? NODE_DIR : 0;
+        if(entry.node >= 0) {
+            if(entry.node >= (int)walk_to_node.size()) { walk_to_node.resize(entry.node + 1, NONE); }
+            walk_to_node[entry.node] = nodes.size();
+        }
+        nodes.push_back(child);
+    }
+    nodes[parent].first_child = first;
+    nodes[parent].child_count = listing.entries.size();
+    nodes[parent].flags |= NODE_LISTED;
+
+    // Listings of collapsed directories don't touch the visible rows at all
+    if(!(nodes[parent].flags & NODE_EXPANDED) || !isShown(parent)) {
+        return false;
+    }
+    std::vector<uint32_t> rows;
+    collectRows(parent, &rows);
+    insertRows(rowOf(parent) + 1, rows);
+    return !rows.empty();
+}
+
+bool TreeModel::toggle(int row) {
+    if(row < 0 || row >= (int)visible.size()) { return false; }
+    uint32_t node = visible[row];
+    if(!(nodes[node].flags & NODE_DIR)) { return false; }
+
+    nodes[node].flags ^= NODE_EXPANDED;
+    if(nodes[node].flags & NODE_EXPANDED) {
+        // Expanding a directory the walker hasn't reached yet shows its rows once the listing arrives
+        if(!(nodes[node].flags & NODE_LISTED)) { return true; }
+        std::vector<uint32_t> rows;
+        collectRows(node, &rows);
+        insertRows(row + 1, rows);
+    } else {
+        // The subtree's rows are exactly the following rows that are deeper than the node
+        int end = row + 1;
+        while(end < (int)visible.size() && nodes[visible[end]].depth > nodes[node].depth) { end++; }
+        eraseRows(row + 1, end);
+    }
+    return true;
+}
+
+std::string TreeModel::path(uint32_t node) const {
+    std::vector<uint32_t> chain;
+    for(uint32_t n = node; n != NONE; n = nodes[n].parent) { chain.push_back(n); }
+    std::string result;
+    for(int i = chain.size() - 1; i >= 0; i--) {
+        if(!result.empty()) { result += "/"; }
+        result += name(chain[i]);
+    }
+    return result;
+}
+
+/* Flags a node as removed, counting it the first time */
+void TreeModel::markRemoved(uint32_t node) {
+    if(nodes[node].flags & NODE_REMOVED) { return; }
+    nodes[node].flags |= NODE_REMOVED;
+    removed_count++;
+}
+
+/* Flags everything below 'node' as removed */
+void TreeModel::removeSubtree(uint32_t node) {
+    std::vector<uint32_t> stack(1, node);
+    while(!stack.empty()) {
+        uint32_t parent = stack.back();
+        stack.pop_back();
+        for(uint32_t i = 0; i < nodes[parent].child_count; i++) {
+            uint32_t child = nodes[parent].first_child + i;
+            markRemoved(child);
+            stack.push_back(child);
+        }
+    }
+}
+
+int TreeModel::findDirectory(const std::string& path) const {
+    if(nodes.empty()) { return -1; }
+    const char* root = name(0);
+    size_t root_length = strlen(root);
+    if(path.compare(0, root_length, root) != 0 || (path.size() > root_length && root_length > 0 &&
+                                                   root[root_length - 1] != '/' && path[root_length] != '/')) {
+        return -1;
+    }
+    // Follow the components below the root, matching each among the children of the one before
+    uint32_t node = 0;
+    size_t start = root_length;
+    while(start < path.size()) {
+        size_t end = path.find('/', start);
+        if(end == std::string::npos) { end = path.size(); }
+        if(end > start) {
+            const Node& parent = nodes[node];
+            uint32_t found = NONE;
+            for(uint32_t i = 0; i < parent.child_count && found == NONE; i++) {
+                uint32_t child = parent.first_child + i;
+                if((nodes[child].flags & (NODE_DIR | NODE_REMOVED)) == NODE_DIR && path.compare(start, end - start, name(child)) == 0 &&
+                   strlen(name(child)) == end - start) {
+                    found = child;
+                }
+            }
+            if(found == NONE) { return -1; }
+            node = found;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+bool TreeModel::updateChildren(uint32_t node, const std::vector<WalkEntry>& present, const std::vector<std::string>& gone, bool complete) {
+    Node& parent_node = nodes[node];
+    bool was_listed = parent_node.flags & NODE_LISTED;
+    std::vector<Child> children;
+    std::unordered_map<std::string, size_t> present_index;
+    for(size_t p = 0; p < present.size(); p++) { present_index[present[p].name] = p; }
+    std::unordered_set<std::string> gone_names(gone.begin(), gone.end());
+    // Entries of 'present' that are an old child staying as it was
+    std::vector<bool> kept(present.size(), false);
+    std::vector<uint32_t> dropped;
+    bool changed = !was_listed && complete;
+    for(uint32_t i = 0; i < parent_node.child_count; i++) {
+        uint32_t old = parent_node.first_child + i;
+        // Flagged by an earlier update
+        if(nodes[old].flags & NODE_REMOVED) { continue; }
+        const char* old_name = name(old);
+        bool is_dir = nodes[old].flags & NODE_DIR;
+        bool keep = !gone_names.count(old_name);
+        std::unordered_map<std::string, size_t>::iterator match = present_index.find(old_name);
+        if(match != present_index.end()) {
+            // A file that became a directory (or the other way round) is a new node
+            if(present[match->second].is_dir != is_dir) {
+                keep = false;
+            } else {
+                kept[match->second] = keep;
+            }
+        } else if(complete) {
+            keep = false;
+        }
+        if(keep) {
+            Child child = {old_name, is_dir, old};
+            children.push_back(child);
+        } else {
+            dropped.push_back(old);
+            changed = true;
+        }
+    }
+    bool added = false;
+    for(size_t p = 0; p < present.size(); p++) {
+        if(kept[p]) { continue; }
+        Child child = {present[p].name, present[p].is_dir, NONE};
+        children.push_back(child);
+        added = true;
+    }
+    if(!changed && !added) { return false; }
+
+    // Rows currently shown below the directory, to be replaced
+    bool shown = node == 0 || ((parent_node.flags & NODE_EXPANDED) && isShown(node));
+    int row = shown ? rowOf(node) : -1;
+    size_t old_rows = 0;
+    if(shown && was_listed) {
+        std::vector<uint32_t> rows;
+        collectRows(node, &rows);
+        old_rows = rows.size();
+    }
+
+    // The children that didn't stay are dropped with their subtrees
+    for(size_t c = 0; c < dropped.size(); c++) {
+        markRemoved(dropped[c]);
+        removeSubtree(dropped[c]);
+    }
+    // Entries that only went away are flagged where they are; new ones need a new run, which replaces the old one
+    if(added) {
+        moveChildren(node, &children);
+    }
+    nodes[node].flags |= NODE_LISTED;
+
+    if(!shown) { return false; }
+    std::vector<uint32_t> rows;
+    collectRows(node, &rows);
+    eraseRows(row + 1, row + 1 + old_rows);
+    insertRows(row + 1, rows);
+    return true;
+}
+
+/* Gives directory 'node' a new run of children at the end of the tree, in name order: the old children that stay are
+   moved there (with what is known below them), the rest are new. The old run is flagged as removed */
+void TreeModel::moveChildren(uint32_t node, std::vector<Child>* children_ptr) {
+    std::vector<Child>& children = *children_ptr;
+    sortByName(&children, [](const Child& child) -> const std::string& { return child.name; });
+    uint8_t child_depth = nodes[node].depth == 255 ? 255 : nodes[node].depth + 1;
+    for(uint32_t i = 0; i < nodes[node].child_count; i++) {
+        markRemoved(nodes[node].first_child + i);
+    }
+    uint32_t first = nodes.size();
+    for(size_t c = 0; c < children.size(); c++) {
+        Node child;
+        if(children[c].old != NONE) {
+            // Move the node and point its own children at the new copy
+            child = nodes[children[c].old];
+            child.flags &= ~NODE_REMOVED;
+            for(uint32_t g = 0; g < child.child_count; g++) { nodes[child.first_child + g].parent = first + c; }
+        } else {
+            child.name = intern(children[c].name);
+            child.parent = node;
+            child.first_child = 0;
+            child.child_count = 0;
+            child.depth = child_depth;
+            child.flags = children[c].is_dir ? NODE_DIR : 0;
+        }
+        nodes.push_back(child);
+    }
+    nodes[node].first_child = first;
+    nodes[node].child_count = children.size();
+}
+
+bool TreeModel::compact() {
+    size_t live = nodes.size() - removed_count;
+    if(removed_count < COMPACT_MIN_REMOVED || removed_count < live) { return false; }
+    // Copy the live nodes breadth first, so every directory's children stay one contiguous run; names are interned afresh
+    std::vector<Node> old_nodes;
+    old_nodes.swap(nodes);
+    std::vector<char> old_names;
+    old_names.swap(names);
+    intern_slots.assign(1024, 0);
+    interned_count = 0;
+    std::vector<uint32_t> moved(old_nodes.size(), NONE);
+    nodes.reserve(live);
+    nodes.push_back(old_nodes[0]);
+    nodes[0].name = intern(&old_names[old_nodes[0].name]);
+    moved[0] = 0;
+    for(uint32_t at = 0; at < nodes.size(); at++) {
+        uint32_t first = nodes[at].first_child;
+        uint32_t count = nodes[at].child_count;
+        nodes[at].first_child = nodes.size();
+        for(uint32_t i = first; i < first + count; i++) {
+            if(old_nodes[i].flags & NODE_REMOVED) { continue; }
+            moved[i] = nodes.size();
+            Node child = old_nodes[i];
+            child.name = intern(&old_names[old_nodes[i].name]);
+            child.parent = at;
+            nodes.push_back(child);
+        }
+        nodes[at].child_count = nodes.size() - nodes[at].first_child;
+    }
+    for(size_t i = 0; i < walk_to_node.size(); i++) {
+        if(walk_to_node[i] != NONE) { walk_to_node[i] = moved[walk_to_node[i]]; }
+    }
+    // Shown nodes are never removed ones
+    for(size_t row = 0; row < visible.size(); row++) {
+        visible[row] = moved[visible[row]];
+    }
+    row_of.assign(nodes.size(), 0);
+    numberRows(0);
+    removed_count = 0;
+    return true;
+}
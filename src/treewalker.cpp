@@ -0,0 +1,266 @@
+#include "treewalker.h"
+#include "sorter.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+TreeWalker::DirHandle::~DirHandle() {
+    if(fd >= 0) { close(fd); }
+}
+
+TreeWalker::TreeWalker(Uint32 notify_event, int thread_count)
+    : notify_event(notify_event), thread_count(thread_count), generation(0), active(false),
+      pending_finished(false), notified(false) {
+    if(this->thread_count <= 0) {
+        // One worker per core, but at least two so a slow directory never stalls the walk
+        this->thread_count = std::max(2, std::min(8, (int)std::thread::hardware_concurrency()));
+    }
+}
+
+TreeWalker::~TreeWalker() {
+    cancel();
+    // Only here are the workers waited for; they all stop soon after the generation changed
+    for(int i = 0; i < retired.size(); i++) {
+        retired[i].join();
+    }
+}
+
+/* Doesn't wait for the workers: they notice the generation change between entries and finish on their own walk's
+   state, and whatever they still publish is dropped. A directory stuck on a slow mount can't hold up the UI */
+void TreeWalker::cancel() {
+    generation++;
+    if(current) {
+        std::lock_guard<std::mutex> guard(current->idle_lock);
+        current->idle.notify_all();
+    }
+    current.reset();
+    active = false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    for(int i = 0; i < workers.size(); i++) {
+        retired.push_back(std::move(workers[i]));
+    }
+    workers.clear();
+    // Reap the workers that returned since; the rest are joined by a later cancel() or the destructor
+    for(int i = 0; i < retired.size(); ) {
+        std::vector<std::thread::id>::iterator done = std::find(exited.begin(), exited.end(), retired[i].get_id());
+        if(done == exited.end()) { i++; continue; }
+        exited.erase(done);
+        retired[i].join();
+        retired.erase(retired.begin() + i);
+    }
+    pending.clear();
+    pending_finished = false;
+    notified = false;
+}
+
+void TreeWalker::start(const std::string& root) {
+    cancel();
+    std::shared_ptr<Walk> walk(new Walk());
+    walk->id = generation;
+    walk->next_node = 1;
+    walk->outstanding = 1;
+    for(int i = 0; i < thread_count; i++) {
+        walk->queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    current = walk;
+    active = true;
+
+    // The root is node 0 and is opened by path; everything below it is opened relative to its parent
+    Task task;
+    task.node = 0;
+    task.name = root;
+    task.path = root;
+    walk->queues[0]->tasks.push_back(task);
+
+    for(int i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&TreeWalker::work, this, i, walk));
+    }
+}
+
+void TreeWalker::takeListings(std::vector<WalkListing>* out, bool* finished) {
+    std::vector<WalkListing> front;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        front.swap(pending);
+        *finished = pending_finished;
+        pending_finished = false;
+        notified = false;
+    }
+    out->insert(out->end(), std::make_move_iterator(front.begin()), std::make_move_iterator(front.end()));
+}
+
+void TreeWalker::push(Walk& walk, int index, Task task) {
+    {
+        std::lock_guard<std::mutex> guard(walk.queues[index]->lock);
+        walk.queues[index]->tasks.push_back(std::move(task));
+    }
+    std::lock_guard<std::mutex> guard(walk.idle_lock);
+    walk.idle.notify_one();
+}
+
+/* Pops the newest task of this worker's own queue (depth first, keeps few descriptors open),
+   otherwise steals the oldest task of another worker (breadth first, the biggest pieces of work) */
+bool TreeWalker::nextTask(Walk& walk, int index, Task* task) {
+    {
+        WorkQueue& own = *walk.queues[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()) {
+            *task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for(int i = 1; i < thread_count; i++) {
+        WorkQueue& victim = *walk.queues[(index + i) % thread_count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()) {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TreeWalker::work(int index, std::shared_ptr<Walk> walk) {
+    PROFILE_THREAD("walker");
+    while(generation == walk->id) {
+        Task task;
+        if(nextTask(*walk, index, &task)) {
+            list(*walk, index, task);
+            // The last task to finish ends the walk and wakes everyone so they can exit
+            if(--walk->outstanding == 0) {
+                WalkListing none;
+                none.node = -1;
+                publish(&none, true, walk->id);
+                std::lock_guard<std::mutex> guard(walk->idle_lock);
+                walk->idle.notify_all();
+            }
+            continue;
+        }
+        if(walk->outstanding == 0) { break; }
+        std::unique_lock<std::mutex> guard(walk->idle_lock);
+        walk->idle.wait_for(guard, std::chrono::milliseconds(5));
+    }
+    // Lets cancel() join this thread without waiting
+    std::lock_guard<std::mutex> guard(lock);
+    exited.push_back(std::this_thread::get_id());
+}
+
+/* Records a directory as visited; returns false if it has been descended into before */
+bool TreeWalker::markVisited(Walk& walk, dev_t dev, ino_t ino) {
+    std::lock_guard<std::mutex> guard(walk.visited_lock);
+    return walk.visited.insert(std::make_pair(dev, ino)).second;
+}
+
+/* Lists one directory, publishes its sorted contents and queues its subdirectories */
+void TreeWalker::list(Walk& walk, int index, Task& task) {
+    PROFILE_SCOPE("walk.list");
+    int fd = -1;
+    // Below the root, a directory swapped for a symlink since it was listed is not followed either
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.parent ? O_NOFOLLOW : 0);
+    if(task.parent) {
+        fd = openat(task.parent->fd, task.name.c_str(), flags);
+    }
+    // The root, or out of descriptors: fall back to the full path
+    if(fd < 0 && (!task.parent || errno == EMFILE || errno == ENFILE)) {
+        fd = open(task.path.c_str(), flags);
+    }
+    // Unreadable directories simply show up empty
+    if(fd < 0) { return; }
+    // The descriptor is shared with the tasks of the subdirectories and closed once the last of them has opened its own
+    std::shared_ptr<DirHandle> handle(new DirHandle(fd));
+
+    struct stat info;
+    if(fstat(fd, &info) != 0) { return; }
+    // The walk stays on the root's file system; its subdirectories are only queued after this is set
+    if(task.node == 0) { walk.device = info.st_dev; }
+    // Mount points show up as empty directories, like ones already visited (through a bind mount)
+    if(info.st_dev != walk.device || !markVisited(walk, info.st_dev, info.st_ino)) {
+        return;
+    }
+
+    // fdopendir takes ownership of the descriptor it is given, so hand it a duplicate
+    int list_fd = dup(fd);
+    DIR* dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if(dir == NULL) {
+        if(list_fd >= 0) { close(list_fd); }
+        return;
+    }
+
+    WalkListing listing;
+    listing.node = task.node;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(generation != walk.id) { closedir(dir); return; }
+        std::string name = entry->d_name;
+        if(name == "." || name == "..") { continue; }
+
+        WalkEntry walked;
+        walked.name = name;
+        walked.node = -1;
+        if(entry->d_type == DT_DIR) {
+            walked.is_dir = true;
+        } else if(entry->d_type == DT_UNKNOWN) {
+            // Only entries whose type readdir doesn't know need a stat; symlinks are leaves, never followed
+            struct stat file_info;
+            walked.is_dir = fstatat(fd, entry->d_name, &file_info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(file_info.st_mode);
+        } else {
+            walked.is_dir = false;
+        }
+        listing.entries.push_back(walked);
+    }
+    closedir(dir);
+
+    // Sort case-insensitively and naturally, breaking ties by the raw name so the order never depends on readdir or on thread timing
+    sortByName(&listing.entries, [](const WalkEntry& walked) -> const std::string& { return walked.name; });
+
+    // Number the subdirectories before publishing, so a parent's listing always precedes its children's
+    std::vector<Task> children;
+    for(int i = 0; i < listing.entries.size(); i++) {
+        if(!listing.entries[i].is_dir) { continue; }
+        listing.entries[i].node = walk.next_node++;
+        Task child;
+        child.node = listing.entries[i].node;
+        child.parent = handle;
+        child.name = listing.entries[i].name;
+        child.path = task.path + "/" + listing.entries[i].name;
+        children.push_back(std::move(child));
+    }
+    publish(&listing, false, walk.id);
+
+    walk.outstanding += children.size();
+    // Push in reverse so this worker pops the first subdirectory next
+    for(int i = children.size() - 1; i >= 0; i--) {
+        push(walk, index, std::move(children[i]));
+    }
+}
+
+/* Hands a listing to the UI thread, unless the walk has been cancelled in the meantime */
+void TreeWalker::publish(WalkListing* listing, bool last, unsigned int walk_id) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(generation != walk_id) { return; }
+        if(listing->node >= 0) {
+            pending.push_back(std::move(*listing));
+        }
+        pending_finished = last;
+        // Only the current walk's last task clears this, so a cancelled walk can't end the new one
+        if(last) { active = false; }
+        // One queued event is enough, the UI thread takes everything pending when it handles it
+        wake = !notified;
+        notified = true;
+    }
+    if(wake) {
+        SDL_Event event = {};
+        event.type = notify_event;
+        SDL_PushEvent(&event);
+    }
+}